@@ -58,6 +58,8 @@ enum BoronEvalCells
 
 
 extern UPortDevice port_file;
+extern int file_openBuffered( UThread*, const UCell* from, int opt, int size,
+                              UCell* res );
 #ifdef CONFIG_SOCKET
 extern UPortDevice port_socket;
 #endif
@@ -67,6 +69,10 @@ extern UPortDevice port_ssl;
 #ifdef CONFIG_THREAD
 extern UPortDevice port_thread;
 #endif
+#ifdef __linux
+extern UPortDevice port_waitSet;
+extern UPortDevice port_timer;
+#endif
 
 #include "boron_types.c"
 
@@ -172,6 +178,8 @@ static void boron_threadInit( UThread* ut )
     BT->requestAccess = NULL;
 
     ur_arrInit( &BT->frames, sizeof(UIndex), 0 );
+    BT->sched = NULL;
+    BT->poller = NULL;
 
     ur_arrReserve( &ut->stack, 512 );
     BT->stackLimit = ut->stack.ptr.cell + 512 - 8;
@@ -188,6 +196,8 @@ static void boron_threadMethod( UThread* ut, enum UThreadMethod op )
             break;
 
         case UR_THREAD_FREE:
+            boron_freeScheduler( ut );
+            boron_freePoller( BT->poller );
             ur_arrFree( &BT->frames );
             ur_binFree( &BT->tbin );
             // Other data is in dataStore, so there is nothing more to free.
@@ -668,8 +678,15 @@ extern CFUNC_PUB( cfunc_hostname );
 extern CFUNC_PUB( cfunc_execute );
 extern CFUNC_PUB( cfunc_with_flock );
 #endif
+#ifdef CONFIG_THREAD
+extern CFUNC_PUB( cfunc_task );
+extern CFUNC_PUB( cfunc_await );
+extern void boron_freeTaskPool( UThread* );
+#endif
 extern CFUNC_PUB( cfunc_sleep );
 extern CFUNC_PUB( cfunc_wait );
+extern CFUNC_PUB( cfunc_spawn );
+extern CFUNC_PUB( cfunc_yield );
 
 #ifdef CFUNC_SERIALIZED
 #include "cfunc_table.c"
@@ -750,6 +767,9 @@ UThread* boron_makeEnv( UEnvParameters* par )
     dt_context.make = context_make_override;
 
     BENV->funcRead = cfunc_read;
+#ifdef CONFIG_THREAD
+    BENV->taskPool = NULL;
+#endif
 
     ur_internAtoms( ut, "none true false file udp tcp thread"
         " func | local extern no-trace"
@@ -778,6 +798,10 @@ UThread* boron_makeEnv( UEnvParameters* par )
     boron_addPortDevice( ut, &port_ssl,    atoms[10] );
     boron_addPortDevice( ut, &port_ssl,    atoms[11] );
 #endif
+#ifdef __linux
+    boron_addPortDevice( ut, &port_waitSet, ur_intern( ut, "wait-set", 8 ) );
+    boron_addPortDevice( ut, &port_timer,   ur_intern( ut, "timer", 5 ) );
+#endif
 
 
     // Add some useful words.
@@ -854,6 +878,9 @@ void boron_freeEnv( UThread* ut )
 {
     if( ut )
     {
+#ifdef CONFIG_THREAD
+        boron_freeTaskPool( ut );
+#endif
         ur_ctxFree( &BENV->ports );
         ur_freeEnv( ut );
     }
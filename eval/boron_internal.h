@@ -28,12 +28,55 @@ typedef struct
     UBuffer ports;
     UStatus (*funcRead)( UThread*, UCell*, UCell* );
     UAtom   compileAtoms[5];
+#ifdef CONFIG_THREAD
+    void*   taskPool;
+#endif
 }
 BoronEnv;
 
 #define BENV      ((BoronEnv*) ut->env)
 
 
+enum CoroutineState
+{
+    CO_READY,
+    CO_WAITING,
+    CO_RUNNING,
+    CO_DONE,
+    CO_ERROR
+};
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    UThread* ut;            // Zero once the thread is freed.
+    void*   wait;           // WaitInfo of coroutine blocked in wait.
+    double  deadline;       // Wait timeout as ur_now() time, or zero.
+    int     waitResult;     // Ready port index or -1 on timeout.
+    int     state;
+    int     slot;           // Index in CoScheduler list.
+    int     timerPos;       // Index in CoScheduler timers or -1.
+    void*   joiners;        // Waits on the coroutine port (see wait.c).
+    UIndex  stackN;         // Block holding the idle evaluation stack.
+    UIndex  stackHold;
+    UIndex  portHold;
+    UCell*  stackLimit;
+    UBuffer frames;
+}
+Coroutine;
+
+
+typedef struct CoScheduler
+{
+    Coroutine* current;     // Running coroutine or zero if in scheduler.
+    UBuffer list;           // Coroutine pointers of unfinished coroutines.
+    UBuffer ready;          // Queue of coroutines to run (zero if closed).
+    UBuffer timers;         // Min-heap of waiting coroutines by deadline.
+}
+CoScheduler;
+
+
 typedef struct BoronThread
 {
     UThread thread;
@@ -42,6 +85,8 @@ typedef struct BoronThread
     UCell*  stackLimit;
     UBuffer frames;         // Function body & locals stack position.
     UCell   optionCell;
+    CoScheduler* sched;
+    void* poller;           // Ports waited on (see wait.c).
 #ifdef CONFIG_RANDOM
     Well512 rand;
 #endif
@@ -58,5 +103,17 @@ BoronThread;
 
 extern UIndex boron_seriesEnd( UThread* ut, const UCell* cell );
 
+#define boron_coCurrent(ut) (BT->sched ? BT->sched->current : NULL)
+extern UPortDevice port_coroutine;
+extern void boron_coReady( UThread*, Coroutine* );
+extern void boron_coRunReady( UThread* );
+extern void boron_coSuspend( UThread* );
+extern void boron_freeScheduler( UThread* );
+extern void boron_freePoller( void* );
+extern void boron_waitCancel( UThread*, Coroutine* );
+extern void boron_waitNotify( UThread*, Coroutine* );
+extern void boron_waitDetach( UThread*, Coroutine* );
+extern UStatus boron_waitPort( UThread*, const UCell* portC );
+
 
 #endif  // BORON_INTERNAL_H
@@ -3884,17 +3884,38 @@ CFUNC(cfunc_setenv)
         /write  Write-only mode.
         /new    Create empty file.
         /nowait Non-blocking reads.
+        /reuse  Let other sockets listen on the same address.
+        /buffer Buffer file reads & writes in memory.
+            size int!
     return: port!
     group: io
     see: close
 
     Create port!.
+
+    The /reuse option sets SO_REUSEPORT on a listening socket so that
+    several threads can each open a listener on the same address and have
+    the system share connections between them.
+
+    The /buffer option batches small reads & writes of a file! or
+    int! (standard I/O) port into fewer system calls.  Pending output is
+    written when the port is closed, read, or positioned (use skip 0 to
+    flush it without moving).
 */
 CFUNC(cfunc_open)
 {
+#define OPT_OPEN_BUFFER 0x20
+    int opt = CFUNC_OPTIONS;
+    if( opt & OPT_OPEN_BUFFER )
+    {
+        if( ! ur_is(a1, UT_FILE) && ! ur_is(a1, UT_INT) )
+            return errorType( "open /buffer expected file!/int! device" );
+        return file_openBuffered( ut, a1, opt & ~OPT_OPEN_BUFFER,
+                                  ur_int(CFUNC_OPT_ARG(6)), res );
+    }
     if( ur_is(a1, UT_FILE) )
-        return port_file.open( ut, &port_file, a1, CFUNC_OPTIONS, res );
-    return port_makeOpt( ut, a1, CFUNC_OPTIONS, res );
+        return port_file.open( ut, &port_file, a1, opt, res );
+    return port_makeOpt( ut, a1, opt, res );
 }
 
 
@@ -3924,6 +3945,8 @@ CFUNC(cfunc_close)
 #define OPT_READ_INTO   0x02
 #define OPT_READ_APPEND 0x04
 #define OPT_READ_PART   0x08
+#define OPT_READ_MMAP   0x10
+#define OPT_READ_SERIAL 0x20
 
 /*
   \param len   Default length.
@@ -4010,14 +4033,71 @@ static int _readBuffer( UThread* ut, uint32_t opt, const UCell* a1,
 }
 
 
+#ifdef CONFIG_SOCKET
+extern UPortDevice port_socket;
+extern UPortDevice port_listenSocket;
+extern int socket_readBatch( UThread*, UBuffer* port, UIndex blkN,
+                             int count );
+
+/*
+  Read datagrams from a UDP socket or connections from a listening socket
+  into a block.
+*/
+static int _readBatch( UThread* ut, const UCell* a1, UBuffer* pbuf,
+                       UCell* res )
+{
+    uint32_t opt = CFUNC_OPTIONS;
+    const UCell* ic = CFUNC_OPT_ARG( (opt & OPT_READ_APPEND ? 3 : 2) );
+    UBuffer* blk;
+    int n;
+
+    blk = ur_bufferSerM( ic );
+    if( ! blk )
+        return UR_THROW;
+    if( opt & OPT_READ_INTO )
+        blk->used = 0;
+
+    n = socket_readBatch( ut, pbuf, ic->series.buf,
+                          (opt & OPT_READ_PART) ? ur_int(CFUNC_OPT_ARG(4))
+                                                : 0 );
+    if( n < 0 )
+        return UR_THROW;
+    if( n )
+        *res = *ic;
+    else
+        ur_setId(res, UT_NONE);
+    return UR_OK;
+}
+#endif
+
+
 CFUNC_PUB(cfunc_readPort)
 {
-    PORT_SITE(dev, pbuf, a1);
     int len;
 
+    if( ! boron_waitPort( ut, a1 ) )    // May run coroutines.
+        return UR_THROW;
+    {
+    PORT_SITE(dev, pbuf, a1);
+
     if( ! dev )
         return errorScript( "cannot read from closed port" );
 
+#ifdef CONFIG_SOCKET
+    if( CFUNC_OPTIONS & (OPT_READ_INTO | OPT_READ_APPEND) )
+    {
+        const UCell* ic = CFUNC_OPT_ARG(
+                    (CFUNC_OPTIONS & OPT_READ_APPEND ? 3 : 2) );
+        if( ur_is(ic, UT_BLOCK) )
+        {
+            if( dev != &port_socket && dev != &port_listenSocket )
+                return errorScript(
+                            "read /into block! expected socket port" );
+            return _readBatch( ut, a1, pbuf, res );
+        }
+    }
+#endif
+
     len = dev->defaultReadLen;
     if( len > 0 )
     {
@@ -4028,22 +4108,222 @@ CFUNC_PUB(cfunc_readPort)
     }
 
     return dev->read( ut, pbuf, res, len );
+    }
 }
 
 
 extern int ur_readDir( UThread*, const char* filename, UCell* res );
 
+#ifndef _WIN32
+static int _readMapped( UThread* ut, uint32_t opt, const UCell* a1,
+                        const char* filename, int64_t size, UCell* res )
+{
+    UBuffer* dest;
+    FILE* fp;
+    int n;
+
+    if( opt & (OPT_READ_TEXT | OPT_READ_INTO | OPT_READ_APPEND) )
+        return errorScript( "read /mmap cannot be used with /text, /into,"
+                            " or /append" );
+    if( opt & OPT_READ_PART )
+    {
+        n = ur_int(CFUNC_OPT_ARG(4));
+        if( size > n )
+            size = (n > 0) ? n : 0;
+    }
+    if( size > INT32_MAX )
+    {
+        // A binary! cannot hold it, so the file is streamed from a port.
+        UCell file = *a1;
+        ur_type(&file) = UT_FILE;
+        return port_file.open( ut, &port_file, &file, UR_PORT_READ, res );
+    }
+    if( ! size )
+    {
+        ur_setId(res, UT_NONE);
+        return UR_OK;
+    }
+
+    fp = fopen( filename, "rb" );
+    if( ! fp )
+        return ur_error( ut, UR_ERR_ACCESS,
+                         "could not open file %s", filename );
+    dest = ur_makeBinaryCell( ut, 0, res );
+    n = ur_binMapFile( dest, fileno( fp ), (int) size );
+    fclose( fp );
+    if( ! n )
+        return ur_error( ut, UR_ERR_ACCESS, "mmap %s - %s",
+                         filename, strerror(errno) );
+    return UR_OK;
+}
+#endif
+
+
+#define SERIAL_CHUNK    0x10000
+
+typedef struct
+{
+    const UCell* portC;
+    FILE* fp;
+    UIndex chunkN;      // Binary to pass data to port device.
+}
+SerialIO;
+
+
+static int _serialRead( UThread* ut, void* user, uint8_t* dest, int len )
+{
+    SerialIO* io = (SerialIO*) user;
+    UBuffer* chunk;
+    UCell dc;
+
+    if( io->fp )
+    {
+        size_t n = fread( dest, 1, len, io->fp );
+        if( n == 0 && ferror( io->fp ) )
+        {
+            ur_error( ut, UR_ERR_ACCESS, "fread error" );
+            return -1;
+        }
+        return (int) n;
+    }
+
+    if( ! boron_waitPort( ut, io->portC ) )     // May run coroutines.
+        return -1;
+    {
+    PORT_SITE(dev, pbuf, io->portC);
+    if( ! dev )
+    {
+        errorScript( "cannot read from closed port" );
+        return -1;
+    }
+    if( len > SERIAL_CHUNK )
+        len = SERIAL_CHUNK;
+    chunk = ur_buffer( io->chunkN );
+    chunk->used = 0;
+    ur_initSeries( &dc, UT_BINARY, io->chunkN );
+    if( ! dev->read( ut, pbuf, &dc, len ) )
+        return -1;
+    if( ur_is(&dc, UT_NONE) )
+        return 0;
+    chunk = ur_buffer( io->chunkN );
+    memCpy( dest, chunk->ptr.b, chunk->used );
+    return chunk->used;
+    }
+}
+
+
+static UStatus _serialWrite( UThread* ut, void* user, const uint8_t* data,
+                             int len )
+{
+    SerialIO* io = (SerialIO*) user;
+    UBuffer* chunk;
+    UCell dc;
+    int n;
+
+    if( io->fp )
+    {
+        if( fwrite( data, 1, len, io->fp ) != (size_t) len )
+            return ur_error( ut, UR_ERR_ACCESS, "fwrite error" );
+        return UR_OK;
+    }
+
+    ur_initSeries( &dc, UT_BINARY, io->chunkN );
+    while( len )
+    {
+        PORT_SITE(dev, pbuf, io->portC);
+        if( ! dev )
+            return errorScript( "cannot write to closed port" );
+        n = (len > SERIAL_CHUNK) ? SERIAL_CHUNK : len;
+        chunk = ur_buffer( io->chunkN );
+        memCpy( chunk->ptr.b, data, n );
+        chunk->used = n;
+        if( ! dev->write( ut, pbuf, &dc ) )
+            return UR_THROW;
+        data += n;
+        len  -= n;
+    }
+    return UR_OK;
+}
+
+
+/*
+  Open file or make port chunk buffer for ur_serializeStream() or
+  ur_unserializeStream().  Return hold of chunk, UR_INVALID_HOLD for a
+  file, or -2 if an error was thrown.
+*/
+static int _serialOpen( UThread* ut, SerialIO* io, const UCell* dest,
+                        const char* mode )
+{
+    io->fp = NULL;
+    io->portC = dest;
+    if( ur_is(dest, UT_PORT) )
+    {
+        io->chunkN = ur_makeBinary( ut, SERIAL_CHUNK );
+        return ur_hold( io->chunkN );
+    }
+    else if( ur_isStringType( ur_type(dest) ) )
+    {
+        const char* filename = boron_cpath( ut, dest, 0 );
+        if( *mode != 'r' &&
+            ! boron_requestAccess( ut, "Write file \"%s\"", filename ) )
+            return -2;
+        io->fp = fopen( filename, mode );
+        if( ! io->fp )
+        {
+            ur_error( ut, UR_ERR_ACCESS, "could not open %s", filename );
+            return -2;
+        }
+        return UR_INVALID_HOLD;
+    }
+    errorType( "serialized stream expected file!/string!/port!" );
+    return -2;
+}
+
+
+static UStatus _serialClose( UThread* ut, SerialIO* io, int hold )
+{
+    if( io->fp )
+    {
+        int err = fclose( io->fp );
+        if( err )
+            return ur_error( ut, UR_ERR_ACCESS, "fclose error" );
+    }
+    else
+        ur_release( hold );
+    return UR_OK;
+}
+
+
+/*
+  read/serialized
+*/
+static UStatus _readSerialized( UThread* ut, const UCell* src, UCell* res )
+{
+    SerialIO io;
+    UStatus ok;
+    int hold = _serialOpen( ut, &io, src, "rb" );
+    if( hold == -2 )
+        return UR_THROW;
+    ok = ur_unserializeStream( ut, 0, _serialRead, &io, res );
+    if( ! _serialClose( ut, &io, hold ) )
+        return UR_THROW;
+    return ok;
+}
+
+
 /*-cf-
     read
         source      file!/string!/port!
         /text       Read as text rather than binary.
         /into       Put data into existing buffer.
-            buffer  binary!/string!
+            buffer  binary!/string!/block!
         /append     Append data to existing buffer.
-            abuf    binary!/string!
-        /part       Read a specific number of bytes.
+            abuf    binary!/string!/block!
+        /part       Read a specific number of bytes (or datagrams).
             size    int!
-    return: binary!/string!/block!/none!
+        /mmap       Map file into memory as a read-only binary!.
+        /serialized Read one block! written by write/serialized.
+    return: binary!/string!/block!/port!/none!
     group: io
     see: load, write
 
@@ -4053,11 +4333,32 @@ extern int ur_readDir( UThread*, const char* filename, UCell* res );
     When source is a file name the entire file will be read into memory
     unless /part is used.
 
+    The /mmap option maps a file rather than copying it, so pages are only
+    loaded from the cache as they are accessed.  The binary! cannot be
+    modified and the file is unmapped when it is freed or garbage collected.
+    It cannot be used with /text, /into, or /append.  A file of 2 GiB or
+    more (unless /part is smaller) is too large for a binary!, so a file
+    port opened for reading is returned instead.  On Windows the file is
+    read normally.
+
     If the /text option is used or the /into buffer is a string! then the
     file is read as UTF-8 data and carriage returns are filtered on Windows.
 
     If source is a directory name then a block containing file names is
     returned.
+
+    If source is a UDP socket port and the /into or /append buffer is a
+    block! then up to 16 waiting datagrams (or the /part count, at most
+    64) are read at once.  Each is added as a binary! followed by its
+    source address as a "host:port" string!.
+
+    Reading a listening socket /into a block! accepts all the waiting
+    connections (or the /part count) and adds their ports.
+
+    The /serialized option decodes the stream made by write/serialized
+    as it is read, without holding all the input in memory.  Nothing past
+    the end of the stream is read, so many blocks can be sent over one
+    connection.  None is returned if the source is already at its end.
 */
 CFUNC(cfunc_read)
 {
@@ -4066,6 +4367,8 @@ CFUNC(cfunc_read)
     uint32_t opt;
     int len;
 
+    if( CFUNC_OPTIONS & OPT_READ_SERIAL )
+        return _readSerialized( ut, a1, res );
 
     if( ur_is(a1, UT_PORT) )
         return cfunc_readPort( ut, a1, res );
@@ -4083,6 +4386,10 @@ CFUNC(cfunc_read)
         return ur_readDir( ut, filename, res );
 
     opt = CFUNC_OPTIONS;
+#ifndef _WIN32
+    if( opt & OPT_READ_MMAP )
+        return _readMapped( ut, opt, a1, filename, info.size, res );
+#endif
     len = _readBuffer( ut, opt, a1, res, (int) info.size ); // gc!
     if( len > 0 )
     {
@@ -4131,22 +4438,488 @@ CFUNC(cfunc_read)
 }
 
 
+#define LINE_CHUNK  65536
+
+/*
+  Append more data to the chunk binary.  If len is zero then the chunk
+  is filled, otherwise up to len bytes are read.  Return the number of
+  bytes read, zero at the end of input, or -1 if an error is thrown.
+*/
+static int _lineFill( UThread* ut, FILE* fp, const UCell* portC,
+                      UIndex chunkN, int len )
+{
+    UBuffer* chunk = ur_buffer( chunkN );
+    int start;
+
+    if( len )
+    {
+        if( ur_testAvail(chunk) - chunk->used < len )
+            ur_binReserve( chunk, chunk->used + len );
+    }
+    else
+    {
+        if( ur_avail(chunk) - chunk->used < LINE_CHUNK / 2 )
+            ur_binReserve( chunk, ur_avail(chunk) * 2 );
+        len = ur_avail(chunk) - chunk->used;
+    }
+
+    if( fp )
+    {
+        size_t n = fread( chunk->ptr.b + chunk->used, 1, len, fp );
+        if( n == 0 && ferror( fp ) )
+        {
+            ur_error( ut, UR_ERR_ACCESS, "fread error" );
+            return -1;
+        }
+        chunk->used += n;
+        return (int) n;
+    }
+    else
+    {
+        UCell dest;
+        start = chunk->used;
+        if( ! boron_waitPort( ut, portC ) )     // May run coroutines.
+            return -1;
+        {
+        PORT_SITE(dev, pbuf, portC);
+        if( ! dev )
+        {
+            errorScript( "cannot read from closed port" );
+            return -1;
+        }
+        ur_initSeries( &dest, UT_BINARY, chunkN );
+        if( ! dev->read( ut, pbuf, &dest, len ) )
+            return -1;
+        if( ur_is(&dest, UT_NONE) )
+            return 0;
+        return ur_buffer( chunkN )->used - start;
+        }
+    }
+}
+
+
+/*-cf-
+    foreach-line
+        'line   word!
+        source  file!/string!/port!
+        body    block!  Code to evaluate for each line.
+    return: Result of body.
+    group: io
+    see: foreach, read
+
+    Iterate over each line of a file or port without reading it all into
+    memory.  Line endings (LF or CR LF) are not included in the line.
+
+    The same string! is re-used for each line, so it must be copied if it
+    is to be kept after the body is evaluated.
+*/
+CFUNC(cfunc_foreachLine)
+{
+    UBuffer* chunk;
+    UBuffer* line;
+    UCell* cell;
+    FILE* fp = NULL;
+    const uint8_t* it;
+    const uint8_t* nl;
+    UIndex chunkN, lineN, pos;
+    UIndex hold[2];
+    int n, eof = 0;
+    UStatus ok = UR_THROW;
+
+    if( ur_is(a2, UT_PORT) )
+    {
+        PORT_SITE(dev, pbuf, a2);
+        (void) pbuf;
+        if( ! dev )
+            return errorScript( "cannot read from closed port" );
+        if( ! dev->defaultReadLen )
+            return errorScript( "foreach-line expected byte stream port" );
+    }
+    else if( ur_isStringType( ur_type(a2) ) )
+    {
+        const char* filename = boron_cpath( ut, a2, 0 );
+        fp = fopen( filename, "rb" );
+        if( ! fp )
+            return ur_error( ut, UR_ERR_ACCESS,
+                             "could not open file %s", filename );
+    }
+    else
+        return errorType( "foreach-line expected file!/string!/port! source" );
+
+    chunkN = ur_makeBinary( ut, LINE_CHUNK );
+    hold[0] = ur_hold( chunkN );
+    lineN = ur_makeString( ut, UR_ENC_UTF8, 0 );
+    hold[1] = ur_hold( lineN );
+    ur_setId(res, UT_NONE);
+    pos = 0;
+
+    while( 1 )
+    {
+        chunk = ur_buffer( chunkN );
+        it = chunk->ptr.b + pos;
+        nl = memchr( it, '\n', chunk->used - pos );
+        if( ! nl )
+        {
+            if( eof )
+            {
+                if( pos == chunk->used )
+                    break;
+                nl = chunk->ptr.b + chunk->used;
+            }
+            else
+            {
+                // Move partial line to the start & refill.
+                n = chunk->used - pos;
+                if( pos )
+                {
+                    memMove( chunk->ptr.b, it, n );
+                    chunk->used = n;
+                    pos = 0;
+                }
+                n = _lineFill( ut, fp, a2, chunkN, 0 );
+                if( n < 0 )
+                    goto cleanup;
+                if( n == 0 )
+                    eof = 1;
+                continue;
+            }
+        }
+
+        n = nl - it;
+        pos += n;
+        if( pos < chunk->used )
+            ++pos;                  // Skip newline.
+        if( n && nl[-1] == '\r' )
+            --n;
+
+        line = ur_buffer( lineN );
+        line->form = UR_ENC_UTF8;
+        line->used = 0;
+        ur_arrReserve( line, n );
+        memCpy( line->ptr.b, it, n );
+        line->used = n;
+        ur_strFlatten( line );
+
+        if( ! (cell = ur_wordCellM( ut, a1 )) )
+            goto cleanup;
+        ur_initSeries( cell, UT_STRING, lineN );
+
+        if( ! boron_doBlock( ut, a3, res ) )
+        {
+            cell = ur_exception( ut );
+            if( ur_is(cell, UT_WORD) )
+            {
+                if( ur_atom(cell) == UR_ATOM_BREAK )
+                    break;
+                if( ur_atom(cell) == UR_ATOM_CONTINUE )
+                    continue;
+            }
+            goto cleanup;
+        }
+    }
+    ok = UR_OK;
+
+cleanup:
+    if( fp )
+        fclose( fp );
+    ur_release( hold[0] );
+    ur_release( hold[1] );
+    return ok;
+}
+
+
+/*-cf-
+    walk-dir
+        'words  word!/block! Path word or [path type size modified] words.
+        dir     file!/string!
+        body    block!  Code to evaluate for each entry.
+        /threads    Read directories in parallel.
+            count   int!
+    return: Result of body.
+    group: os
+    see: read, info?
+
+    Iterate over every file and directory below dir.  Each path is a new
+    file! which begins with dir.  Symbolic links are reported but not
+    followed.
+
+    If words is a block then the second word is set to the file type
+    (see info?), the third to the byte size and the fourth to the
+    modification date.  The size & date are only read if those words are
+    present.
+
+    Entries are produced as directories are read, so the body is evaluated
+    before the walk is complete.  The /threads option reads directories
+    in parallel using count threads; the order of the entries is then not
+    fixed.
+*/
+CFUNC(cfunc_walkDir)
+{
+    static const char* _walkType[5] =
+    {
+        "file", "link", "dir", "socket", "other"
+    };
+#define OPT_WALK_THREADS    0x01
+    OSWalk* wk;
+    OSFileInfo info;
+    UCell* cell;
+    const UCell* words = a1;
+    const char* path;
+    UAtom types[5];
+    UIndex strN;
+    int i, len;
+    int wordCount = 1;
+    int mask = FI_Type;
+    UStatus ok = UR_THROW;
+
+    if( ur_is(a1, UT_BLOCK) )
+    {
+        UBlockIt bi;
+        ur_blockIt( ut, &bi, a1 );
+        wordCount = bi.end - bi.it;
+        if( wordCount < 1 || wordCount > 4 )
+            return errorScript( "walk-dir expected 1 to 4 words" );
+        for( i = 0; i < wordCount; ++i )
+        {
+            if( ! ur_is(bi.it + i, UT_WORD) )
+                return errorType( "walk-dir expected block of word!" );
+        }
+        words = bi.it;
+        if( wordCount > 2 )
+            mask |= FI_Size | FI_Time;
+    }
+    for( i = 0; i < 5; ++i )
+        types[i] = ur_intern( ut, _walkType[i], strLen(_walkType[i]) );
+
+    path = boron_cpath( ut, a2, 0 );
+    wk = ur_walkOpen( path, mask, (CFUNC_OPTIONS & OPT_WALK_THREADS) ?
+                                  ur_int(CFUNC_OPT_ARG(1)) : 0 );
+    if( ! wk )
+        return ur_error( ut, UR_ERR_ACCESS,
+                         "could not open directory %s", path );
+    ur_setId(res, UT_NONE);
+
+    while( (path = ur_walkNext( wk, &info, &len )) )
+    {
+        strN = ur_makeStringUtf8( ut, (const uint8_t*) path,
+                                      (const uint8_t*) path + len );
+        if( ! (cell = ur_wordCellM( ut, words )) )
+            goto cleanup;
+        ur_initSeries( cell, UT_FILE, strN );
+
+        for( i = 1; i < wordCount; ++i )
+        {
+            if( ! (cell = ur_wordCellM( ut, words + i )) )
+                goto cleanup;
+            switch( i )
+            {
+                case 1:
+                    ur_setId(cell, UT_WORD);
+                    ur_setWordUnbound( cell, types[ info.type ] );
+                    break;
+                case 2:
+                    ur_setCellI64( cell, info.size );
+                    break;
+                case 3:
+                    ur_setId(cell, UT_DATE);
+                    ur_double(cell) = info.modified;
+                    break;
+            }
+        }
+
+        if( ! boron_doBlock( ut, a3, res ) )
+        {
+            cell = ur_exception( ut );
+            if( ur_is(cell, UT_WORD) )
+            {
+                if( ur_atom(cell) == UR_ATOM_BREAK )
+                    break;
+                if( ur_atom(cell) == UR_ATOM_CONTINUE )
+                    continue;
+            }
+            goto cleanup;
+        }
+    }
+    ok = UR_OK;
+
+cleanup:
+    ur_walkClose( wk );
+    return ok;
+}
+
+
+#ifdef CONFIG_SOCKET
+extern int socket_sendFile( UThread*, UBuffer* port, int fd, int64_t offset,
+                            int64_t len, int64_t* sent );
+
+/*-cf-
+    transfer
+        dest    port!   TCP socket.
+        source  file!/port!
+        /part   Send a specific number of bytes.
+            size    int!
+        /offset Start at a file position.
+            pos     int!
+    return: int! Number of bytes sent.
+    group: io
+    see: write
+
+    Send file data to a socket without reading it into a series.
+    On Linux sendfile() is used so the data is not copied through user
+    memory.
+
+    A file! source is sent from the start, and a file port! from (and
+    advancing) its current position.  The /offset option sets the starting
+    position without changing that of a port.
+
+    Fewer bytes than requested are sent if the end of the file is reached
+    or a /nowait socket would block.
+*/
+CFUNC(cfunc_transfer)
+{
+#define OPT_TRANSFER_PART   0x01
+#define OPT_TRANSFER_OFFSET 0x02
+    uint32_t opt = CFUNC_OPTIONS;
+    int64_t offset = -1;
+    int64_t len = -1;
+    int64_t sent = 0;
+    FILE* fp = NULL;
+    int fd, ok;
+
+    if( ! ur_is(a1, UT_PORT) )
+        return errorType( "transfer expected port! dest" );
+    if( opt & OPT_TRANSFER_PART )
+    {
+        len = ur_int(CFUNC_OPT_ARG(1));
+        if( len < 0 )
+            len = 0;
+    }
+    if( opt & OPT_TRANSFER_OFFSET )
+    {
+        offset = ur_int(CFUNC_OPT_ARG(2));
+        if( offset < 0 )
+            return errorScript( "transfer /offset cannot be negative" );
+    }
+
+    if( ur_is(a2, UT_PORT) )
+    {
+        UCell tmp;
+        PORT_SITE(dev, pbuf, a2);
+        if( dev != &port_file )
+            return errorScript( "transfer expected file port! source" );
+
+        // Write any buffered output before the kernel reads the file.
+        ur_setId(&tmp, UT_INT);
+        ur_int(&tmp) = 0;
+        if( ! dev->seek( ut, pbuf, &tmp, UR_PORT_SKIP ) )
+            return UR_THROW;
+        fd = pbuf->used;    // File ports keep the descriptor here.
+    }
+    else if( ur_isStringType( ur_type(a2) ) )
+    {
+        const char* filename = boron_cpath( ut, a2, 0 );
+        fp = fopen( filename, "rb" );
+        if( ! fp )
+            return ur_error( ut, UR_ERR_ACCESS,
+                             "could not open file %s", filename );
+        fd = fileno( fp );
+        if( offset < 0 )
+            offset = 0;
+    }
+    else
+        return errorType( "transfer expected file!/port! source" );
+
+    {
+    PORT_SITE(dev, pbuf, a1);
+    if( dev != &port_socket )
+        ok = errorScript( "transfer expected socket port! dest" );
+    else
+        ok = socket_sendFile( ut, pbuf, fd, offset, len, &sent );
+    }
+    if( fp )
+        fclose( fp );
+
+    ur_setId(res, UT_INT);
+    ur_int(res) = sent;
+    return ok;
+}
+
+
+#ifndef _WIN32
+extern int socket_pending( const UBuffer* port );
+#endif
+
+/*-cf-
+    pending?
+        port    port!
+    return: int! Number of bytes queued.
+    group: io
+    see: wait, write
+
+    Get the amount of output which a /nowait TCP socket has queued because
+    the peer is not yet accepting it.  Zero is returned for other ports.
+*/
+CFUNC(cfunc_pendingQ)
+{
+    PORT_SITE(dev, pbuf, a1);
+    ur_setId(res, UT_INT);
+#ifdef _WIN32
+    (void) dev;
+    (void) pbuf;
+    ur_int(res) = 0;
+#else
+    ur_int(res) = (dev == &port_socket) ? socket_pending( pbuf ) : 0;
+#endif
+    return UR_OK;
+}
+#endif
+
+
 /*-cf-
     write
         dest    file!/string!/port!
-        data    binary!/string!/context!
+        data    binary!/string!/context!/block!
         /append
         /text   Emit new lines with carriage returns on Windows.
+        /serialized Write block! as a serialized stream.
     return: unset!
     group: io
-    see: read, save
+    see: read, save, serialize
+
+    A block! of data can be written to a UDP socket port to send many
+    datagrams at once.  It must hold pairs of binary!/string! data and
+    a "host:port" string! address or none! to use the port address.
+
+    The /serialized option encodes the data block! as it is written, so
+    a large block is never held as one binary! in memory.  Use
+    read/serialized to load it.
 */
 CFUNC(cfunc_write)
 {
 #define OPT_WRITE_APPEND    0x01
 #define OPT_WRITE_TEXT      0x02
+#define OPT_WRITE_SERIAL    0x04
     const UCell* data = a2;
 
+    if( CFUNC_OPTIONS & OPT_WRITE_SERIAL )
+    {
+        SerialIO io;
+        UStatus ok;
+        int hold;
+
+        if( ! ur_is(data, UT_BLOCK) )
+            return errorType( "write/serialized expected block! data" );
+        hold = _serialOpen( ut, &io, a1, (CFUNC_OPTIONS & OPT_WRITE_APPEND) ?
+                                         "ab" : "wb" );
+        if( hold == -2 )
+            return UR_THROW;
+        ok = ur_serializeStream( ut, data->series.buf, 0, _serialWrite, &io );
+        if( ! _serialClose( ut, &io, hold ) )
+            return UR_THROW;
+        ur_setId(res, UT_UNSET);
+        return ok;
+    }
+
     if( ur_is(a1, UT_PORT) )
     {
         PORT_SITE(dev, pbuf, a1);
@@ -4292,128 +5065,696 @@ CFUNC(cfunc_rename)
 /*-cf-
     serialize
         data    block!
+        /index  Append an index for unserialize/pick.
+        /dedupe Store equal binary!, string!, & file! values once.
+        /compress   Deflate large binary!, string!, and vector! values.
+        /parallel   Encode large sub-blocks of data on multiple threads.
     return: binary!
     group: data
     see: unserialize
 
     Pack data into binary image for transport.
     Series positions, slices, and non-global word bindings are retained.
+
+    The /dedupe option makes the image smaller when many separate series
+    hold the same text or bytes.  These are still separate series when
+    unserialized, but with unserialize/borrow they all reference the one
+    copy of the contents within the image.
+
+    The /compress option deflates the contents of each large series
+    separately, so unserialize inflates them directly into their new
+    series without a decompressed copy of the whole image.  It is ignored
+    if Boron was not compiled with zlib.
+
+    The /parallel option encodes each large block in data (and everything
+    it references) on a separate thread.  This only helps when data holds
+    many large blocks which do not share any series or contexts.
+    The result is the same as a normal serialize once unserialized.
+    If the blocks share anything (or there are fewer than two large
+    blocks) then no threads are started and data is serialized normally;
+    finding this requires a quick pass over the cells of the blocks.
 */
 CFUNC( cfunc_serialize )
 {
-    return ur_serialize( ut, a1->series.buf, res );
+    int opt = 0;
+    if( CFUNC_OPTIONS & 1 )
+        opt |= UR_SERIAL_INDEX;
+    if( CFUNC_OPTIONS & 2 )
+        opt |= UR_SERIAL_DEDUPE;
+    if( CFUNC_OPTIONS & 4 )
+        opt |= UR_SERIAL_COMPRESS;
+    if( CFUNC_OPTIONS & 8 )
+        opt |= UR_SERIAL_PARALLEL;
+    return ur_serializeOpt( ut, a1->series.buf, opt, res );
 }
 
 
 /*-cf-
     unserialize
         data    binary!
-    return: Re-materialized block!.
+        /borrow Reference data in place rather than copying it.
+        /pick   Only re-materialize one value of data.
+            index   int!
+    return: Re-materialized block! or value at index.
     group: data
     see: serialize
+
+    The /borrow option makes any binary!, string!, and vector! values
+    reference their contents within data.  This is fastest & uses the least
+    memory when data is large and long-lived, such as a file read with
+    read/mmap.  Data becomes read-only (it is copied if modified) and its
+    memory is kept until all the values referencing it are recycled.
+    A borrowing value is also copied the first time it is modified.
+
+    The /pick option returns the value at index of the serialized block
+    (or none if index is out of range).  If data was made with
+    serialize/index then only the buffers referenced by that value are
+    decoded, so picking from a large image is much faster than a full
+    unserialize.
 */
 CFUNC( cfunc_unserialize )
 {
+#define OPT_UNSER_BORROW    0x01
+#define OPT_UNSER_PICK      0x02
     UBinaryIter bi;
+    int opt = 0;
+
+    if( (CFUNC_OPTIONS & OPT_UNSER_BORROW) && ! ur_isShared(a1->series.buf) )
+    {
+        if( ur_binMakeImage( ur_buffer( a1->series.buf ) ) )
+            opt = UR_SERIAL_BORROW;
+    }
     ur_binSlice( ut, &bi, a1 );
-    return ur_unserialize( ut, bi.it, bi.end, res );
+    if( CFUNC_OPTIONS & OPT_UNSER_PICK )
+        return ur_unserializePick( ut, bi.it, bi.end, opt,
+                                   ur_int(CFUNC_OPT_ARG(2)) - 1, res );
+    return ur_unserializeOpt( ut, bi.it, bi.end, opt, res );
+}
+
+
+/*-cf-
+    freeze
+        value
+    return: Value referencing shared buffers.
+    group: data
+    see: serialize
+
+    Move the value and any series or contexts it references into the
+    shared environment.  The result is read-only and can be passed to
+    other threads and tasks without copying.
+
+    The original series become empty.  Any words still bound to an
+    original context see the frozen values of its words.  Words bound to the
+    thread globals are rebound to any shared global of the same name or
+    else unbound.
+*/
+CFUNC( cfunc_freeze )
+{
+    *res = *a1;
+    return ur_freeze( ut, res );
 }
 
 
 extern int ur_serializedHeader( const uint8_t* data, int len );
 
-/*-cf-
-    load
-        file    file!/string!/binary!
-    return: block! or none! if file is empty.
-    group: io
-    see: read, save
+/*
+  Compiled script cache
+
+  Scripts of at least CACHE_MIN_SIZE bytes are serialized after they are
+  tokenized (before they are bound) into the directory named by the
+  BORON_CACHE environment variable, $XDG_CACHE_HOME/boron, or
+  $HOME/.cache/boron.  Setting BORON_CACHE to an empty string or "0"
+  disables the cache.
+
+  The cache file name is a hash of the absolute script path.  The file
+  starts with a header that holds the interpreter version, CACHE_REVISION,
+  a stamp of the script file, and the path.  It is only used when all of
+  these match.
+  On Unix the stamp is the size, inode, and nanosecond modification &
+  change times, so a rewrite within the same second is still detected.
+
+  The total size of the cache files is kept in a tally file which each
+  write adds to.  When it exceeds CACHE_MAX_BYTES the oldest files are
+  removed until half that remains.
+*/
+#define CACHE_MIN_SIZE  2048
+#define CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define CACHE_ID        "BSC2"
+#define CACHE_REVISION  1       // Increment when the tokenizer output changes.
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+#define CACHE_NSEC(ts)  (((uint64_t) (ts).tv_sec) * 1000000000 + (ts).tv_nsec)
+#endif
 
-    Load file or serialized data with default bindings.
+/*
+  Set head to the expected cache header & name to the cache file name.
+  Return non-zero if the script can be cached.
 */
-CFUNC(cfunc_load)
+static int _cacheNames( const char* script, UBuffer* head, UBuffer* name )
 {
-    if( ur_is(a1, UT_BINARY) )
+#ifdef _WIN32
+    OSFileInfo info;
+#else
+    struct stat info;
+#endif
+    uint64_t stamp[4];
+    const char* env;
+    char* path;
+    const char* cp;
+    uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+    uint32_t n;
+    int i;
+
+#ifdef _WIN32
+    if( ! ur_fileInfo( script, &info, FI_Size | FI_Time | FI_Type ) ||
+        info.type != FI_File || info.size < CACHE_MIN_SIZE )
+        return 0;
+    stamp[0] = info.size;
+    memCpy( stamp + 1, &info.modified, 8 );
+    stamp[2] = stamp[3] = 0;
+#else
+    if( stat( script, &info ) == -1 ||
+        ! S_ISREG(info.st_mode) || info.st_size < CACHE_MIN_SIZE )
+        return 0;
+    stamp[0] = info.st_size;
+    stamp[1] = info.st_ino;
+    stamp[2] = CACHE_NSEC( info.st_mtim );
+    stamp[3] = CACHE_NSEC( info.st_ctim );
+#endif
+
+    if( (env = getenv( "BORON_CACHE" )) )
     {
-        if( cfunc_unserialize( ut, a1, res ) )
+        if( ! *env || (env[0] == '0' && ! env[1]) )
+            return 0;
+        ur_binAppendData( name, (const uint8_t*) env, strLen(env) );
+    }
+#ifdef _WIN32
+    else if( (env = getenv( "LOCALAPPDATA" )) )
+    {
+        ur_binAppendData( name, (const uint8_t*) env, strLen(env) );
+        ur_binAppendData( name, (const uint8_t*) "/boron", 6 );
+    }
+#else
+    else if( (env = getenv( "XDG_CACHE_HOME" )) && *env )
+    {
+        ur_binAppendData( name, (const uint8_t*) env, strLen(env) );
+        ur_binAppendData( name, (const uint8_t*) "/boron", 6 );
+    }
+    else if( (env = getenv( "HOME" )) )
+    {
+        ur_binAppendData( name, (const uint8_t*) env, strLen(env) );
+        ur_binAppendData( name, (const uint8_t*) "/.cache/boron", 13 );
+    }
+#endif
+    else
+        return 0;
+
+#ifdef _WIN32
+    path = _fullpath( NULL, script, 0 );
+#else
+    path = realpath( script, NULL );
+#endif
+    if( ! path )
+        return 0;
+    for( cp = path; *cp; ++cp )
+    {
+        hash ^= (uint8_t) *cp;
+        hash *= 0x100000001b3ULL;
+    }
+
+    ur_binReserve( name, name->used + 24 );
+    name->ptr.c[ name->used++ ] = '/';
+    for( i = 60; i >= 0; i -= 4 )
+        name->ptr.c[ name->used++ ] = "0123456789abcdef"[ (hash >> i) & 15 ];
+    ur_binAppendData( name, (const uint8_t*) ".bsc", 5 );   // With nul.
+    --name->used;
+
+    n = cp - path;
+    ur_binAppendData( head, (const uint8_t*) CACHE_ID, 4 );
+    ur_binReserve( head, 48 + n );
+    *((uint32_t*) (head->ptr.b + 4)) = BORON_VERSION;
+    *((uint32_t*) (head->ptr.b + 8)) = CACHE_REVISION;
+    *((uint32_t*) (head->ptr.b + 12)) = n;
+    memCpy( head->ptr.b + 16, stamp, sizeof(stamp) );
+    memCpy( head->ptr.b + 48, path, n );
+    head->used = 48 + n;
+    free( path );
+    return 1;
+}
+
+
+/*
+  Return non-zero if res was set to the cached script block.
+*/
+static int _cacheRead( UThread* ut, const UBuffer* head, const UBuffer* name,
+                       UCell* res )
+{
+    UBuffer data;
+    FILE* fp;
+    long size;
+    int ok = 0;
+
+    fp = fopen( name->ptr.c, "rb" );
+    if( ! fp )
+        return 0;
+    if( fseek( fp, 0, SEEK_END ) == 0 && (size = ftell( fp )) > head->used )
+    {
+        rewind( fp );
+        ur_binInit( &data, size );
+        if( fread( data.ptr.b, 1, size, fp ) == (size_t) size &&
+            memcmp( data.ptr.b, head->ptr.b, head->used ) == 0 )
         {
-bind_sb:
-            boron_bindDefault( ut, res->series.buf );
-            return UR_OK;
+            ok = ur_unserialize( ut, data.ptr.b + head->used,
+                                 data.ptr.b + size, res );
         }
+        ur_binFree( &data );
     }
-    else
+    fclose( fp );
+    return ok;
+}
+
+
+typedef struct
+{
+    double  modified;
+    int64_t size;
+    UIndex  path;       // Offset of path in CacheTrim names.
+}
+CacheEntry;
+
+
+static int _cacheEntryAge( const void* a, const void* b )
+{
+    double ma = ((const CacheEntry*) a)->modified;
+    double mb = ((const CacheEntry*) b)->modified;
+    return (ma < mb) ? -1 : (ma > mb);
+}
+
+
+/*
+  If the cache files in dir total more than CACHE_MAX_BYTES then remove
+  the least recently written until half that remains.
+
+  Return the total size of the remaining cache files.
+*/
+static int64_t _cacheTrim( const char* dir )
+{
+    OSWalk* wk;
+    OSFileInfo info;
+    UBuffer ent;
+    UBuffer names;
+    UBuffer* entp = &ent;
+    CacheEntry* ce;
+    CacheEntry* end;
+    const char* path;
+    int64_t total = 0;
+    int len;
+
+    wk = ur_walkOpen( dir, FI_Type | FI_Size | FI_Time, 0 );
+    if( ! wk )
+        return 0;
+    ur_arrInit( &ent, sizeof(CacheEntry), 0 );
+    ur_binInit( &names, 0 );
+    while( (path = ur_walkNext( wk, &info, &len )) )
+    {
+        if( info.type != FI_File || len < 4 ||
+            memcmp( path + len - 4, ".bsc", 4 ) != 0 )
+            continue;
+        ur_arrExpand1( CacheEntry, entp, ce );
+        ce->modified = info.modified;
+        ce->size = info.size;
+        ce->path = names.used;
+        ur_binAppendData( &names, (const uint8_t*) path, len + 1 );
+        total += info.size;
+    }
+    ur_walkClose( wk );
+
+    if( total > CACHE_MAX_BYTES )
+    {
+        ce  = ur_ptr(CacheEntry, &ent);
+        end = ce + ent.used;
+        qsort( ce, ent.used, sizeof(CacheEntry), _cacheEntryAge );
+        for( ; ce != end && total > CACHE_MAX_BYTES / 2; ++ce )
+        {
+            if( remove( names.ptr.c + ce->path ) == 0 )
+                total -= ce->size;
+        }
+    }
+    ur_arrFree( &ent );
+    ur_binFree( &names );
+    return total;
+}
+
+
+/*
+  Add the size of a new cache file to the tally of dir & trim the cache if
+  that passes CACHE_MAX_BYTES.  Replaced files are counted again, which only
+  makes the trim (which recounts the total) happen sooner.
+*/
+static void _cacheTally( const char* dir, int64_t added )
+{
+    UBuffer path;
+    FILE* fp;
+    int64_t total = -1;
+    int len = strLen(dir);
+
+    ur_binInit( &path, len + 7 );
+    ur_binAppendData( &path, (const uint8_t*) dir, len );
+    ur_binAppendData( &path, (const uint8_t*) "/tally", 7 );   // With nul.
+
+    fp = fopen( path.ptr.c, "rb" );
+    if( fp )
+    {
+        if( fread( &total, sizeof(total), 1, fp ) != 1 )
+            total = -1;
+        fclose( fp );
+    }
+    if( total < 0 || (total += added) > CACHE_MAX_BYTES )
+        total = _cacheTrim( dir );
+
+    fp = fopen( path.ptr.c, "wb" );
+    if( fp )
     {
-        UCell args[2];
+        fwrite( &total, sizeof(total), 1, fp );
+        fclose( fp );
+    }
+    ur_binFree( &path );
+}
 
-        ur_setId(args, UT_UNSET);       // Clear read CFUNC_OPTIONS.
-        args[1] = *a1;
 
-        if( BENV->funcRead( ut, args + 1, res ) )
+/*
+  Save the unbound script block to the cache.  Any errors are ignored.
+*/
+static void _cacheWrite( UThread* ut, const UBuffer* head, UBuffer* name,
+                         const UCell* blkC )
+{
+    UBuffer tmpName;
+    UCell* bin;
+    const UBuffer* data;
+    char* slash;
+    char tmp[ 16 ];
+    FILE* fp;
+    int ok;
+
+    bin = ur_push( ut, UT_UNSET );
+    if( ! boron_requestAccess( ut, "Write file \"%s\"", name->ptr.c ) ||
+        ! ur_serialize( ut, blkC->series.buf, bin ) )       // gc!
+        goto done;
+
+    // Make the cache directory & any missing parents.
+    slash = strrchr( name->ptr.c, '/' );
+    *slash = '\0';
+    ok = _makeDirParents( ut, name->ptr.c, slash ) &&
+         ur_makeDir( ut, name->ptr.c );
+    *slash = '/';
+    if( ! ok )
+        goto done;
+
+    // Write to a temporary file & rename it so readers never see a
+    // partial file.
+#ifdef _WIN32
+    sprintf( tmp, ".%d", _getpid() );
+#else
+    sprintf( tmp, ".%d", (int) getpid() );
+#endif
+    ur_binInit( &tmpName, name->used + 16 );
+    ur_binAppendData( &tmpName, name->ptr.b, name->used );
+    ur_binAppendData( &tmpName, (const uint8_t*) tmp, strLen(tmp) + 1 );
+
+    fp = fopen( tmpName.ptr.c, "wb" );
+    if( fp )
+    {
+        data = ur_bufferSer( bin );
+        ok = fwrite( head->ptr.b, 1, head->used, fp ) == (size_t) head->used &&
+             fwrite( data->ptr.b, 1, data->used, fp ) == (size_t) data->used;
+        if( fclose( fp ) || ! ok )
+            remove( tmpName.ptr.c );
+        else
         {
-            const uint8_t* cp;
-            UBuffer* bin;
-            UIndex hold;
-            UIndex blkN;
-#if CONFIG_COMPRESS == 2
-check_str:
+#ifdef _WIN32
+            remove( name->ptr.c );
 #endif
-            bin = ur_buffer( res->series.buf );
-            if( ! bin->used )
+            if( rename( tmpName.ptr.c, name->ptr.c ) )
+                remove( tmpName.ptr.c );
+            else
             {
-                ur_setId(res, UT_NONE);
-                return UR_OK;
+                *slash = '\0';
+                _cacheTally( name->ptr.c, head->used + data->used );
+                *slash = '/';
             }
+        }
+    }
+    ur_binFree( &tmpName );
 
-            // Skip any Unix shell interpreter line.
-            cp = bin->ptr.b;
-            if( cp[0] == '#' && cp[1] == '!' ) 
-            {
-                cp = find_uint8_t( cp, cp + bin->used, '\n' );
-                if( ! cp )
-                    cp = bin->ptr.b;
-            }
-            else if( ur_serializedHeader( cp, bin->used ) )
-            {
-                if( ! ur_unserialize( ut, cp, cp + bin->used, res ) )
-                    return UR_THROW;
-                goto bind_sb;
-            }
+done:
+    ur_pop( ut );
+}
+
+
+/*
+  Read & tokenize script.  If cacheHead is not zero then the unbound block
+  is saved to the cache.
+*/
+static UStatus _loadText( UThread* ut, const UCell* a1, UCell* res,
+                          const UBuffer* cacheHead, UBuffer* cacheName )
+{
+    UCell args[2];
+
+    ur_setId(args, UT_UNSET);       // Clear read CFUNC_OPTIONS.
+    args[1] = *a1;
+
+    if( BENV->funcRead( ut, args + 1, res ) )
+    {
+        const uint8_t* cp;
+        UBuffer* bin;
+        UIndex hold;
+        UIndex blkN;
+#if CONFIG_COMPRESS == 2
+check_str:
+#endif
+        bin = ur_buffer( res->series.buf );
+        if( ! bin->used )
+        {
+            ur_setId(res, UT_NONE);
+            return UR_OK;
+        }
+
+        // Skip any Unix shell interpreter line.
+        cp = bin->ptr.b;
+        if( cp[0] == '#' && cp[1] == '!' ) 
+        {
+            cp = find_uint8_t( cp, cp + bin->used, '\n' );
+            if( ! cp )
+                cp = bin->ptr.b;
+        }
+        else if( ur_serializedHeader( cp, bin->used ) )
+        {
+            if( ! ur_unserialize( ut, cp, cp + bin->used, res ) )
+                return UR_THROW;
+            boron_bindDefault( ut, res->series.buf );
+            return UR_OK;
+        }
 #if CONFIG_COMPRESS == 2
-            else if( bin->used > (12 + 8) )
+        else if( bin->used > (12 + 8) )
+        {
+            const uint8_t* pat = (const uint8_t*) "BZh";
+            cp = find_pattern_8( cp, cp + 12, pat, pat + 3 );
+            if( cp && (cp[3] >= '1') && (cp[3] <= '9') )
             {
-                const uint8_t* pat = (const uint8_t*) "BZh";
-                cp = find_pattern_8( cp, cp + 12, pat, pat + 3 );
-                if( cp && (cp[3] >= '1') && (cp[3] <= '9') )
-                {
-                    *args = *res;
-                    hold = ur_hold( res->series.buf );
-                    blkN = cfunc_decompress( ut, args, res );
-                    ur_release( hold );
-                    if( ! blkN )
-                        return UR_THROW;
-                    goto check_str;
-                }
-                else
-                    cp = bin->ptr.b;
+                *args = *res;
+                hold = ur_hold( res->series.buf );
+                blkN = cfunc_decompress( ut, args, res );
+                ur_release( hold );
+                if( ! blkN )
+                    return UR_THROW;
+                goto check_str;
             }
+            else
+                cp = bin->ptr.b;
+        }
 #endif
 
-            hold = ur_hold( res->series.buf );
-            blkN = ur_tokenize( ut, (char*) cp, bin->ptr.c + bin->used, res );
-            ur_release( hold );
+        hold = ur_hold( res->series.buf );
+        blkN = ur_tokenize( ut, (char*) cp, bin->ptr.c + bin->used, res );
+        ur_release( hold );
 
-            if( blkN )
-            {
-                boron_bindDefault( ut, blkN );
-                return UR_OK;
-            }
+        if( blkN )
+        {
+            if( cacheHead )
+                _cacheWrite( ut, cacheHead, cacheName, res );   // gc!
+            boron_bindDefault( ut, res->series.buf );
+            return UR_OK;
         }
     }
     return UR_THROW;
 }
 
 
+#define LOAD_CHUNK  4096
+
+/*
+  load/next
+*/
+static UStatus _loadNext( UThread* ut, const UCell* portC,
+                          const UCell* chunkC, UCell* res )
+{
+    UBuffer* chunk;
+    UBuffer* blk;
+    const uint8_t* pos;
+    const uint8_t* end;
+    UIndex chunkN, blkN, hold;
+    int n, eof;
+
+    {
+    PORT_SITE(dev, pbuf, portC);
+    (void) pbuf;
+    if( ! dev )
+        return errorScript( "cannot read from closed port" );
+    if( ! dev->defaultReadLen )
+        return errorScript( "load/next expected byte stream port" );
+    }
+    if( ! ur_is(chunkC, UT_BINARY) )
+        return errorType( "load/next expected binary! buffer" );
+    if( ! ur_bufferSerM(chunkC) )
+        return UR_THROW;
+    chunkN = chunkC->series.buf;
+
+    ur_makeBlockCell( ut, UT_BLOCK, 0, res );
+    blkN = res->series.buf;
+    hold = ur_hold( blkN );
+
+    while( 1 )
+    {
+        // Tokenize from the start of the chunk each time as the previous
+        // attempt may have stopped in the middle of a token.  A nul is
+        // kept at the end of the chunk once the end of input is reached
+        // so the port is not read again.
+        chunk = ur_buffer( chunkN );
+        end = chunk->ptr.b + chunk->used;
+        eof = (chunk->used && end[-1] == '\0');
+        ur_buffer( blkN )->used = 0;
+        n = ur_tokenizeNext( ut, blkN, UR_ENC_UTF8, chunk->ptr.b,
+                             eof ? end - 1 : end, ! eof, &pos );
+        if( n == UR_THROW )
+            goto fail;
+        if( n == UR_OK )
+            break;
+        // Read in small pieces so that little input needs to be moved
+        // after each value, but double the size for large values so they
+        // are not re-tokenized too many times.
+        n = ur_buffer( chunkN )->used;
+        n = _lineFill( ut, NULL, portC, chunkN,
+                       (n > LOAD_CHUNK) ? n : LOAD_CHUNK ); // gc!
+        if( n < 0 )
+            goto fail;
+        if( n == 0 )
+            ur_binAppendData( ur_buffer( chunkN ), (const uint8_t*) "", 1 );
+    }
+    ur_release( hold );
+
+    // Keep any input following the value for the next call.
+    chunk = ur_buffer( chunkN );
+    n = chunk->used - (pos - chunk->ptr.b);
+    if( n )
+        memMove( chunk->ptr.b, pos, n );
+    chunk->used = n;
+
+    blk = ur_buffer( blkN );
+    if( blk->used )
+    {
+        boron_bindDefault( ut, blkN );
+        *res = ur_buffer( blkN )->ptr.cell[0];
+    }
+    else
+    {
+        // End of input; drop the nul so the buffer can be used again.
+        chunk->used = 0;
+        ur_setId(res, UT_NONE);
+    }
+    return UR_OK;
+
+fail:
+    ur_release( hold );
+    return UR_THROW;
+}
+
+
+/*-cf-
+    load
+        file    file!/string!/binary!/port!
+        /next   Load one value from a port.
+            buffer  binary!  Holds input read past the value.
+    return: block!, value with /next, or none! if file is empty.
+    group: io
+    see: read, save
+
+    Load file or serialized data with default bindings.
+
+    Large scripts are cached in a tokenized form so that later loads are
+    faster.  See the User Manual for details.
+
+    The /next option reads only enough of a port to parse the next value
+    in it, so large data files or streams can be processed one value at
+    a time.  The value itself (not a block) is returned, or none! when the
+    end of the input is reached.  The same buffer must be passed to each
+    call for a given port.  Once none! is returned the buffer is empty and
+    can be used with another port.
+*/
+CFUNC(cfunc_load)
+{
+#define OPT_LOAD_NEXT   0x01
+    UBuffer cacheHead;
+    UBuffer cacheName;
+    UStatus ok;
+    int cache;
+
+    if( ur_is(a1, UT_PORT) )
+    {
+        if( CFUNC_OPTIONS & OPT_LOAD_NEXT )
+            return _loadNext( ut, a1, CFUNC_OPT_ARG(1), res );
+        return errorScript( "load of port! requires /next" );
+    }
+
+    if( ur_is(a1, UT_BINARY) )
+    {
+        if( cfunc_unserialize( ut, a1, res ) )
+        {
+bind_sb:
+            boron_bindDefault( ut, res->series.buf );
+            return UR_OK;
+        }
+        return UR_THROW;
+    }
+
+    cache = 0;
+    if( ur_isStringType( ur_type(a1) ) )
+    {
+        ur_binInit( &cacheHead, 0 );
+        ur_binInit( &cacheName, 0 );
+        cache = _cacheNames( boron_cpath( ut, a1, 0 ), &cacheHead,
+                             &cacheName );
+        if( cache && _cacheRead( ut, &cacheHead, &cacheName, res ) )
+        {
+            ur_binFree( &cacheHead );
+            ur_binFree( &cacheName );
+            goto bind_sb;
+        }
+    }
+    ok = _loadText( ut, a1, res, cache ? &cacheHead : 0, &cacheName );
+    if( cache )
+    {
+        ur_binFree( &cacheHead );
+        ur_binFree( &cacheName );
+    }
+    return ok;
+}
+
+
 /*-cf-
     save
         dest    file!/string!/port!
@@ -4512,13 +5853,18 @@ CFUNC(cfunc_parse)
 {
 #define OPT_PARSE_CASE      0x01
     uint32_t opt = CFUNC_OPTIONS;
-    USeriesIterM si;
+    USeriesIter si;
     const UBuffer* rules;
     UIndex pos;
     UStatus ok = UR_THROW;
 
-    if( ! ur_seriesSliceM( ut, &si, a1 ) )
+    // The parser only reads the input; rules which modify it call functions
+    // that require a writable series.  This allows a memory mapped binary!
+    // to be parsed.  Shared input is still refused (with the usual error)
+    // as the parser re-acquires the buffer from the thread dataStore.
+    if( ur_isShared( a1->series.buf ) && ! ur_bufferSerM(a1) )
         return UR_THROW;
+    ur_seriesSlice( ut, &si, a1 );
 
     rules = ur_bufferSer(a2);
 
@@ -4526,12 +5872,12 @@ CFUNC(cfunc_parse)
     {
         case UT_BINARY:
         case UT_STRING:
-            ok = ur_parseString( ut, si.buf, si.it, si.end, &pos, rules,
-                                 boron_doVoid, opt & OPT_PARSE_CASE );
+            ok = ur_parseString( ut, (UBuffer*) si.buf, si.it, si.end, &pos,
+                                 rules, boron_doVoid, opt & OPT_PARSE_CASE );
             break;
         case UT_BLOCK:
-            ok = ur_parseBlock( ut, si.buf, si.it, si.end, &pos, rules,
-                                boron_doVoid );
+            ok = ur_parseBlock( ut, (UBuffer*) si.buf, si.it, si.end, &pos,
+                                rules, boron_doVoid );
             break;
     }
     if( ! ok )
@@ -4544,11 +5890,8 @@ CFUNC(cfunc_parse)
     }
     else
     {
-        // Re-aquire.
-        if( ! (si.buf = ur_bufferSerM(a1)) )
-            return UR_THROW;
         // Pos can be greater than used if input was erased.
-        pos = (pos >= si.buf->used);
+        pos = (pos >= ur_bufferSer(a1)->used);
     }
 
     ur_setId(res, UT_LOGIC);
@@ -5157,7 +6500,14 @@ CFUNC_PUB(cfunc_free)
     int type = ur_type(a1);
     if( ! ur_isSeriesType( type ) && (type != UT_PORT) )
         return boron_badArg( ut, type, 0 );
-    if( ! (buf = ur_bufferSerM(a1)) )
+    if( type != UT_PORT && ! ur_isShared( a1->series.buf ) &&
+        (ur_buffer( a1->series.buf )->flags &
+            (UR_BUF_MAPPED | UR_BUF_BORROWED)) )
+    {
+        // Unmap or release the image rather than copying the data first.
+        buf = ur_buffer( a1->series.buf );
+    }
+    else if( ! (buf = ur_bufferSerM(a1)) )
         return UR_THROW;
     DT( type )->destroy( buf );
     ur_setId(res, UT_UNSET);
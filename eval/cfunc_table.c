@@ -107,13 +107,17 @@ DEF_CF( cfunc_change_dir, "change-dir path string!/file!\n" )
 DEF_CF( cfunc_current_dir,"current-dir\n" )
 DEF_CF( cfunc_getenv,     "getenv name string!\n" )
 DEF_CF( cfunc_setenv,     "setenv name string! val\n" )
-DEF_CF( cfunc_open,       "open from /read /write /new /nowait\n" )
+DEF_CF( cfunc_open,       "open from /read /write /new /nowait /reuse"
+                            " /buffer size int!\n" )
 DEF_CF( cfunc_read,       "read from /text /into b /append a"
-                            " /part size int!\n" )
-DEF_CF( cfunc_write,      "write to data /append /text\n" )
+                            " /part size int! /mmap /serialized\n" )
+DEF_CF( cfunc_foreachLine, "foreach-line 'w word! from body block! /no-trace\n" )
+DEF_CF( cfunc_walkDir,    "walk-dir 'w word!/block! dir string!/file!"
+                            " body block! /threads n int! /no-trace\n" )
+DEF_CF( cfunc_write,      "write to data /append /text /serialized\n" )
 DEF_CF( cfunc_delete,     "delete file string!/file!\n" )
 DEF_CF( cfunc_rename,     "rename a string!/file! b string!/file!\n" )
-DEF_CF( cfunc_load,       "load from\n" )
+DEF_CF( cfunc_load,       "load from /next buf\n" )
 DEF_CF( cfunc_save,       "save to data\n" )
 DEF_CF( cfunc_split,      "split a b\n" )
 DEF_CF( cfunc_parse,      "parse input binary!/string!/block!"
@@ -141,21 +145,29 @@ DEF_CF( cfunc_mark_sol,   "mark-sol val /block /clear\n" )
 DEF_CF( cfunc_now,        "now /date\n" )
 DEF_CF( cfunc_cpu_cycles, "cpu-cycles n int! b block!\n" )
 DEF_CF( cfunc_free,       "free s\n" )
-DEF_CF( cfunc_serialize,  "serialize b block!\n" )
-DEF_CF( cfunc_unserialize,"unserialize b binary!\n" )
+DEF_CF( cfunc_serialize,  "serialize b block! /index /dedupe /compress /parallel\n" )
+DEF_CF( cfunc_unserialize,"unserialize b binary! /borrow /pick n int!\n" )
+DEF_CF( cfunc_freeze,     "freeze val\n" )
 DEF_CF( cfunc_collect,    "collect type datatype! a block!/paren!"
                             " /unique /into b block!\n" )
 DEF_CF( cfunc_construct,  "construct s b\n" )
 DEF_CF( cfunc_sleep,      "sleep n\n" )
 DEF_CF( cfunc_wait,       "wait b\n" )
+DEF_CF( cfunc_spawn,      "spawn body block!\n" )
+DEF_CF( cfunc_yield,      "yield\n" )
 DEF_CF( cfunc_format,     "format s block! a\n" )
 
 #ifdef CONFIG_SOCKET
     DEF_CF( cfunc_set_addr,   "set-addr p host\n" )
     DEF_CF( cfunc_hostname,   "hostname p\n" )
+    DEF_CF( cfunc_transfer,   "transfer to port! from /part size int!"
+                                " /offset pos int!\n" )
+    DEF_CF( cfunc_pendingQ,   "pending? p port!\n" )
 #endif
 #ifdef CONFIG_THREAD
     DEF_CF( cfunc_thread,     "thread body /port\n" )
+    DEF_CF( cfunc_task,       "task body block!\n" )
+    DEF_CF( cfunc_await,      "await f port!/block!\n" )
 #endif
 #ifdef CONFIG_CHECKSUM
     DEF_CF( cfunc_hash,       "hash val\n" )
@@ -0,0 +1,575 @@
+/*
+  This file is part of the Boron programming language.
+
+  Boron is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Boron is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Boron.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  Coroutines multiplexed within one UThread.
+
+  Each coroutine has its own evaluation stack, function frames, and C stack.
+  Whichever evaluation stack is not in use (the scheduler's or the
+  coroutine's) is kept in a held block so that ur_recycle() marks the
+  values on it.
+
+  Coroutines only switch to and from the scheduler, which is run by wait
+  and yield in the thread that spawned them (see wait.c).
+*/
+
+
+#include "boron.h"
+#include "os.h"
+#include "boron_internal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <ucontext.h>
+#endif
+
+
+#define CO_STACK_CELLS  512             // Same as boron_threadInit().
+#define CO_CSTACK_SIZE  (256 * 1024)
+
+
+typedef struct
+{
+    Coroutine co;
+    int orphan;             // Port closed while coroutine is running.
+#ifdef _WIN32
+    LPVOID fiber;
+#else
+    ucontext_t ctx;
+    void* cstack;
+#endif
+}
+CoroutineExt;
+
+
+typedef struct
+{
+    CoScheduler cs;
+#ifdef _WIN32
+    LPVOID fiber;
+    int converted;
+#else
+    ucontext_t ctx;
+#endif
+}
+CoSchedulerExt;
+
+
+static CoScheduler* _scheduler( UThread* ut )
+{
+    CoSchedulerExt* se = (CoSchedulerExt*) BT->sched;
+    if( ! se )
+    {
+        se = (CoSchedulerExt*) memAlloc( sizeof(CoSchedulerExt) );
+        if( ! se )
+            return NULL;
+        se->cs.current = NULL;
+        ur_arrInit( &se->cs.list, sizeof(Coroutine*), 0 );
+        ur_arrInit( &se->cs.ready, sizeof(Coroutine*), 0 );
+        ur_arrInit( &se->cs.timers, sizeof(Coroutine*), 0 );
+#ifdef _WIN32
+        se->fiber = ConvertThreadToFiber( NULL );
+        se->converted = 1;
+        if( ! se->fiber )
+        {
+            se->fiber = GetCurrentFiber();
+            se->converted = 0;
+        }
+#endif
+        BT->sched = &se->cs;
+    }
+    return &se->cs;
+}
+
+
+/*
+  Exchange the evaluation state of the thread with that of the coroutine.
+*/
+static void _swapEvalState( UThread* ut, Coroutine* co )
+{
+    UBuffer* blk = ur_buffer( co->stackN );
+    UBuffer tmp;
+    UCell* limit;
+
+    tmp.used = blk->used;
+    tmp.ptr  = blk->ptr;
+    blk->used = ut->stack.used;
+    blk->ptr  = ut->stack.ptr;
+    ut->stack.used = tmp.used;
+    ut->stack.ptr  = tmp.ptr;
+
+    tmp = BT->frames;
+    BT->frames = co->frames;
+    co->frames = tmp;
+
+    limit = BT->stackLimit;
+    BT->stackLimit = co->stackLimit;
+    co->stackLimit = limit;
+}
+
+
+static void _unlist( CoScheduler* cs, Coroutine* co )
+{
+    Coroutine** list = (Coroutine**) cs->list.ptr.v;
+    Coroutine* last;
+
+    last = list[ --cs->list.used ];
+    list[ co->slot ] = last;
+    last->slot = co->slot;
+}
+
+
+static void _unqueue( CoScheduler* cs, Coroutine* co )
+{
+    Coroutine** it  = (Coroutine**) cs->ready.ptr.v;
+    Coroutine** end = it + cs->ready.used;
+    for( ; it != end; ++it )
+    {
+        if( *it == co )
+            *it = NULL;
+    }
+}
+
+
+static void _freeContext( CoroutineExt* ce )
+{
+#ifdef _WIN32
+    if( ce->fiber )
+    {
+        DeleteFiber( ce->fiber );
+        ce->fiber = NULL;
+    }
+#else
+    memFree( ce->cstack );
+    ce->cstack = NULL;
+#endif
+}
+
+
+static void _evalBody( Coroutine* co )
+{
+    UThread* ut = co->ut;
+    UCell* cell = ut->stack.ptr.cell;
+
+    // Stack cell 3 is the body and 2 is the result (see cfunc_spawn).
+    co->state = boron_doBlock( ut, cell + 3, cell + 2 ) ? CO_DONE : CO_ERROR;
+}
+
+
+#ifdef _WIN32
+static VOID CALLBACK _coroutineMain( LPVOID arg )
+{
+    CoroutineExt* ce = (CoroutineExt*) arg;
+    CoSchedulerExt* se;
+
+    _evalBody( &ce->co );
+    se = (CoSchedulerExt*) ((BoronThread*) ce->co.ut)->sched;
+    SwitchToFiber( se->fiber );
+}
+#else
+static void _coroutineMain( unsigned int hi, unsigned int lo )
+{
+    uintptr_t ptr = (((uintptr_t) hi) << 16) << 16 | lo;
+    _evalBody( &((CoroutineExt*) ptr)->co );
+    // Returns to the scheduler through uc_link.
+}
+#endif
+
+
+/*
+  Run coroutine until it suspends or finishes.
+  Must be called from the scheduler.
+
+  Return non-zero if the coroutine finished.
+*/
+static int _resume( UThread* ut, CoSchedulerExt* se, CoroutineExt* ce )
+{
+    Coroutine* co = &ce->co;
+
+    _swapEvalState( ut, co );
+    co->state = CO_RUNNING;
+    se->cs.current = co;
+#ifdef _WIN32
+    SwitchToFiber( ce->fiber );
+#else
+    swapcontext( &se->ctx, &ce->ctx );
+#endif
+    se->cs.current = NULL;
+    _swapEvalState( ut, co );
+
+    if( co->state >= CO_DONE )
+    {
+        boron_waitNotify( ut, co );
+        _freeContext( ce );
+        _unlist( &se->cs, co );
+        ur_arrFree( &co->frames );
+        ur_release( co->portHold );
+        if( ce->orphan )
+        {
+            ur_release( co->stackHold );
+            memFree( ce );
+        }
+        // Otherwise the result stays on the held stack until port close.
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+  Queue a coroutine to be run by the scheduler.
+*/
+void boron_coReady( UThread* ut, Coroutine* co )
+{
+    UBuffer* queue = &BT->sched->ready;
+    Coroutine** slot;
+    if( co->state != CO_READY )
+    {
+        co->state = CO_READY;
+        ur_arrExpand1( Coroutine*, queue, slot );
+        *slot = co;
+    }
+}
+
+
+/**
+  Run each coroutine which is ready once.
+  Must be called from the scheduler (when boron_coCurrent() is zero).
+*/
+void boron_coRunReady( UThread* ut )
+{
+    CoSchedulerExt* se = (CoSchedulerExt*) BT->sched;
+    UBuffer* queue;
+    Coroutine* co;
+    UIndex i, n;
+
+    if( ! se )
+        return;
+
+    // Coroutines made ready during this pass will run on the next one.
+    queue = &se->cs.ready;
+    n = queue->used;
+    for( i = 0; i < n; ++i )
+    {
+        co = ((Coroutine**) queue->ptr.v)[ i ];
+        if( co )
+            _resume( ut, se, (CoroutineExt*) co );
+    }
+
+    queue->used -= n;
+    memMove( queue->ptr.v, ((Coroutine**) queue->ptr.v) + n,
+             queue->used * sizeof(Coroutine*) );
+}
+
+
+/**
+  Switch from the current coroutine back to the scheduler.
+  The coroutine state must be set before this is called.
+*/
+void boron_coSuspend( UThread* ut )
+{
+    CoSchedulerExt* se = (CoSchedulerExt*) BT->sched;
+    CoroutineExt* ce = (CoroutineExt*) se->cs.current;
+#ifdef _WIN32
+    SwitchToFiber( se->fiber );
+#else
+    swapcontext( &ce->ctx, &se->ctx );
+#endif
+}
+
+
+/*
+  Called when the thread is freed.
+*/
+void boron_freeScheduler( UThread* ut )
+{
+    CoSchedulerExt* se = (CoSchedulerExt*) BT->sched;
+    if( se )
+    {
+        Coroutine** it  = (Coroutine**) se->cs.list.ptr.v;
+        Coroutine** end = it + se->cs.list.used;
+        for( ; it != end; ++it )
+        {
+            boron_waitCancel( ut, *it );
+            (*it)->ut = NULL;       // Port close will free the rest.
+            _freeContext( (CoroutineExt*) *it );
+        }
+        ur_arrFree( &se->cs.list );
+        ur_arrFree( &se->cs.ready );
+        ur_arrFree( &se->cs.timers );
+#ifdef _WIN32
+        if( se->converted )
+            ConvertFiberToThread();
+#endif
+        memFree( se );
+        BT->sched = NULL;
+    }
+}
+
+
+static int co_open( UThread* ut, const UPortDevice* pdev,
+                    const UCell* from, int opt, UCell* res )
+{
+    (void) pdev;
+    (void) from;
+    (void) opt;
+    (void) res;
+    return ur_error( ut, UR_ERR_SCRIPT, "Coroutine ports are created by spawn" );
+}
+
+
+static void co_close( UBuffer* port )
+{
+    CoroutineExt* ce = (CoroutineExt*) port->ptr.v;
+    Coroutine* co = &ce->co;
+    UThread* ut = co->ut;
+
+    if( ut )
+        boron_waitDetach( ut, co );
+
+    if( ut && co->state < CO_DONE )
+    {
+        if( co == BT->sched->current )
+        {
+            // Cannot free the C stack we are running on.  The coroutine
+            // is freed when it finishes.
+            ce->orphan = 1;
+            return;
+        }
+
+        // The coroutine is abandoned where it is suspended.
+        if( co->state == CO_READY )
+            _unqueue( BT->sched, co );
+        boron_waitCancel( ut, co );
+        _unlist( BT->sched, co );
+        _freeContext( ce );
+        ur_arrFree( &co->frames );
+        ur_release( co->portHold );
+    }
+    if( ut )
+        ur_release( co->stackHold );
+    else
+        ur_arrFree( &co->frames );
+    _freeContext( ce );
+    memFree( ce );
+}
+
+
+static int co_read( UThread* ut, UBuffer* port, UCell* dest, int part )
+{
+    Coroutine* co = (Coroutine*) port->ptr.v;
+    const UCell* cell;
+    (void) part;
+
+    // cfunc_readPort has called boron_waitPort() so the coroutine is
+    // normally finished here.
+    if( co->state < CO_DONE )
+        return ur_error( ut, UR_ERR_SCRIPT, "Coroutine is still running" );
+
+    cell = ur_buffer( co->stackN )->ptr.cell;
+    if( co->state == CO_ERROR )
+    {
+        UCell* ex = ur_exception( ut );
+        ex[0] = cell[0];
+        ex[1] = cell[1];
+        return UR_THROW;
+    }
+    *dest = cell[2];
+    return UR_OK;
+}
+
+
+static int co_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    (void) port;
+    (void) data;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot write to coroutine port" );
+}
+
+
+static int co_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot seek on coroutine port" );
+}
+
+
+#ifdef _WIN32
+static int co_waitFD( UBuffer* port, void** handle )
+{
+    (void) port;
+    (void) handle;
+    return -1;
+}
+#else
+static int co_waitFD( UBuffer* port )
+{
+    (void) port;
+    return -1;
+}
+#endif
+
+
+UPortDevice port_coroutine =
+{
+    co_open, co_close, co_read, co_write, co_seek,
+    co_waitFD, 0
+};
+
+
+static int _makeContext( CoSchedulerExt* se, CoroutineExt* ce )
+{
+#ifdef _WIN32
+    (void) se;
+    ce->fiber = CreateFiber( CO_CSTACK_SIZE, _coroutineMain, ce );
+    return ce->fiber != NULL;
+#else
+    uintptr_t ptr = (uintptr_t) ce;
+
+    ce->cstack = memAlloc( CO_CSTACK_SIZE );
+    if( ! ce->cstack )
+        return 0;
+    if( getcontext( &ce->ctx ) == -1 )
+    {
+        memFree( ce->cstack );
+        return 0;
+    }
+    ce->ctx.uc_stack.ss_sp   = ce->cstack;
+    ce->ctx.uc_stack.ss_size = CO_CSTACK_SIZE;
+    ce->ctx.uc_link = &se->ctx;
+    makecontext( &ce->ctx, (void (*)(void)) _coroutineMain, 2,
+                 (unsigned int) ((ptr >> 16) >> 16),
+                 (unsigned int) (ptr & 0xffffffff) );
+    return 1;
+#endif
+}
+
+
+/*-cf-
+    spawn
+        body block!
+    return: Coroutine port!
+    group: control
+    see: wait, yield
+
+    Create a coroutine which will evaluate body in the current thread.
+
+    Coroutines run only while the thread which spawned them is inside
+    wait or yield.  A running coroutine gives up control when it calls
+    wait or yield, or reads from a port which has no data ready.
+
+    Read the coroutine port to get the result of body.  The port is
+    readable with wait when the coroutine has finished.  If body threw an
+    exception then read will throw it.
+*/
+CFUNC_PUB( cfunc_spawn )
+{
+    CoSchedulerExt* se;
+    CoroutineExt* ce;
+    Coroutine* co;
+    UBuffer* blk;
+    UIndex blkN;
+
+    se = (CoSchedulerExt*) _scheduler( ut );
+    if( ! se )
+        goto no_mem;
+    ce = (CoroutineExt*) memAlloc( sizeof(CoroutineExt) );
+    if( ! ce )
+        goto no_mem;
+    if( ! _makeContext( se, ce ) )
+    {
+        memFree( ce );
+        goto no_mem;
+    }
+
+    blkN = ur_makeBlock( ut, CO_STACK_CELLS );      // gc!
+    blk = ur_buffer( blkN );
+    ur_setId( blk->ptr.cell,     UT_UNSET );        // Exception.
+    ur_setId( blk->ptr.cell + 1, UT_UNSET );        // Named exception value.
+    ur_setId( blk->ptr.cell + 2, UT_UNSET );        // Result.
+    blk->ptr.cell[3] = *a1;                         // Body.
+    blk->used = 4;
+
+    co = &ce->co;
+    co->dev        = &port_coroutine;
+    co->ut         = ut;
+    co->wait       = NULL;
+    co->deadline   = 0.0;
+    co->waitResult = -1;
+    co->state      = CO_WAITING;
+    co->timerPos   = -1;
+    co->joiners    = NULL;
+    co->stackN     = blkN;
+    co->stackHold  = ur_hold( blkN );
+    co->stackLimit = blk->ptr.cell + CO_STACK_CELLS - 8;
+    ur_arrInit( &co->frames, sizeof(UIndex), 0 );
+    ce->orphan = 0;
+
+    boron_makePort( ut, &port_coroutine, ce, res );
+    co->portHold = ur_hold( res->port.buf );
+
+    co->slot = se->cs.list.used;
+    ur_arrReserve( &se->cs.list, co->slot + 1 );
+    ((Coroutine**) se->cs.list.ptr.v)[ co->slot ] = co;
+    ++se->cs.list.used;
+    boron_coReady( ut, co );
+    return UR_OK;
+
+no_mem:
+    return ur_error( ut, UR_ERR_INTERNAL, "No memory for coroutine" );
+}
+
+
+extern CFUNC_PUB( cfunc_wait );
+
+/*-cf-
+    yield
+    return: unset!
+    group: control
+    see: spawn, wait
+
+    Let other coroutines run.
+
+    When called from a coroutine, it is suspended until the scheduler runs
+    it again.  Otherwise, each coroutine which is ready runs once.
+*/
+CFUNC_PUB( cfunc_yield )
+{
+    Coroutine* co = boron_coCurrent( ut );
+    (void) a1;
+
+    if( co )
+    {
+        boron_coReady( ut, co );
+        boron_coSuspend( ut );
+    }
+    else if( BT->sched )
+    {
+        UCell tmp;
+        ur_setId( &tmp, UT_INT );
+        ur_int(&tmp) = 0;
+        if( ! cfunc_wait( ut, &tmp, res ) )
+            return UR_THROW;
+    }
+    ur_setId( res, UT_UNSET );
+    return UR_OK;
+}
+
+
+/*EOF*/
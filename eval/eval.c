@@ -1523,6 +1523,11 @@ static void _bindDefaultB( UThread* ut, UIndex blkN )
         type = ur_type(bi.it);
         if( ur_isWordType(type) )
         {
+            // Keep bindings to frozen contexts.
+            if( ur_binding(bi.it) == UR_BIND_ENV &&
+                bi.it->word.ctx < -UR_MAIN_CONTEXT )
+                continue;
+
             if( threadCtx->used )
             {
                 wrdN = ur_ctxLookup( threadCtx, ur_atom(bi.it) );
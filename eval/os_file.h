@@ -50,7 +50,13 @@ typedef struct
 OSFileInfo;
 
 
+typedef struct OSWalk  OSWalk;
+
+
 extern int ur_fileInfo( const char* path, OSFileInfo* info, int mask );
+extern OSWalk* ur_walkOpen( const char* root, int mask, int threads );
+extern const char* ur_walkNext( OSWalk*, OSFileInfo* info, int* pathLen );
+extern void ur_walkClose( OSWalk* );
 
 
 #endif  /* OS_FILE_H */
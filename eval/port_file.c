@@ -19,6 +19,7 @@
 
 
 #include "boron.h"
+#include "os.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -48,6 +49,25 @@
 #define FD  used
 
 
+/*
+  Buffered file ports have a FileBuffer extension.  The descriptor is still
+  held in UBuffer::used.
+*/
+typedef struct
+{
+    const UPortDevice* dev;
+    int     size;           // Capacity of data.
+    int     pos;            // Read position.
+    int     used;           // Bytes of data held.
+    int     writing;        // Non-zero if data is pending output.
+    uint8_t data[ 1 ];
+}
+FileBuffer;
+
+#define fileBuffer(port) \
+    ((port)->form == UR_PORT_EXT ? ur_ptr(FileBuffer, port) : NULL)
+
+
 static int file_open( UThread* ut, const UPortDevice* pdev, const UCell* from,
                       int opt, UCell* res )
 {
@@ -97,14 +117,66 @@ static int file_open( UThread* ut, const UPortDevice* pdev, const UCell* from,
 }
 
 
+static int _writeAll( int fd, const uint8_t* it, ssize_t len )
+{
+    ssize_t n;
+    while( len > 0 )
+    {
+        n = write( fd, it, len );
+        if( n < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            return 0;
+        }
+        it  += n;
+        len -= n;
+    }
+    return 1;
+}
+
+
+/*
+  Write any pending output, or move the file position back to the end of
+  the data actually read by the script.  The buffer is then empty.
+
+  Return zero and set errno if an error occurs.
+*/
+static int _fileSync( UBuffer* port, FileBuffer* fb )
+{
+    int ok = 1;
+    if( fb->writing )
+    {
+        ok = _writeAll( port->FD, fb->data, fb->used );
+        fb->writing = 0;
+    }
+    else if( fb->pos < fb->used )
+    {
+        if( lseek( port->FD, fb->pos - fb->used, SEEK_CUR ) == -1 &&
+            errno != ESPIPE )
+            ok = 0;
+    }
+    fb->pos = fb->used = 0;
+    return ok;
+}
+
+
 static void file_close( UBuffer* port )
 {
+    FileBuffer* fb = fileBuffer(port);
     if( port->FD > -1 )
     {
         //printf( "KR file_close %d\n", port->FD );
+        if( fb )
+            _fileSync( port, fb );
         close( port->FD );
         port->FD = -1;
     }
+    if( fb )
+    {
+        memFree( fb );
+        port->ptr.v = NULL;
+    }
 }
 
 
@@ -112,6 +184,54 @@ static int file_read( UThread* ut, UBuffer* port, UCell* dest, int len )
 {
     ssize_t n;
     UBuffer* buf = ur_buffer( dest->series.buf );
+    FileBuffer* fb = fileBuffer(port);
+
+    if( fb )
+    {
+        if( fb->writing && ! _fileSync( port, fb ) )
+            return ur_error( ut, UR_ERR_ACCESS, strerror( errno ) );
+
+        if( len < fb->size )
+        {
+            int copied = 0;
+            while( 1 )
+            {
+                n = fb->used - fb->pos;
+                if( n > len )
+                    n = len;
+                memCpy( buf->ptr.c + buf->used, fb->data + fb->pos, n );
+                fb->pos += n;
+                buf->used += n;
+                copied += n;
+                len -= n;
+
+                // Refill if empty, or to complete the request when the last
+                // fill was not short (so more input should be ready).
+                if( ! len || (copied && fb->used < fb->size) )
+                    break;
+                n = read( port->FD, fb->data, fb->size );
+                if( n < 0 )
+                    return ur_error( ut, UR_ERR_ACCESS, strerror( errno ) );
+                fb->pos  = 0;
+                fb->used = n;
+                if( ! n )
+                    break;
+            }
+            if( ! copied )
+                ur_setId(dest, UT_NONE);
+            return UR_OK;
+        }
+
+        if( fb->pos < fb->used )
+        {
+            n = fb->used - fb->pos;
+            memCpy( buf->ptr.c + buf->used, fb->data + fb->pos, n );
+            fb->pos = fb->used;
+            buf->used += n;
+            return UR_OK;
+        }
+        // Large reads with an empty buffer go directly to the file.
+    }
 
     n = read( port->FD, buf->ptr.c + buf->used, len );
     if( n > 0 )
@@ -165,13 +285,37 @@ static int file_write( UThread* ut, UBuffer* port, const UCell* data )
     const void* buf;
     ssize_t count;
     ssize_t len = boron_sliceMem( ut, data, &buf );
+    FileBuffer* fb = fileBuffer(port);
+
+    if( fb && len )
+    {
+        if( ! fb->writing || fb->used + len > fb->size )
+        {
+            if( ! _fileSync( port, fb ) )
+                goto fail;
+        }
+        if( len < fb->size )
+        {
+            memCpy( fb->data + fb->used, buf, len );
+            fb->used += len;
+            fb->writing = 1;
+            return UR_OK;
+        }
+        if( ! _writeAll( port->FD, (const uint8_t*) buf, len ) )
+            goto fail;
+        return UR_OK;
+    }
+
     if( len )
     {
         count = write( port->FD, buf, len );
         if( count != len )
-            return ur_error( ut, UR_ERR_ACCESS, strerror( errno ) );
+            goto fail;
     }
     return UR_OK;
+
+fail:
+    return ur_error( ut, UR_ERR_ACCESS, strerror( errno ) );
 }
 
 
@@ -179,6 +323,10 @@ static int file_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
 {
     if( ur_is(pos, UT_INT) )
     {
+        FileBuffer* fb = fileBuffer(port);
+        if( fb && ! _fileSync( port, fb ) )
+            return ur_error( ut, UR_ERR_ACCESS, strerror( errno ) );
+
         switch( where )
         {
             case UR_PORT_HEAD:
@@ -216,6 +364,17 @@ static int file_waitFD( UBuffer* port )
 #endif
 
 
+/*
+  Return non-zero if the port has input held in its FileBuffer.  The
+  descriptor from file_waitFD may not signal for data already read.
+*/
+int file_pending( const UBuffer* port )
+{
+    const FileBuffer* fb = fileBuffer(port);
+    return fb && ! fb->writing && fb->pos < fb->used;
+}
+
+
 UPortDevice port_file =
 {
     file_open, file_close, file_read, file_write, file_seek,
@@ -223,4 +382,52 @@ UPortDevice port_file =
 };
 
 
+/*
+  Pipe from a child process (see execute /port).  The same as a file port
+  but reads in larger chunks by default.
+*/
+UPortDevice port_pipe =
+{
+    file_open, file_close, file_read, file_write, file_seek,
+    file_waitFD, 0x10000
+};
+
+
+/*
+  Open a file port which buffers reads & writes in user memory.
+  Pending output is written when the port is closed, seeked, or read.
+
+  \param size   Buffer size in bytes.
+*/
+int file_openBuffered( UThread* ut, const UCell* from, int opt, int size,
+                       UCell* res )
+{
+    UBuffer* port;
+    FileBuffer* fb;
+
+    if( size < 512 )
+        size = 512;
+    fb = (FileBuffer*) memAlloc( sizeof(FileBuffer) - 1 + size );
+    if( ! fb )
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for file buffer" );
+
+    if( ! file_open( ut, &port_file, from, opt, res ) )
+    {
+        memFree( fb );
+        return UR_THROW;
+    }
+
+    fb->dev     = &port_file;
+    fb->size    = size;
+    fb->pos     = 0;
+    fb->used    = 0;
+    fb->writing = 0;
+
+    port = ur_buffer( res->port.buf );
+    port->form  = UR_PORT_EXT;
+    port->ptr.v = fb;
+    return UR_OK;
+}
+
+
 /*EOF*/
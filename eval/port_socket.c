@@ -39,11 +39,21 @@ static char* WSAGetLastErrorMessage()
 
 #else
 
+#ifdef __linux__
+#define _GNU_SOURCE     // For recvmmsg() & sendmmsg().
+#endif
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <signal.h>
+#include <sys/sendfile.h>
+#endif
 
 #define SOCKET      int
 #define SOCKET_ERR  strerror(errno)
@@ -54,6 +64,7 @@ static char* WSAGetLastErrorMessage()
 
 #include "boron.h"
 #include "os.h"
+#include "boron_internal.h"
 
 
 #define FD      used
@@ -67,6 +78,10 @@ typedef struct
     socklen_t addrlen;
 #ifdef _WIN32
     HANDLE event;
+#else
+    UBuffer out;        // Output queued by a non-blocking TCP socket.
+    int outPos;         // Start of unsent data in out.
+    int nowait;
 #endif
 }
 SocketExt;
@@ -85,6 +100,32 @@ UPortDevice port_listenSocket;
 UPortDevice port_socket;
 
 
+static SocketExt* _makeSocketExt( int nowait )
+{
+    SocketExt* ext = (SocketExt*) memAlloc( sizeof(SocketExt) );
+#ifdef _WIN32
+    (void) nowait;
+    ext->event = WSA_INVALID_EVENT;
+#else
+    ur_binInit( &ext->out, 0 );
+    ext->outPos = 0;
+    ext->nowait = nowait;
+#endif
+    return ext;
+}
+
+
+static void _setNonBlocking( SOCKET fd )
+{
+#ifdef _WIN32
+    u_long flags = 1;
+    ioctlsocket( fd, FIONBIO, &flags );
+#else
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+}
+
+
 /*
    Initialize NodeServ from strings like "myhost.net",
    "udp://myhost.net:180", "tcp://:4600", etc.
@@ -267,10 +308,29 @@ makeStr:
 }
 
 
+/*
+  Allow other sockets to bind the same address so that the system can
+  balance incoming connections or datagrams between them.
+*/
+static int _reusePort( UThread* ut, SOCKET fd )
+{
+#ifdef SO_REUSEPORT
+    int yes = 1;
+    if( setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, (const char*) &yes,
+                    sizeof(int) ) == 0 )
+        return UR_OK;
+    return ur_error( ut, UR_ERR_ACCESS, "setsockopt %s", SOCKET_ERR );
+#else
+    (void) fd;
+    return ur_error( ut, UR_ERR_SCRIPT, "open /reuse is not supported" );
+#endif
+}
+
+
 /*
    \param ext  If non-zero, then bind socket to ext->addr.
 */
-static int _openUdpSocket( UThread* ut, SocketExt* ext, int nowait )
+static int _openUdpSocket( UThread* ut, SocketExt* ext, int opt )
 {
     SOCKET fd;
 
@@ -281,18 +341,16 @@ static int _openUdpSocket( UThread* ut, SocketExt* ext, int nowait )
         return -1;
     }
 
-    if( nowait )
-    {
-#ifdef _WIN32
-        u_long flags = 1;
-        ioctlsocket( fd, FIONBIO, &flags );
-#else
-        fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
-#endif
-    }
+    if( opt & UR_PORT_NOWAIT )
+        _setNonBlocking( fd );
 
     if( ext )
     {
+        if( (opt & UR_PORT_REUSE) && ! _reusePort( ut, fd ) )
+        {
+            closesocket( fd );
+            return -1;
+        }
         if( bind( fd, &ext->addr, ext->addrlen ) < 0 )
         {
             closesocket( fd );
@@ -341,7 +399,7 @@ static int _openTcpClient( UThread* ut, struct sockaddr* addr,
 
 
 static int _openTcpServer( UThread* ut, struct sockaddr* addr,
-                           socklen_t addrlen, int backlog )
+                           socklen_t addrlen, int backlog, int reuse )
 {
     SOCKET fd;
     int yes = 1;
@@ -360,6 +418,12 @@ static int _openTcpServer( UThread* ut, struct sockaddr* addr,
         return -1;
     }
 
+    if( reuse && ! _reusePort( ut, fd ) )
+    {
+        closesocket( fd );
+        return -1;
+    }
+
     if( bind( fd, addr, addrlen ) != 0 )
     {
         closesocket( fd );
@@ -399,11 +463,8 @@ static int socket_open( UThread* ut, const UPortDevice* pdev,
     if( ! ur_is(from, UT_STRING) )
         return ur_error( ut, UR_ERR_TYPE, "socket open expected string" );
 
-    ext = (SocketExt*) memAlloc( sizeof(SocketExt) );
+    ext = _makeSocketExt( nowait );
     ext->addrlen = 0;
-#ifdef _WIN32
-    ext->event = WSA_INVALID_EVENT;
-#endif
 
     //if( ur_is(from, UT_STRING) )
     {
@@ -470,17 +531,23 @@ static int socket_open( UThread* ut, const UPortDevice* pdev,
 
     if( ns.socktype == SOCK_DGRAM )
     {
-        socket = _openUdpSocket( ut, ns.node ? 0 : ext, nowait );
+        socket = _openUdpSocket( ut, ns.node ? 0 : ext, opt );
     }
     else
     {
         if( ns.node && ! (opt & UR_PORT_READ) )
         {
             socket = _openTcpClient( ut, &ext->addr, ext->addrlen );
+#ifndef _WIN32
+            if( nowait && socket > -1 )
+                _setNonBlocking( socket );
+#endif
         }
         else
         {
-            socket = _openTcpServer( ut, &ext->addr, ext->addrlen, 10 );
+            socket = _openTcpServer( ut, &ext->addr, ext->addrlen,
+                                     (opt & UR_PORT_REUSE) ? SOMAXCONN : 10,
+                                     opt & UR_PORT_REUSE );
             pdev = &port_listenSocket;
         }
     }
@@ -503,12 +570,111 @@ fail:
 }
 
 
+#ifndef __linux__
+#define MSG_NOSIGNAL    0
+#endif
+
+
+#ifndef _WIN32
+/*
+  Send queued output followed by len bytes of data with a single gathering
+  sendmsg() call.  Anything which the socket does not accept is added to
+  the queue.
+
+  \return Number of bytes still queued, or -1 if an error occured.
+*/
+static ssize_t _sendQueued( UBuffer* port, const void* data, ssize_t len )
+{
+    SocketExt* ext = ur_ptr(SocketExt, port);
+    UBuffer* out = &ext->out;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t pending = out->used - ext->outPos;
+    ssize_t n;
+
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = iov;
+    if( pending )
+    {
+        iov[0].iov_base = out->ptr.b + ext->outPos;
+        iov[0].iov_len  = pending;
+        msg.msg_iovlen = 1;
+    }
+    if( len )
+    {
+        iov[ msg.msg_iovlen ].iov_base = (void*) data;
+        iov[ msg.msg_iovlen ].iov_len  = len;
+        ++msg.msg_iovlen;
+    }
+    if( ! msg.msg_iovlen )
+        return 0;
+
+    while( (n = sendmsg( port->FD, &msg, MSG_NOSIGNAL )) == -1 )
+    {
+        if( errno == EAGAIN || errno == EWOULDBLOCK )
+        {
+            n = 0;
+            break;
+        }
+        if( errno != EINTR )
+            return -1;
+    }
+
+    if( n >= pending )
+    {
+        out->used = ext->outPos = 0;
+        n -= pending;
+        if( n < len )
+            ur_binAppendData( out, (const uint8_t*) data + n, len - n );
+    }
+    else
+    {
+        ext->outPos += n;
+        if( len )
+        {
+            // Reclaim the sent part of the queue before it grows.
+            if( ext->outPos > out->used / 2 )
+            {
+                ur_binErase( out, 0, ext->outPos );
+                ext->outPos = 0;
+            }
+            ur_binAppendData( out, (const uint8_t*) data, len );
+        }
+    }
+    return out->used - ext->outPos;
+}
+
+
+/*
+  Return the number of output bytes queued by a socket port.
+*/
+int socket_pending( const UBuffer* port )
+{
+    const SocketExt* ext = ur_ptr(const SocketExt, port);
+    return ext->out.used - ext->outPos;
+}
+
+
+/*
+  Try to send the output queue of a socket port without blocking.
+
+  \return Number of bytes still queued, or -1 if an error occured.
+*/
+int socket_flush( UBuffer* port )
+{
+    if( port->FD < 0 )
+        return -1;
+    return _sendQueued( port, NULL, 0 );
+}
+#endif
+
+
 static void socket_close( UBuffer* pbuf )
 {
     //printf( "KR socket_close %d\n", pbuf->FD );
+    SocketExt* ext = ur_ptr(SocketExt, pbuf);
 
 #ifdef _WIN32
-    SocketExt* ext = ur_ptr(SocketExt, pbuf);
     if( ext->event != WSA_INVALID_EVENT )
     {
         WSACloseEvent( ext->event );
@@ -518,9 +684,17 @@ static void socket_close( UBuffer* pbuf )
 
     if( pbuf->FD > -1 )
     {
+#ifndef _WIN32
+        // Make a last attempt to send queued output.
+        if( socket_pending( pbuf ) )
+            socket_flush( pbuf );
+#endif
         closesocket( pbuf->FD );
         pbuf->FD = -1;
     }
+#ifndef _WIN32
+    ur_binFree( &ext->out );
+#endif
 
     memFree( pbuf->ptr.v );
     //pbuf->ptr.v = 0;      // Done by port_destroy().
@@ -611,22 +785,31 @@ static HANDLE _createSocketEvent( int socketFD, int accept )
 #endif
 
 
-static int socket_accept( UThread* ut, UBuffer* port, UCell* dest, int part )
+/*
+  Accept a connection from a listening socket as a new socket port.
+
+  \return 1 if dest is set, 0 if a non-blocking listener has no connection
+          waiting, or -1 if accept() failed.
+*/
+static int _acceptSocket( UThread* ut, SOCKET listenFD, int nowait,
+                          UCell* dest )
 {
     SOCKET fd;
     SocketExt* ext;
     UBuffer* buf;
-    (void) part;
-
 
-    ext = (SocketExt*) memAlloc( sizeof(SocketExt) );
+    ext = _makeSocketExt( nowait );
     ext->addrlen = sizeof(ext->addr);
 
-    fd = accept( port->FD, &ext->addr, &ext->addrlen );
+    fd = accept( listenFD, &ext->addr, &ext->addrlen );
     if( INVALID(fd) )
     {
         memFree( ext );
-        return ur_error( ut, UR_ERR_INTERNAL, "accept %s", SOCKET_ERR );
+#ifdef _WIN32
+        return (WSAGetLastError() == WSAEWOULDBLOCK) ? 0 : -1;
+#else
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+#endif
     }
 
 #ifdef _WIN32
@@ -642,56 +825,611 @@ static int socket_accept( UThread* ut, UBuffer* port, UCell* dest, int part )
     ext->event = WSA_INVALID_EVENT;
     }
 #endif
+#else
+    // Connections accepted by a /nowait listener are non-blocking.
+    if( nowait )
+        _setNonBlocking( fd );
 #endif
 
     buf = boron_makePort( ut, &port_socket, ext, dest );
     buf->TCP = 1;
     buf->FD  = fd;
+    return 1;
+}
+
+
+#ifdef _WIN32
+#define _listenNoWait(port)     0
+#else
+#define _listenNoWait(port)     ur_ptr(SocketExt, port)->nowait
+#endif
+
+
+static int socket_accept( UThread* ut, UBuffer* port, UCell* dest, int part )
+{
+    (void) part;
+
+    if( _acceptSocket( ut, port->FD, _listenNoWait(port), dest ) < 1 )
+        return ur_error( ut, UR_ERR_INTERNAL, "accept %s", SOCKET_ERR );
     return UR_OK;
 }
 
 
+/*
+  Accept all waiting connections (up to count) and append their ports to
+  a block.  Only the first connection is waited for.
+
+  \return Number of connections accepted or -1 if an error was thrown.
+*/
+static int _acceptBatch( UThread* ut, UBuffer* port, UIndex blkN, int count )
+{
+    // The port buffer may move as new ports are made.
+    SOCKET fd = port->FD;
+    int nowait = _listenNoWait(port);
+    int n = 0;
+    int r;
+    UCell cell;
+
+#ifdef _WIN32
+    count = 1;
+#else
+    int flags = -1;
+#endif
+    if( count < 1 )
+        count = INT32_MAX;
+
+    while( (r = _acceptSocket( ut, fd, nowait, &cell )) > 0 )
+    {
+        ur_blkPush( ur_buffer(blkN), &cell );
+        if( ++n == count )
+            break;
+#ifndef _WIN32
+        // Make the listener non-blocking to stop when none are waiting.
+        if( flags < 0 )
+        {
+            flags = fcntl( fd, F_GETFL, 0 );
+            fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+        }
+#endif
+    }
+
+#ifndef _WIN32
+    if( flags > -1 )
+        fcntl( fd, F_SETFL, flags );
+#endif
+    if( r < 0 && ! n )
+    {
+        ur_error( ut, UR_ERR_INTERNAL, "accept %s", SOCKET_ERR );
+        return -1;
+    }
+    return n;
+}
+
+
 extern int boron_sliceMem( UThread* ut, const UCell* cell, const void** ptr );
 
 
+#define BATCH_MAX   64          // Datagrams per recvmmsg/sendmmsg call.
+#define BATCH_READ  16          // Datagrams read if no count is given.
+#define BATCH_SLOT  0x10000     // Largest datagram read.
+
+typedef struct
+{
+    const void* data;
+    int len;
+    const struct sockaddr* addr;
+    socklen_t addrlen;
+}
+Datagram;
+
+
+/*
+  Set addr from a "host:port" string.  Numeric addresses are converted
+  directly, other host names are looked up.
+*/
+static int _parseAddr( UThread* ut, const UCell* strC, struct sockaddr* addr )
+{
+    struct sockaddr_in* sin = (struct sockaddr_in*) addr;
+    SocketExt tmp;
+    NodeServ ns;
+
+    stringToNodeServ( ut, strC, &ns );
+    if( ! ns.node || ! ns.service )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Datagram address requires hostname and port" );
+
+    memset( sin, 0, sizeof(struct sockaddr_in) );
+    if( inet_pton( AF_INET, ns.node, &sin->sin_addr ) == 1 )
+    {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons( (uint16_t) atoi( ns.service ) );
+        return UR_OK;
+    }
+
+    ns.socktype = SOCK_DGRAM;
+    if( ! makeSockAddr( ut, &tmp, &ns ) )
+        return UR_THROW;
+    memcpy( addr, &tmp.addr, sizeof(struct sockaddr_in) );
+    return UR_OK;
+}
+
+
+/*
+  Append a binary! datagram & its source address string! to a block.
+*/
+static void _appendDatagram( UThread* ut, UIndex blkN, const uint8_t* data,
+                             int len, const struct sockaddr_in* from )
+{
+    char host[ INET_ADDRSTRLEN + 8 ];
+    UBuffer* bin;
+    UCell* cell;
+    UIndex n;
+    int hlen;
+
+    n = ur_makeBinary( ut, len );
+    bin = ur_buffer( n );
+    memCpy( bin->ptr.b, data, len );
+    bin->used = len;
+    cell = ur_blkAppendNew( ur_buffer(blkN), UT_BINARY );
+    ur_setSeries( cell, n, 0 );
+
+    if( ! inet_ntop( AF_INET, (void*) &from->sin_addr, host,
+                     INET_ADDRSTRLEN ) )
+        host[0] = '\0';
+    hlen = strLen( host );
+    hlen += sprintf( host + hlen, ":%d", ntohs( from->sin_port ) );
+    n = ur_makeStringLatin1( ut, (const uint8_t*) host,
+                                 (const uint8_t*) host + hlen );
+    cell = ur_blkAppendNew( ur_buffer(blkN), UT_STRING );
+    ur_setSeries( cell, n, 0 );
+}
+
+
+/*
+  Receive up to count datagrams from a UDP socket and append them to a
+  block as binary! & source address string! pairs.  Only the first
+  datagram is waited for if the socket is blocking.
+
+  The datagrams are received into the thread temporary binary, which is
+  shared by all ports and grown to BATCH_SLOT bytes per datagram requested.
+
+  For a listening socket the waiting connections are accepted instead.
+
+  \return Number of datagrams received or -1 if an error was thrown.
+*/
+int socket_readBatch( UThread* ut, UBuffer* port, UIndex blkN, int count )
+{
+    SocketExt* ext = ur_ptr(SocketExt, port);
+    UBuffer* area = &BT->tbin;
+    struct sockaddr_in from[ BATCH_MAX ];
+    int dlen[ BATCH_MAX ];
+    int i, n;
+
+    if( port->FD > -1 && ext->dev == &port_listenSocket )
+        return _acceptBatch( ut, port, blkN, count );
+    if( port->FD < 0 || port->TCP )
+    {
+        ur_error( ut, UR_ERR_SCRIPT,
+                  "read /into block! expected open UDP or listen socket" );
+        return -1;
+    }
+    if( count < 1 )
+        count = BATCH_READ;
+    else if( count > BATCH_MAX )
+        count = BATCH_MAX;
+
+    // Pages past the first slot are only touched by large datagrams.
+    area->used = 0;
+    ur_binReserve( area, count * BATCH_SLOT );
+
+#ifdef __linux__
+    {
+    struct mmsghdr msg[ BATCH_MAX ];
+    struct iovec iov[ BATCH_MAX ];
+
+    memset( msg, 0, sizeof(struct mmsghdr) * count );
+    for( i = 0; i < count; ++i )
+    {
+        iov[ i ].iov_base = area->ptr.b + i * BATCH_SLOT;
+        iov[ i ].iov_len  = BATCH_SLOT;
+        msg[ i ].msg_hdr.msg_name    = from + i;
+        msg[ i ].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msg[ i ].msg_hdr.msg_iov     = iov + i;
+        msg[ i ].msg_hdr.msg_iovlen  = 1;
+    }
+    while( (n = recvmmsg( port->FD, msg, count, MSG_WAITFORONE, NULL )) == -1
+           && errno == EINTR )
+        ;
+    for( i = 0; i < n; ++i )
+        dlen[ i ] = msg[ i ].msg_len;
+    }
+#else
+    {
+    socklen_t alen;
+    int flags = 0;
+    int r;
+
+#ifdef _WIN32
+    count = 1;
+#endif
+    for( n = 0; n < count; ++n )
+    {
+        alen = sizeof(struct sockaddr_in);
+        r = recvfrom( port->FD, (char*) area->ptr.b + n * BATCH_SLOT,
+                      BATCH_SLOT, flags, (struct sockaddr*) (from + n),
+                      &alen );
+        if( r < 0 )
+        {
+            if( n )
+                break;
+            n = -1;
+            break;
+        }
+        dlen[ n ] = r;
+#ifndef _WIN32
+        flags = MSG_DONTWAIT;
+#endif
+    }
+    }
+#endif
+
+    if( n < 0 )
+    {
+#ifdef _WIN32
+        int err = WSAGetLastError();
+        if( (err == WSAEWOULDBLOCK) || (err == WSAEINTR) )
+#else
+        if( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+#endif
+            return 0;
+        ur_error( ut, UR_ERR_ACCESS, "recvmmsg %s", SOCKET_ERR );
+        return -1;
+    }
+
+    for( i = 0; i < n; ++i )
+        _appendDatagram( ut, blkN, area->ptr.b + i * BATCH_SLOT, dlen[ i ],
+                         from + i );
+    return n;
+}
+
+
+/*
+  Send datagrams with as few system calls as possible.
+*/
+static int _sendBatch( UThread* ut, UBuffer* port, const Datagram* dg,
+                       int count )
+{
+    int n = 0;
+#ifdef __linux__
+    struct mmsghdr msg[ BATCH_MAX ];
+    struct iovec iov[ BATCH_MAX ];
+    int i, r;
+
+    memset( msg, 0, sizeof(struct mmsghdr) * count );
+    for( i = 0; i < count; ++i )
+    {
+        iov[ i ].iov_base = (void*) dg[ i ].data;
+        iov[ i ].iov_len  = dg[ i ].len;
+        msg[ i ].msg_hdr.msg_name    = (void*) dg[ i ].addr;
+        msg[ i ].msg_hdr.msg_namelen = dg[ i ].addrlen;
+        msg[ i ].msg_hdr.msg_iov     = iov + i;
+        msg[ i ].msg_hdr.msg_iovlen  = 1;
+    }
+    while( n < count )
+    {
+        r = sendmmsg( port->FD, msg + n, count - n, 0 );
+        if( r < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            goto fail;
+        }
+        n += r;
+    }
+#else
+    for( ; n < count; ++n, ++dg )
+    {
+        if( sendto( port->FD, dg->data, dg->len, 0, dg->addr,
+                    dg->addrlen ) < 0 )
+            goto fail;
+    }
+#endif
+    return UR_OK;
+
+fail:
+#ifdef _WIN32
+    if( WSAGetLastError() == WSAEWOULDBLOCK )
+#else
+    if( errno == EAGAIN || errno == EWOULDBLOCK )
+#endif
+        return ur_error( ut, UR_ERR_ACCESS,
+                         "send only sent %d of %d datagrams", n, count );
+    ur_error( ut, UR_ERR_ACCESS, "sendmmsg %s", SOCKET_ERR );
+
+    // An error occured; the socket must not be used again.
+    closesocket( port->FD );
+    port->FD = -1;
+    return UR_THROW;
+}
+
+
+/*
+  Send a block of data & address pairs from a UDP socket.  Each address is
+  a "host:port" string! or none! to use the port address.
+*/
+static int _writeBatch( UThread* ut, UBuffer* port, const UCell* blkC )
+{
+    SocketExt* ext = ur_ptr(SocketExt, port);
+    struct sockaddr to[ BATCH_MAX ];
+    Datagram dg[ BATCH_MAX ];
+    Datagram* it;
+    UBlockIter bi;
+    int count = 0;
+
+    if( port->TCP )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "write block! expected UDP socket port" );
+
+    ur_blkSlice( ut, &bi, blkC );
+    if( (bi.end - bi.it) & 1 )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "write expected block of data & address pairs" );
+
+    for( ; bi.it != bi.end; bi.it += 2 )
+    {
+        it = dg + count;
+        if( ! ur_is(bi.it, UT_BINARY) && ! ur_is(bi.it, UT_STRING) )
+            return ur_error( ut, UR_ERR_TYPE,
+                             "write expected binary!/string! datagram" );
+        it->len = boron_sliceMem( ut, bi.it, &it->data );
+
+        if( ur_is(bi.it + 1, UT_STRING) )
+        {
+            if( ! _parseAddr( ut, bi.it + 1, to + count ) )
+                return UR_THROW;
+            it->addr    = to + count;
+            it->addrlen = sizeof(struct sockaddr_in);
+        }
+        else if( ur_is(bi.it + 1, UT_NONE) )
+        {
+            it->addr    = &ext->addr;
+            it->addrlen = ext->addrlen;
+        }
+        else
+            return ur_error( ut, UR_ERR_TYPE,
+                             "write expected string!/none! address" );
+
+        if( ++count == BATCH_MAX )
+        {
+            if( ! _sendBatch( ut, port, dg, count ) )
+                return UR_THROW;
+            count = 0;
+        }
+    }
+    return count ? _sendBatch( ut, port, dg, count ) : UR_OK;
+}
+
+
 static int socket_write( UThread* ut, UBuffer* port, const UCell* data )
 {
     const void* buf;
-    int n;
-    ssize_t len = boron_sliceMem( ut, data, &buf );
+    ssize_t n;
+    ssize_t len;
 
-#ifndef __linux__
-#define MSG_NOSIGNAL    0
-#endif
+    if( ur_is(data, UT_BLOCK) && port->FD > -1 )
+        return _writeBatch( ut, port, data );
 
+    len = boron_sliceMem( ut, data, &buf );
     if( port->FD > -1 && len )
     {
         if( port->TCP )
         {
-            n = send( port->FD, buf, len, MSG_NOSIGNAL );
+#ifndef _WIN32
+            // Non-blocking sockets queue what cannot be sent immediately.
+            if( ur_ptr(SocketExt, port)->nowait )
+            {
+                if( _sendQueued( port, buf, len ) < 0 )
+                    goto fail;
+                return UR_OK;
+            }
+#endif
+            // A blocking send may be cut short by a signal.
+            do
+            {
+                n = send( port->FD, buf, len, MSG_NOSIGNAL );
+                if( n > 0 )
+                {
+                    buf = (const char*) buf + n;
+                    len -= n;
+                }
+#ifndef _WIN32
+                else if( errno == EINTR )
+                    continue;
+#endif
+                else
+                    goto fail;
+            }
+            while( len );
         }
         else
         {
             SocketExt* ext = ur_ptr(SocketExt, port);
             n = sendto( port->FD, buf, len, 0, &ext->addr, ext->addrlen );
+            if( n == -1 )
+                goto fail;
+            if( n != len )
+                return ur_error( ut, UR_ERR_ACCESS,
+                                 "send only sent %d of %d bytes",
+                                 (int) n, (int) len );
         }
+    }
+    return UR_OK;
+
+fail:
+    ur_error( ut, UR_ERR_ACCESS, "send %s", SOCKET_ERR );
+
+    // An error occured; the socket must not be used again.
+    closesocket( port->FD );
+    port->FD = -1;
+    return UR_THROW;
+}
+
+
+#define SEND_FILE_CHUNK     0x10000
+
+/*
+  Send data from a file descriptor to a TCP socket port.
+
+  \param port    TCP socket port.
+  \param fd      File descriptor to read from.
+  \param offset  Starting file offset, or -1 to use (and advance) the
+                 file position.
+  \param len     Maximum number of bytes to send, or -1 for the rest of
+                 the file.
+  \param sent    Set to the number of bytes sent.
+
+  \return UR_OK/UR_THROW
+
+  Fewer than len bytes are sent if the end of file is reached or a
+  non-blocking socket would block.
+*/
+int socket_sendFile( UThread* ut, UBuffer* port, int fd, int64_t offset,
+                     int64_t len, int64_t* sent )
+{
+    int64_t total = 0;
+    ssize_t n;
 
-        if( n == -1 )
+    if( port->FD < 0 || ! port->TCP )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "transfer expected open TCP socket port" );
+
+#ifndef _WIN32
+    // Queued output must go first; if it cannot then the socket would block.
+    if( socket_pending( port ) )
+    {
+        n = socket_flush( port );
+        if( n )
         {
+            *sent = 0;
+            if( n > 0 )
+                return UR_OK;
             ur_error( ut, UR_ERR_ACCESS, "send %s", SOCKET_ERR );
+            goto fail;
+        }
+    }
+#endif
 
-            // An error occured; the socket must not be used again.
-            closesocket( port->FD );
-            port->FD = -1;
-            return UR_THROW;
+#ifdef __linux__
+    {
+    // sendfile() has no MSG_NOSIGNAL, so SIGPIPE is blocked & discarded.
+    sigset_t pipeSet, oldSet;
+    off_t off = offset;
+    size_t chunk;
+    int err = 0;
+
+    sigemptyset( &pipeSet );
+    sigaddset( &pipeSet, SIGPIPE );
+    pthread_sigmask( SIG_BLOCK, &pipeSet, &oldSet );
+
+    while( len )
+    {
+        chunk = (len < 0 || len > 0x7ffff000) ? 0x7ffff000 : (size_t) len;
+        n = sendfile( port->FD, fd, (offset < 0) ? NULL : &off, chunk );
+        if( n > 0 )
+        {
+            total += n;
+            if( len > 0 )
+                len -= n;
         }
-        else if( n != len )
+        else if( n == 0 )
+            break;
+        else if( errno != EINTR )
         {
-            return ur_error( ut, UR_ERR_ACCESS,
-                             "send only sent %d of %d bytes", n, len );
+            if( errno != EAGAIN )
+                err = errno;
+            break;
         }
     }
+
+    if( err == EPIPE )
+    {
+        struct timespec zero = { 0, 0 };
+        sigtimedwait( &pipeSet, NULL, &zero );
+    }
+    pthread_sigmask( SIG_SETMASK, &oldSet, NULL );
+
+    *sent = total;
+    if( err )
+    {
+        ur_error( ut, UR_ERR_ACCESS, "sendfile %s", strerror(err) );
+        goto fail;
+    }
+    }
+#else
+    {
+    // Copy through a buffer.  Reads are positioned so that data which the
+    // socket does not accept is not consumed from the file.
+    char* buf;
+    int64_t pos = offset;
+    int chunk;
+    int wn = 0;
+
+#ifdef _WIN32
+#define lseek   _lseeki64
+#endif
+    if( pos < 0 )
+        pos = lseek( fd, 0, SEEK_CUR );
+    buf = (char*) memAlloc( SEND_FILE_CHUNK );
+
+    while( len )
+    {
+        chunk = (len < 0 || len > SEND_FILE_CHUNK) ? SEND_FILE_CHUNK
+                                                   : (int) len;
+#ifdef _WIN32
+        lseek( fd, pos, SEEK_SET );
+        n = _read( fd, buf, chunk );
+#else
+        n = pread( fd, buf, chunk, pos );
+#endif
+        if( n <= 0 )
+            break;
+        wn = send( port->FD, buf, n, MSG_NOSIGNAL );
+        if( wn > 0 )
+        {
+            pos   += wn;
+            total += wn;
+            if( len > 0 )
+                len -= wn;
+        }
+        if( wn != n )
+            break;
+    }
+    memFree( buf );
+
+    if( offset < 0 )
+        lseek( fd, pos, SEEK_SET );
+    *sent = total;
+    if( wn < 0 )
+    {
+#ifdef _WIN32
+        if( WSAGetLastError() != WSAEWOULDBLOCK )
+#else
+        if( errno != EAGAIN )
+#endif
+        {
+            ur_error( ut, UR_ERR_ACCESS, "send %s", SOCKET_ERR );
+            goto fail;
+        }
+    }
+    }
+#endif
     return UR_OK;
+
+fail:
+    // An error occured; the socket must not be used again.
+    closesocket( port->FD );
+    port->FD = -1;
+    return UR_THROW;
 }
 
 
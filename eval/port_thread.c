@@ -349,6 +349,11 @@ static int thread_read( UThread* ut, UBuffer* port, UCell* dest, int part )
             if( ur_binding(dest) == UR_BIND_THREAD )
                 ur_unbind(dest);
         }
+        else if( type >= UT_REFERENCE_BUF )
+        {
+            // May reference buffers frozen by the writer.
+            ur_syncShared( ut );
+        }
     }
 
     return UR_OK;
@@ -0,0 +1,837 @@
+/*
+  This file is part of the Boron programming language.
+
+  Boron is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Boron is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with Boron.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+  Work-stealing task pool.
+
+  Each worker is a UThread with its own deque of pending tasks.  A worker
+  pops the newest task from its own deque and steals the oldest task from
+  the others when it runs dry.  Task bodies and results are passed between
+  threads in serialized form, so only the frozen shared environment is
+  common to the submitting thread and the worker.
+
+  A future is a port! which becomes readable when the task finishes.
+*/
+
+
+#include "boron.h"
+#include "os.h"
+#include "boron_internal.h"
+
+#ifdef __linux
+#define USE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+
+#define MAX_WORKERS 64      // LIMIT: Maximum number of pool threads.
+
+
+enum TaskState
+{
+    TASK_PENDING,
+    TASK_DONE,
+    TASK_ERROR
+};
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    OSMutex  mutex;
+    OSCond   cond;
+    UBuffer  data;          // Serialized result or UTF-8 error message.
+    int      refCount;      // Protected by mutex.
+    int      state;         // Protected by mutex.
+    int      exType;
+#ifdef USE_EVENTFD
+    int      eventFD;
+#elif defined(_WIN32)
+    HANDLE   eventH;
+#else
+    int      pipeFD[2];
+#endif
+}
+TaskFuture;
+
+
+typedef struct
+{
+    TaskFuture* fut;
+    uint8_t* code;          // Serialized body block.
+    int len;
+}
+TaskItem;
+
+
+typedef struct TaskPool TaskPool;
+
+typedef struct
+{
+    OSMutex  mutex;
+    UBuffer  deque;         // TaskItem array.  Protected by mutex.
+    UIndex   head;          // Oldest item in deque.  Protected by mutex.
+    TaskPool* pool;
+    UThread* ut;
+    OSThread thread;
+}
+TaskWorker;
+
+
+struct TaskPool
+{
+    OSMutex  mutex;
+    OSCond   cond;          // Signaled when a task is queued or on quit.
+    int      pending;       // Number of queued tasks.  Protected by mutex.
+    int      next;          // Round-robin index for outside threads.
+    int      quit;
+    int      count;         // Workers with a thread & deque.
+    int      running;       // Workers with a started thread.
+    TaskWorker workers[ 1 ];
+};
+
+
+extern UPortDevice port_task;
+
+
+static TaskFuture* _makeFuture()
+{
+    TaskFuture* fut = (TaskFuture*) memAlloc( sizeof(TaskFuture) );
+    if( ! fut )
+        return NULL;
+    if( mutexInitF( fut->mutex ) )
+        goto fail;
+#ifdef USE_EVENTFD
+    fut->eventFD = eventfd( 0, EFD_CLOEXEC );
+    if( fut->eventFD == -1 )
+        goto fail_mutex;
+#elif defined(_WIN32)
+    fut->eventH = CreateEvent( NULL, TRUE, FALSE, NULL );
+    if( fut->eventH == NULL )
+        goto fail_mutex;
+#else
+    if( pipe( fut->pipeFD ) == -1 )
+        goto fail_mutex;
+#endif
+    condInit( fut->cond );
+    ur_binInit( &fut->data, 0 );
+    fut->dev      = &port_task;
+    fut->refCount = 2;      // Port & task item.
+    fut->state    = TASK_PENDING;
+    fut->exType   = UR_ERR_SCRIPT;
+    return fut;
+
+fail_mutex:
+    mutexFree( fut->mutex );
+fail:
+    memFree( fut );
+    return NULL;
+}
+
+
+static void _releaseFuture( TaskFuture* fut )
+{
+    int refs;
+
+    mutexLock( fut->mutex );
+    refs = --fut->refCount;
+    mutexUnlock( fut->mutex );
+
+    if( refs == 0 )
+    {
+#ifdef USE_EVENTFD
+        close( fut->eventFD );
+#elif defined(_WIN32)
+        CloseHandle( fut->eventH );
+#else
+        close( fut->pipeFD[0] );
+        close( fut->pipeFD[1] );
+#endif
+        mutexFree( fut->mutex );
+        condFree( fut->cond );
+        ur_binFree( &fut->data );
+        memFree( fut );
+    }
+}
+
+
+/*
+  Set the result state and wake any thread waiting on the future.
+*/
+static void _finishFuture( TaskFuture* fut, int state )
+{
+    mutexLock( fut->mutex );
+    fut->state = state;
+    condSignal( fut->cond );
+    mutexUnlock( fut->mutex );
+
+    // The event stays set so the port remains readable for wait.
+    {
+#ifdef USE_EVENTFD
+    uint64_t n = 1;
+    write( fut->eventFD, &n, sizeof(n) );
+#elif defined(_WIN32)
+    SetEvent( fut->eventH );
+#else
+    uint8_t n = 1;
+    write( fut->pipeFD[1], &n, 1 );
+#endif
+    }
+
+    _releaseFuture( fut );
+}
+
+
+static void _failFuture( TaskFuture* fut, int exType, const char* msg )
+{
+    fut->exType = exType;
+    fut->data.used = 0;
+    ur_binAppendData( &fut->data, (const uint8_t*) msg, strLen(msg) + 1 );
+    _finishFuture( fut, TASK_ERROR );
+}
+
+
+/*
+  Store the exception of the current thread as the future error and clear it.
+*/
+static void _setTaskException( UThread* ut, TaskFuture* fut )
+{
+    UBuffer str;
+    UCell tmp;
+    UCell* ex = ur_exception( ut );
+    int exType = UR_ERR_SCRIPT;
+
+    ur_strInit( &str, UR_ENC_UTF8, 0 );
+    if( ur_is(ex, UT_ERROR) )
+    {
+        exType = ex->error.exType;
+        ur_initSeries( &tmp, UT_STRING, ex->error.messageStr );
+        ur_toText( ut, &tmp, &str );
+    }
+    else
+    {
+        ur_strAppendCStr( &str, "task threw " );
+        ur_toText( ut, ex, &str );
+    }
+    ur_strTermNull( &str );
+
+    ur_setId( ex, UT_UNSET );
+    ur_setId( ex + 1, UT_UNSET );
+
+    _failFuture( fut, exType, str.ptr.c );
+    ur_strFree( &str );
+}
+
+
+/*
+  Evaluate task body in a worker thread and finish the future.
+  This is re-entrant so that a worker can run other tasks inside await.
+*/
+static void _runTask( UThread* ut, TaskItem* item )
+{
+    TaskFuture* fut = item->fut;
+    UCell* cell;
+    UIndex stackUsed  = ut->stack.used;
+    UIndex framesUsed = BT->frames.used;
+    UStatus ok;
+
+    cell = ur_push( ut, UT_UNSET );     // Body block
+    ur_push( ut, UT_UNSET );            // Result
+
+    ok = ur_unserializeOpt( ut, item->code, item->code + item->len,
+                            UR_SERIAL_SHARED, cell );
+    memFree( item->code );
+    if( ok )
+    {
+        boron_bindDefault( ut, cell->series.buf );
+        ok = boron_doBlock( ut, cell, cell + 1 );
+    }
+    if( ok )
+    {
+        UIndex blkN = ur_makeBlock( ut, 1 );    // gc!
+        ur_blkPush( ur_buffer(blkN), cell + 1 );
+        ur_initSeries( cell, UT_BLOCK, blkN );
+        ok = ur_serializeOpt( ut, blkN, UR_SERIAL_SHARED, cell + 1 );
+    }
+
+    if( ok )
+    {
+        const UBuffer* bin = ur_bufferSer( cell + 1 );
+        fut->data.used = 0;
+        ur_binAppendData( &fut->data, bin->ptr.b, bin->used );
+        _finishFuture( fut, TASK_DONE );
+    }
+    else
+    {
+        _setTaskException( ut, fut );
+    }
+
+    ut->stack.used  = stackUsed;
+    BT->frames.used = framesUsed;
+}
+
+
+/*
+  Queue item on the deque of worker wi, or on the next worker in round-robin
+  order if wi is negative.
+*/
+static void _pushTask( TaskPool* pool, int wi, const TaskItem* item )
+{
+    TaskWorker* w;
+    UBuffer* dq;
+
+    mutexLock( pool->mutex );
+    if( wi < 0 )
+    {
+        wi = pool->next;
+        if( ++pool->next == pool->running )
+            pool->next = 0;
+    }
+    w = pool->workers + wi;
+
+    mutexLock( w->mutex );
+    dq = &w->deque;
+    ur_arrReserve( dq, dq->used + 1 );
+    ((TaskItem*) dq->ptr.v)[ dq->used++ ] = *item;
+    mutexUnlock( w->mutex );
+
+    ++pool->pending;
+    condSignal( pool->cond );
+    mutexUnlock( pool->mutex );
+}
+
+
+/*
+  Take the newest task from the deque of worker wi or steal the oldest one
+  from another worker.
+
+  Return non-zero if item was set.
+*/
+static int _takeTask( TaskPool* pool, int wi, TaskItem* item )
+{
+    TaskWorker* w;
+    UBuffer* dq;
+    int i;
+    int found = 0;
+
+    w = pool->workers + wi;
+    mutexLock( w->mutex );
+    dq = &w->deque;
+    if( dq->used > w->head )
+    {
+        *item = ((TaskItem*) dq->ptr.v)[ --dq->used ];
+        if( dq->used == w->head )
+            dq->used = w->head = 0;
+        found = 1;
+    }
+    mutexUnlock( w->mutex );
+
+    for( i = 1; ! found && i < pool->count; ++i )
+    {
+        w = pool->workers + ((wi + i) % pool->count);
+        mutexLock( w->mutex );
+        dq = &w->deque;
+        if( dq->used > w->head )
+        {
+            *item = ((TaskItem*) dq->ptr.v)[ w->head++ ];
+            if( dq->used == w->head )
+                dq->used = w->head = 0;
+            found = 1;
+        }
+        mutexUnlock( w->mutex );
+    }
+
+    if( found )
+    {
+        mutexLock( pool->mutex );
+        --pool->pending;
+        mutexUnlock( pool->mutex );
+    }
+    return found;
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI taskWorkerRoutine( LPVOID arg )
+#else
+static void* taskWorkerRoutine( void* arg )
+#endif
+{
+    TaskWorker* w = (TaskWorker*) arg;
+    TaskPool* pool = w->pool;
+    TaskItem item;
+    int wi = w - pool->workers;
+
+    while( 1 )
+    {
+        if( _takeTask( pool, wi, &item ) )
+        {
+            _runTask( w->ut, &item );
+            continue;
+        }
+
+        mutexLock( pool->mutex );
+        while( ! pool->quit && ! pool->pending )
+            condWaitF( pool->cond, pool->mutex );
+        mutexUnlock( pool->mutex );
+        if( pool->quit )
+            break;
+    }
+    return 0;
+}
+
+
+static int _cpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+    return si.dwNumberOfProcessors;
+#else
+    return sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+}
+
+
+static void _freeTaskPool( TaskPool* pool );
+
+static TaskPool* _makeTaskPool( UThread* ut )
+{
+    TaskPool* pool;
+    TaskWorker* w;
+    int count = _cpuCount();
+    int i;
+
+    if( count < 1 )
+        count = 1;
+    else if( count > MAX_WORKERS )
+        count = MAX_WORKERS;
+
+    pool = (TaskPool*) memAlloc( sizeof(TaskPool) +
+                                 sizeof(TaskWorker) * (count - 1) );
+    if( ! pool )
+        return NULL;
+    if( mutexInitF( pool->mutex ) )
+    {
+        memFree( pool );
+        return NULL;
+    }
+    condInit( pool->cond );
+    pool->pending = 0;
+    pool->next    = 0;
+    pool->quit    = 0;
+    pool->count   = 0;
+    pool->running = 0;
+
+    for( i = 0; i < count; ++i )
+    {
+        w = pool->workers + i;
+        if( mutexInitF( w->mutex ) )
+            break;
+        w->ut = ur_makeThread( ut );
+        if( ! w->ut )
+        {
+            mutexFree( w->mutex );
+            break;
+        }
+        ur_arrInit( &w->deque, sizeof(TaskItem), 0 );
+        w->head = 0;
+        w->pool = pool;
+        pool->count = i + 1;
+    }
+
+    // Workers can start only after count is final.  If a thread cannot be
+    // started then tasks are only queued on the running workers, though
+    // any deque can still be stolen from.
+    for( i = 0; i < pool->count; ++i )
+    {
+        w = pool->workers + i;
+#ifdef _WIN32
+        {
+        DWORD winId;
+        w->thread = CreateThread( NULL, 0, taskWorkerRoutine, w, 0, &winId );
+        if( ! w->thread )
+            break;
+        }
+#else
+        if( pthread_create( &w->thread, 0, taskWorkerRoutine, w ) )
+            break;
+#endif
+        pool->running = i + 1;
+    }
+
+    if( ! pool->running )
+    {
+        _freeTaskPool( pool );
+        return NULL;
+    }
+    return pool;
+}
+
+
+/*
+  Stop worker threads and fail any tasks which have not been started.
+*/
+static void _freeTaskPool( TaskPool* pool )
+{
+    TaskWorker* w;
+    TaskItem* it;
+    TaskItem* end;
+    int i;
+
+    mutexLock( pool->mutex );
+    pool->quit = 1;
+    condBroadcast( pool->cond );
+    mutexUnlock( pool->mutex );
+
+    for( i = 0; i < pool->running; ++i )
+    {
+        w = pool->workers + i;
+#ifdef _WIN32
+        WaitForSingleObject( w->thread, INFINITE );
+        CloseHandle( w->thread );
+#else
+        pthread_join( w->thread, NULL );
+#endif
+    }
+
+    for( i = 0; i < pool->count; ++i )
+    {
+        w = pool->workers + i;
+        it  = ((TaskItem*) w->deque.ptr.v) + w->head;
+        end = ((TaskItem*) w->deque.ptr.v) + w->deque.used;
+        for( ; it != end; ++it )
+        {
+            memFree( it->code );
+            _failFuture( it->fut, UR_ERR_SCRIPT, "Task pool shut down" );
+        }
+        ur_arrFree( &w->deque );
+        mutexFree( w->mutex );
+        ur_destroyThread( w->ut );
+    }
+
+    mutexFree( pool->mutex );
+    condFree( pool->cond );
+    memFree( pool );
+}
+
+
+void boron_freeTaskPool( UThread* ut )
+{
+    TaskPool* pool = (TaskPool*) BENV->taskPool;
+    if( pool )
+    {
+        BENV->taskPool = NULL;
+        _freeTaskPool( pool );
+    }
+}
+
+
+static TaskPool* _taskPool( UThread* ut )
+{
+    TaskPool* pool;
+    OSMutex* mh = &BENV->env.mutex;
+
+    mutexLock( *mh );
+    pool = (TaskPool*) BENV->taskPool;
+    mutexUnlock( *mh );
+
+    if( ! pool )
+    {
+        // Thread creation is done outside the global lock as ur_makeThread
+        // uses it.
+        pool = _makeTaskPool( ut );
+        if( ! pool )
+            return NULL;
+
+        mutexLock( *mh );
+        if( BENV->taskPool )
+        {
+            // Another thread made the pool first.
+            mutexUnlock( *mh );
+            _freeTaskPool( pool );
+            return (TaskPool*) BENV->taskPool;
+        }
+        BENV->taskPool = pool;
+        mutexUnlock( *mh );
+    }
+    return pool;
+}
+
+
+/*
+  Return index of the worker running in thread ut or -1 if ut is not
+  a pool thread.
+*/
+static int _workerIndex( const TaskPool* pool, const UThread* ut )
+{
+    int i;
+    for( i = 0; i < pool->count; ++i )
+    {
+        if( pool->workers[i].ut == ut )
+            return i;
+    }
+    return -1;
+}
+
+
+/*
+  Wait for future to finish and set res to the task result.
+  Pool workers run other queued tasks rather than sleep.
+*/
+static UStatus _awaitFuture( UThread* ut, TaskFuture* fut, UCell* res )
+{
+    TaskPool* pool = (TaskPool*) BENV->taskPool;
+    TaskItem item;
+    int wi = pool ? _workerIndex( pool, ut ) : -1;
+
+    mutexLock( fut->mutex );
+    while( fut->state == TASK_PENDING )
+    {
+        if( wi > -1 )
+        {
+            mutexUnlock( fut->mutex );
+            if( _takeTask( pool, wi, &item ) )
+            {
+                _runTask( ut, &item );
+                mutexLock( fut->mutex );
+                continue;
+            }
+            mutexLock( fut->mutex );
+            if( fut->state != TASK_PENDING )
+                break;
+        }
+        if( condWaitF( fut->cond, fut->mutex ) )
+        {
+            mutexUnlock( fut->mutex );
+            return ur_error( ut, UR_ERR_INTERNAL, "await condWait failed" );
+        }
+    }
+    mutexUnlock( fut->mutex );
+
+    // The future data is not modified once the task is finished.
+    if( fut->state == TASK_ERROR )
+        return ur_error( ut, fut->exType, "%s", fut->data.ptr.c );
+
+    if( ! ur_unserializeOpt( ut, fut->data.ptr.b,
+                             fut->data.ptr.b + fut->data.used,
+                             UR_SERIAL_SHARED, res ) )
+        return UR_THROW;
+    *res = *ur_bufferSer( res )->ptr.cell;
+    return UR_OK;
+}
+
+
+static int task_open( UThread* ut, const UPortDevice* pdev,
+                      const UCell* from, int opt, UCell* res )
+{
+    (void) pdev;
+    (void) from;
+    (void) opt;
+    (void) res;
+    return ur_error( ut, UR_ERR_SCRIPT, "Task ports are created by task" );
+}
+
+
+static void task_close( UBuffer* port )
+{
+    _releaseFuture( (TaskFuture*) port->ptr.v );
+}
+
+
+static int task_read( UThread* ut, UBuffer* port, UCell* dest, int part )
+{
+    (void) part;
+    return _awaitFuture( ut, (TaskFuture*) port->ptr.v, dest );
+}
+
+
+static int task_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    (void) port;
+    (void) data;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot write to task port" );
+}
+
+
+static int task_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot seek on task port" );
+}
+
+
+#ifdef _WIN32
+static int task_waitFD( UBuffer* port, void** handle )
+{
+    *handle = ((TaskFuture*) port->ptr.v)->eventH;
+    return UR_PORT_HANDLE;
+}
+#else
+static int task_waitFD( UBuffer* port )
+{
+#ifdef USE_EVENTFD
+    return ((TaskFuture*) port->ptr.v)->eventFD;
+#else
+    return ((TaskFuture*) port->ptr.v)->pipeFD[0];
+#endif
+}
+#endif
+
+
+UPortDevice port_task =
+{
+    task_open, task_close, task_read, task_write, task_seek,
+    task_waitFD, 0
+};
+
+
+/*-cf-
+    task
+        body block!
+    return: Future port!
+    group: control
+
+    Queue body to be evaluated by the task pool and return immediately.
+
+    The pool has one worker thread per processor, each with its own data
+    store.  The body is copied to the worker (as if by serialize), and the
+    result is copied back when it is read with await (or read).  Words in
+    the body not bound to the shared environment are bound to the worker
+    thread context, so use reduce or construct to pass values to the task.
+    Values made with freeze are passed by reference rather than copied.
+
+    Tasks may create further tasks.  When a worker awaits a future it runs
+    other queued tasks until the result is ready.
+
+    The future port is also readable with wait when the task is done.
+*/
+CFUNC_PUB( cfunc_task )
+{
+    TaskPool* pool;
+    TaskItem item;
+    const UBuffer* bin;
+    UIndex blkN = a1->series.buf;
+
+    pool = _taskPool( ut );
+    if( ! pool )
+        return ur_error( ut, UR_ERR_INTERNAL, "Could not create task pool" );
+
+    if( a1->series.it || a1->series.end > -1 )
+    {
+        UBlockIt bi;
+        ur_blockIt( ut, &bi, a1 );
+        blkN = ur_makeBlock( ut, bi.end - bi.it );      // gc!
+        ur_initSeries( res, UT_BLOCK, blkN );
+        ur_blockIt( ut, &bi, a1 );
+        ur_blkAppendCells( ur_buffer(blkN), bi.it, bi.end - bi.it );
+    }
+    if( ! ur_serializeOpt( ut, blkN, UR_SERIAL_SHARED, res ) )
+        return UR_THROW;
+
+    bin = ur_bufferSer( res );
+    item.len  = bin->used;
+    item.code = (uint8_t*) memAlloc( item.len );
+    item.fut  = _makeFuture();
+    if( ! item.code || ! item.fut )
+    {
+        memFree( item.code );
+        memFree( item.fut );
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for task" );
+    }
+    memCpy( item.code, bin->ptr.b, item.len );
+
+    boron_makePort( ut, &port_task, item.fut, res );
+    _pushTask( pool, _workerIndex( pool, ut ), &item );
+    return UR_OK;
+}
+
+
+/*-cf-
+    await
+        futures port!/block!
+    return: Task result or block of results.
+    group: control
+
+    Wait for tasks created with the task function to finish.
+
+    If any task threw an exception, then that error is thrown here.
+*/
+CFUNC_PUB( cfunc_await )
+{
+    if( ur_is(a1, UT_PORT) )
+    {
+        if( ! boron_waitPort( ut, a1 ) )
+            return UR_THROW;
+        {
+        PORT_SITE(dev, pbuf, a1);
+        if( dev != &port_task )
+            goto bad_port;
+        return _awaitFuture( ut, (TaskFuture*) pbuf->ptr.v, res );
+        }
+    }
+    else if( ur_is(a1, UT_BLOCK) )
+    {
+        UBlockIt bi;
+        UIndex blkN;
+        UIndex i, n;
+        UCell* cell;
+
+        ur_blockIt( ut, &bi, a1 );
+        n = bi.end - bi.it;
+        blkN = ur_makeBlock( ut, n );                   // gc!
+        ur_initSeries( res, UT_BLOCK, blkN );
+
+        for( i = 0; i < n; ++i )
+        {
+            ur_blockIt( ut, &bi, a1 );
+            if( ! ur_is(bi.it + i, UT_PORT) )
+                goto bad_port;
+            cell = ur_push( ut, UT_UNSET );
+            *cell = bi.it[ i ];
+            if( ! boron_waitPort( ut, cell ) )
+            {
+                ur_pop( ut );
+                return UR_THROW;
+            }
+            ur_pop( ut );
+            ur_blockIt( ut, &bi, a1 );
+            {
+            PORT_SITE(dev, pbuf, (bi.it + i));
+            if( dev != &port_task )
+                goto bad_port;
+            cell = ur_push( ut, UT_UNSET );
+            if( ! _awaitFuture( ut, (TaskFuture*) pbuf->ptr.v, cell ) )
+            {
+                ur_pop( ut );
+                return UR_THROW;
+            }
+            ur_blkPush( ur_buffer(blkN), cell );
+            ur_pop( ut );
+            }
+        }
+        return UR_OK;
+    }
+    return ur_error( ut, UR_ERR_TYPE, "await expected port!/block!" );
+
+bad_port:
+    return ur_error( ut, UR_ERR_TYPE, "await expected task port!" );
+}
+
+
+/*EOF*/
@@ -27,74 +27,180 @@
 #include <winsock2.h>
 #include <windows.h>
 #else
-#include <sys/select.h>
+#include <poll.h>
+#include <unistd.h>
 #include <errno.h>
+#ifdef __linux
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 #endif
 
 #include "boron.h"
+#include "os.h"
 #include "boron_internal.h"
 
 
+#ifdef CONFIG_THREAD
+extern UPortDevice port_thread;
+#endif
+extern double ur_now();
+extern UPortDevice port_file;
+extern int file_pending( const UBuffer* port );
+#if defined(CONFIG_SOCKET) && ! defined(_WIN32)
+extern UPortDevice port_socket;
+extern int socket_pending( const UBuffer* port );
+extern int socket_flush( UBuffer* port );
+#endif
+
+
+#ifdef _WIN32
 #define MAX_PORTS   16      // LIMIT: Maximum ports wait can handle.
+#else
+#define LOCAL_PORTS 16      // Ports held in WaitInfo before allocating.
+#endif
+#define READY_FD    -3      // PortInfo::fd of ports which are always ready.
+#define CO_PORT_FD  -2      // PortInfo::fd of coroutine ports.
 
 
-typedef struct
+typedef struct PortInfo PortInfo;
+
+struct PortInfo
 {
-    const UCell* cell;
+    UCell cell;
     int fd;
-}
-PortInfo;
+#ifndef _WIN32
+    PortInfo* next;             // Next waiter on the same fd.
+    struct WaitInfo* owner;     // Set while registered with the Poller.
+#endif
+};
 
 
-typedef struct
+typedef struct WaitInfo
 {
 #ifdef _WIN32
     DWORD portCount;
     DWORD timeout;
     HANDLE handles[ MAX_PORTS ];
+    PortInfo ports[ MAX_PORTS ];
 #else
-    struct timeval tv;
-    fd_set readfds;
-    int nfds;
-    uint16_t timeout;
-    uint16_t portCount;
+    double timeout;         // Seconds, or negative if there is none.
+    Coroutine* co;          // Waiting coroutine or zero for the scheduler.
+    int ready;              // Index of ready port or -1.
+    int portCount;
+    int portAvail;
+    PortInfo* ports;
+    PortInfo local[ LOCAL_PORTS ];
 #endif
-    PortInfo ports[ MAX_PORTS ];
 }
 WaitInfo;
 
 
-static void _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
+#ifndef _WIN32
+static PortInfo* _addPortInfo( WaitInfo* wi )
+{
+    if( wi->portCount == wi->portAvail )
+    {
+        int avail = wi->portAvail * 2;
+        PortInfo* mem = (PortInfo*) memAlloc( sizeof(PortInfo) * avail );
+        if( ! mem )
+            return NULL;
+        memcpy( mem, wi->ports, sizeof(PortInfo) * wi->portCount );
+        if( wi->ports != wi->local )
+            memFree( wi->ports );
+        wi->ports = mem;
+        wi->portAvail = avail;
+    }
+    return wi->ports + wi->portCount++;
+}
+#endif
+
+
+#if defined(CONFIG_SOCKET) && ! defined(_WIN32)
+/*
+  Return non-zero if the port is a socket with queued output.
+*/
+static int _outPending( UThread* ut, const UCell* portC )
+{
+    PORT_SITE(dev, pbuf, portC);
+    return (dev == &port_socket) ? socket_pending( pbuf ) : 0;
+}
+
+
+/*
+  Send the queued output of a writable socket.  Return non-zero if the port
+  is now ready (the queue is empty or an error occured).
+*/
+static int _outFlush( UThread* ut, const UCell* portC )
+{
+    PORT_SITE(dev, pbuf, portC);
+    (void) dev;
+    return socket_flush( pbuf ) <= 0;
+}
+#else
+#define _outPending(ut,portC)   0
+#define _outFlush(ut,portC)     1
+#endif
+
+
+/*
+  Return non-zero if the port is a buffered file port holding unread input.
+*/
+static int _bufferedInput( UThread* ut, const UCell* portC )
+{
+    PORT_SITE(dev, pbuf, portC);
+    return dev == &port_file && file_pending( pbuf );
+}
+
+
+static UStatus _waitOnPort( UThread* ut, WaitInfo* wi, const UCell* portC )
 {
+    PortInfo* pi;
     int fd;
     PORT_SITE(dev, pbuf, portC);
     if( dev )
     {
-        assert( wi->portCount < MAX_PORTS );
 #ifdef _WIN32
-        fd = dev->waitFD( pbuf, wi->handles + wi->portCount );
-        if( fd > -1 )
+        if( wi->portCount == MAX_PORTS )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "wait is limited to %d ports", MAX_PORTS );
+        if( dev == &port_coroutine )
+            fd = CO_PORT_FD;
+        else
         {
-            wi->ports[ wi->portCount ].cell = portC;
-            wi->ports[ wi->portCount ].fd   = fd;
-            ++wi->portCount;
+            fd = dev->waitFD( pbuf, wi->handles + wi->portCount );
+            if( fd < 0 )
+                return UR_OK;
         }
+        pi = wi->ports + wi->portCount;
+        ++wi->portCount;
 #else
-        fd = dev->waitFD( pbuf );
-        if( fd > -1 )
-        {
-            wi->ports[ wi->portCount ].cell = portC;
-            wi->ports[ wi->portCount ].fd   = fd;
-            ++wi->portCount;
+        fd = (dev == &port_coroutine) ? CO_PORT_FD : dev->waitFD( pbuf );
+        if( fd == -1 )
+            return UR_OK;
+        pi = _addPortInfo( wi );
+        if( ! pi )
+            return ur_error( ut, UR_ERR_INTERNAL, "No memory for wait" );
+        pi->owner = NULL;
+#endif
+        // Input already held in a FileBuffer is ready without polling.
+        if( _bufferedInput( ut, portC ) )
+            fd = READY_FD;
+        pi->cell = *portC;
+        pi->fd   = fd;
+    }
+    return UR_OK;
+}
 
-            FD_SET( fd, &wi->readfds );
 
-            ++fd;
-            if( fd > wi->nfds )
-                wi->nfds = fd;
-        }
+static void _setTimeout( WaitInfo* wi, double sec )
+{
+#ifdef _WIN32
+    wi->timeout = (DWORD) (sec * 1000.0);
+#else
+    wi->timeout = sec;
 #endif
-    }
 }
 
 
@@ -105,37 +211,24 @@ static int _fillWaitInfo( UThread* ut, WaitInfo* wi,
     {
         if( ur_is(it, UT_INT) )
         {
-#ifdef _WIN32
-            wi->timeout = ur_int(it) * 1000;
-#else
-            wi->tv.tv_sec  = ur_int(it);
-            wi->tv.tv_usec = 0;
-            wi->timeout = 1;
-#endif
+            _setTimeout( wi, (double) ur_int(it) );
         }
         else if( ur_is(it, UT_WORD) )
         {
             const UCell* cell;
             if( ! (cell = ur_wordCell( ut, it )) )
                 return UR_THROW;
-            if( ur_is(cell, UT_PORT) )
-                _waitOnPort( ut, wi, cell );
+            if( ur_is(cell, UT_PORT) && ! _waitOnPort( ut, wi, cell ) )
+                return UR_THROW;
         }
         else if( ur_is(it, UT_PORT) )
         {
-            _waitOnPort( ut, wi, it );
+            if( ! _waitOnPort( ut, wi, it ) )
+                return UR_THROW;
         }
         else if( ur_is(it, UT_DOUBLE) || ur_is(it, UT_TIME) )
         {
-#ifdef _WIN32
-            wi->timeout = (DWORD) (ur_double(it) * 1000.0);
-#else
-            double n = floor( ur_double(it) );
-
-            wi->tv.tv_sec  = n ? ((long) n) : 0;
-            wi->tv.tv_usec = (long) ((ur_double(it) - n) * 1000000.0);
-            wi->timeout = 1;
-#endif
+            _setTimeout( wi, ur_double(it) );
         }
 
         ++it;
@@ -144,118 +237,1700 @@ static int _fillWaitInfo( UThread* ut, WaitInfo* wi,
 }
 
 
-/*-cf-
-    wait
-        target  int!/double!/time!/block!/port!
-    return: Port ready for reading or none.
-    group: io
+static void _initWaitInfo( WaitInfo* wi )
+{
+#ifdef _WIN32
+    wi->timeout = INFINITE;
+    wi->portCount = 0;
+#else
+    wi->timeout = -1.0;
+    wi->co = NULL;
+    wi->ready = -1;
+    wi->portCount = 0;
+    wi->portAvail = LOCAL_PORTS;
+    wi->ports = wi->local;
+#endif
+}
 
-    Wait for data on ports.
-*/
-// (target -- port)
-CFUNC_PUB( cfunc_wait )
+
+static void _freeWaitInfo( WaitInfo* wi )
 {
-    WaitInfo wi;
+#ifdef _WIN32
+    (void) wi;
+#else
+    if( wi->ports != wi->local )
+        memFree( wi->ports );
+#endif
+}
 
+
+/*
+  Return timeout in seconds or a negative number if there is none.
+*/
+static double _waitSeconds( const WaitInfo* wi )
+{
 #ifdef _WIN32
-    DWORD n;
+    if( wi->timeout == INFINITE )
+        return -1.0;
+    return wi->timeout * 0.001;
+#else
+    return wi->timeout;
+#endif
+}
 
-    wi.timeout = INFINITE;
-    wi.portCount = 0;
 
-    if( ur_is(a1, UT_BLOCK) )
+static int _coroutineDone( UThread* ut, const UCell* portC )
+{
+    PORT_SITE(dev, pbuf, portC);
+    if( dev != &port_coroutine )
+        return 1;           // Port was closed.
+    return ((Coroutine*) pbuf->ptr.v)->state >= CO_DONE;
+}
+
+
+/*
+  Coroutines waiting with a timeout are kept in a binary min-heap ordered
+  by deadline, so the scheduler finds the next timeout without scanning
+  every coroutine.
+*/
+#define timerHeap(cs)   ((Coroutine**) (cs)->timers.ptr.v)
+
+static void _timerSet( Coroutine** heap, int i, Coroutine* co )
+{
+    heap[ i ] = co;
+    co->timerPos = i;
+}
+
+
+static void _timerUp( Coroutine** heap, int i )
+{
+    Coroutine* co = heap[ i ];
+    int parent;
+    while( i > 0 )
     {
-        UBlockIt bi;
-        ur_blockIt( ut, &bi, a1 );
-        if( ! _fillWaitInfo( ut, &wi, bi.it, bi.end ) )
-            return UR_THROW;
+        parent = (i - 1) / 2;
+        if( heap[ parent ]->deadline <= co->deadline )
+            break;
+        _timerSet( heap, i, heap[ parent ] );
+        i = parent;
     }
-    else
+    _timerSet( heap, i, co );
+}
+
+
+static void _timerDown( Coroutine** heap, int count, int i )
+{
+    Coroutine* co = heap[ i ];
+    int child;
+    while( (child = 2 * i + 1) < count )
     {
-        if( ! _fillWaitInfo( ut, &wi, a1, a1 + 1 ) )
-            return UR_THROW;
+        if( child + 1 < count &&
+            heap[ child + 1 ]->deadline < heap[ child ]->deadline )
+            ++child;
+        if( co->deadline <= heap[ child ]->deadline )
+            break;
+        _timerSet( heap, i, heap[ child ] );
+        i = child;
     }
+    _timerSet( heap, i, co );
+}
 
-    n = WaitForMultipleObjects( wi.portCount, wi.handles, FALSE, wi.timeout );
-    if( n == WAIT_FAILED )
+
+static void _timerAdd( CoScheduler* cs, Coroutine* co )
+{
+    UBuffer* heap = &cs->timers;
+    Coroutine** slot;
+    ur_arrExpand1( Coroutine*, heap, slot );
+    *slot = co;
+    _timerUp( timerHeap(cs), heap->used - 1 );
+}
+
+
+static void _timerRemove( CoScheduler* cs, Coroutine* co )
+{
+    Coroutine** heap = timerHeap(cs);
+    int i = co->timerPos;
+    int last = --cs->timers.used;
+
+    co->timerPos = -1;
+    if( i != last )
     {
-        return ur_error( ut, UR_ERR_INTERNAL,
-                         "WaitForMultipleObjects - %d\n", GetLastError() );
+        heap[ i ] = heap[ last ];
+        if( i > 0 && heap[ i ]->deadline < heap[ (i - 1) / 2 ]->deadline )
+            _timerUp( heap, i );
+        else
+            _timerDown( heap, last, i );
     }
-    else if( n != WAIT_TIMEOUT )
-    {
-        WSANETWORKEVENTS nev;
-        int sock;
+}
+
 
-        n -= WAIT_OBJECT_0;
-        assert( n >= 0 && n < wi.portCount );
+/*
+  Return the earliest coroutine deadline or zero if there is none.
+*/
+static double _timerDue( const CoScheduler* cs )
+{
+    return cs->timers.used ? timerHeap(cs)[0]->deadline : 0.0;
+}
 
-        // Sockets must reset the event object.
-        sock = wi.ports[ n ].fd;
-        if( sock != UR_PORT_HANDLE )
-            WSAEnumNetworkEvents( sock, wi.handles[ n ], &nev );
 
-        *res = *wi.ports[ n ].cell;
-        return UR_OK;
+static void _wakeCoroutine( UThread* ut, Coroutine* co, int portIndex )
+{
+    co->waitResult = portIndex;
+    if( co->timerPos > -1 )
+        _timerRemove( BT->sched, co );
+    boron_coReady( ut, co );
+}
+
+
+static void _timerExpire( UThread* ut, CoScheduler* cs, double now )
+{
+    while( cs->timers.used && timerHeap(cs)[0]->deadline <= now )
+        _wakeCoroutine( ut, timerHeap(cs)[0], -1 );
+}
+
+
+#define coList(cs)  ((Coroutine**) (cs)->list.ptr.v)
+
+
+#ifdef _WIN32
+/*
+  Return index of first finished coroutine port or buffered file port, or -1
+  if none are done.
+*/
+static int _portDone( UThread* ut, const WaitInfo* wi )
+{
+    DWORD i;
+    for( i = 0; i < wi->portCount; ++i )
+    {
+        if( wi->ports[ i ].fd == READY_FD ||
+            (wi->ports[ i ].fd == CO_PORT_FD &&
+             _coroutineDone( ut, &wi->ports[ i ].cell )) )
+            return i;
     }
-#else
-    int n;
+    return -1;
+}
 
-    wi.nfds = 0;
-    wi.timeout = 0;
-    wi.portCount = 0;
 
-    FD_ZERO( &wi.readfds );
-    //FD_SET( 0, &wi.readfds );    // stdin
+#define MAX_HANDLES MAXIMUM_WAIT_OBJECTS
 
-    if( ur_is(a1, UT_BLOCK) )
+typedef struct
+{
+    HANDLE handles[ MAX_HANDLES ];
+    Coroutine* owner[ MAX_HANDLES ];
+    DWORD portIndex[ MAX_HANDLES ];
+    DWORD count;
+}
+HandleSet;
+
+
+static void _addHandles( HandleSet* hs, const WaitInfo* wi, Coroutine* co )
+{
+    DWORD i;
+    for( i = 0; i < wi->portCount && hs->count < MAX_HANDLES; ++i )
     {
-        UBlockIt bi;
-        ur_blockIt( ut, &bi, a1 );
-        if( ! _fillWaitInfo( ut, &wi, bi.it, bi.end ) )
-            return UR_THROW;
+        if( wi->ports[ i ].fd == CO_PORT_FD || wi->ports[ i ].fd == READY_FD )
+            continue;
+        hs->handles[ hs->count ]   = wi->handles[ i ];
+        hs->owner[ hs->count ]     = co;
+        hs->portIndex[ hs->count ] = i;
+        ++hs->count;
     }
-    else
+}
+
+
+/*
+  Return index into HandleSet of signaled handle, -1 on timeout, or -2 if
+  an error was thrown.
+*/
+static int _waitHandles( UThread* ut, HandleSet* hs, DWORD ms )
+{
+    DWORD n = WaitForMultipleObjects( hs->count, hs->handles, FALSE, ms );
+    if( n == WAIT_FAILED )
     {
-        if( ! _fillWaitInfo( ut, &wi, a1, a1 + 1 ) )
-            return UR_THROW;
+        ur_error( ut, UR_ERR_INTERNAL,
+                  "WaitForMultipleObjects - %d\n", GetLastError() );
+        return -2;
     }
+    if( n == WAIT_TIMEOUT )
+        return -1;
+    n -= WAIT_OBJECT_0;
+    return n;
+}
 
-    n = select( wi.nfds, &wi.readfds, NULL, NULL,
-                wi.timeout ? &wi.tv : NULL );
-    if( n == -1 )
+
+/*
+  Sockets must reset the event object.
+*/
+static void _resetSocketEvent( const WaitInfo* wi, DWORD i )
+{
+    int sock = wi->ports[ i ].fd;
+    if( sock != UR_PORT_HANDLE )
     {
-        return ur_error( ut, UR_ERR_INTERNAL,
-                         "select - %s\n", strerror(errno) );
+        WSANETWORKEVENTS nev;
+        WSAEnumNetworkEvents( sock, wi->handles[ i ], &nev );
     }
-    else if( n )
+}
+
+
+/*
+  Wait for ports in the scheduler, running coroutines until a port is ready
+  or the timeout expires.  Return the ready port index, -1 on timeout, or -2
+  if an error was thrown.
+*/
+static int _waitSchedule( UThread* ut, WaitInfo* wi )
+{
+    HandleSet hs;
+    CoScheduler* cs = BT->sched;
+    Coroutine* co;
+    WaitInfo* cw;
+    double sec = _waitSeconds( wi );
+    double deadline = (sec > 0.0) ? ur_now() + sec : 0.0;
+    double due, now;
+    DWORD ms;
+    UIndex ci;
+    int ready, n;
+
+    for(;;)
     {
-        PortInfo* pi;
-        PortInfo* pend;
+        boron_coRunReady( ut );
 
-        /*
-        if( FD_ISSET( 0, &readfds ) )
-            //stdin...
-        else
-        */
+        n = _portDone( ut, wi );
+        if( n > -1 )
+            return n;
+
+        hs.count = 0;
+        _addHandles( &hs, wi, NULL );
+        due = 0.0;
+        ready = (sec == 0.0);
 
-        pi   = wi.ports;
-        pend = pi + wi.portCount;
-        while( pi != pend )
+        if( cs )
         {
-            if( FD_ISSET( pi->fd, &wi.readfds ) )
+            if( cs->ready.used )
+                ready = 1;
+            for( ci = 0; ci < cs->list.used; ++ci )
             {
-                *res = *pi->cell;
-                return UR_OK;
+                co = coList(cs)[ ci ];
+                cw = (WaitInfo*) co->wait;
+                if( co->state != CO_WAITING || ! cw )
+                    continue;
+                n = _portDone( ut, cw );
+                if( n > -1 )
+                {
+                    _wakeCoroutine( ut, co, n );
+                    ready = 1;
+                    continue;
+                }
+                _addHandles( &hs, cw, co );
             }
-            ++pi;
+            due = _timerDue( cs );
+        }
+        if( deadline > 0.0 && (due == 0.0 || deadline < due) )
+            due = deadline;
+
+        if( ready )
+            ms = 0;
+        else if( due > 0.0 )
+        {
+            now = ur_now();
+            ms = (due > now) ? (DWORD) ((due - now) * 1000.0) : 0;
+        }
+        else
+            ms = INFINITE;
+
+        if( hs.count )
+        {
+            n = _waitHandles( ut, &hs, ms );
+            if( n == -2 )
+                return -2;
         }
+        else
+        {
+            // Nothing can become ready while sleeping forever.
+            if( ms == INFINITE )
+                return -1;
+            Sleep( ms );
+            n = -1;
+        }
+
+        if( n > -1 )
+        {
+            co = hs.owner[ n ];
+            _resetSocketEvent( co ? (WaitInfo*) co->wait : wi,
+                               hs.portIndex[ n ] );
+            if( ! co )
+                return hs.portIndex[ n ];
+            _wakeCoroutine( ut, co, hs.portIndex[ n ] );
+        }
+
+        now = ur_now();
+        if( cs )
+            _timerExpire( ut, cs, now );
+        if( sec == 0.0 || (deadline > 0.0 && now >= deadline) )
+            return -1;
     }
-#endif
+}
 
-    ur_setId( res, UT_NONE );
-    return UR_OK;
+
+/*
+  Return ready port index, -1 if none are ready, or -2 if an error was
+  thrown.
+*/
+static int _pollPorts( UThread* ut, WaitInfo* wi )
+{
+    HandleSet hs;
+    int n = _portDone( ut, wi );
+    if( n > -1 )
+        return n;
+
+    hs.count = 0;
+    _addHandles( &hs, wi, NULL );
+    if( ! hs.count )
+        return -1;
+    n = _waitHandles( ut, &hs, 0 );
+    if( n < 0 )
+        return n;
+    _resetSocketEvent( wi, hs.portIndex[ n ] );
+    return hs.portIndex[ n ];
+}
+
+
+void boron_freePoller( void* poller )
+{
+    (void) poller;
+}
+
+
+void boron_waitNotify( UThread* ut, Coroutine* co )
+{
+    (void) ut;
+    (void) co;
+}
+
+
+void boron_waitDetach( UThread* ut, Coroutine* co )
+{
+    (void) ut;
+    (void) co;
+}
+
+
+#define _register(ut,wi)    UR_OK
+#define _unregister(ut,wi)
+#else
+/*
+  Convert seconds to poll() milliseconds, rounding up so that a wait does
+  not end just before its deadline.
+*/
+static int _msec( double sec )
+{
+    if( sec < 0.0 )
+        return -1;
+    return (int) ceil( sec * 1000.0 );
+}
+
+
+/*
+  Return index of first port which is known to be ready without polling
+  (finished coroutines, regular files, & file ports with buffered input),
+  or -1 if there are none.
+*/
+static int _portReady( UThread* ut, const WaitInfo* wi )
+{
+    const PortInfo* pi   = wi->ports;
+    const PortInfo* pend = pi + wi->portCount;
+    for( ; pi != pend; ++pi )
+    {
+        if( pi->fd == READY_FD ||
+            (pi->fd == CO_PORT_FD && _coroutineDone( ut, &pi->cell )) )
+            return pi - wi->ports;
+    }
+    return -1;
 }
 
 
+/*
+  Wait on the ports with poll() until one is ready or the timeout expires.
+  Return the ready port index, -1 on timeout, or -2 if an error was thrown.
+*/
+static int _pollWait( UThread* ut, WaitInfo* wi, double sec )
+{
+    struct pollfd local[ LOCAL_PORTS ];
+    struct pollfd* pfd = local;
+    double deadline = (sec > 0.0) ? ur_now() + sec : 0.0;
+    int i, n, ms;
+
+    n = _portReady( ut, wi );
+    if( n > -1 )
+        return n;
+
+    if( wi->portCount > LOCAL_PORTS )
+    {
+        pfd = (struct pollfd*) memAlloc( sizeof(struct pollfd) *
+                                         wi->portCount );
+        if( ! pfd )
+        {
+            ur_error( ut, UR_ERR_INTERNAL, "No memory for wait" );
+            return -2;
+        }
+    }
+
+    // Coroutine ports have a negative fd which poll() ignores.
+    // Sockets with queued output also wait to be writable.
+    for( i = 0; i < wi->portCount; ++i )
+    {
+        pfd[ i ].fd      = wi->ports[ i ].fd;
+        pfd[ i ].events  = POLLIN;
+        pfd[ i ].revents = 0;
+        if( pfd[ i ].fd > -1 && _outPending( ut, &wi->ports[ i ].cell ) )
+            pfd[ i ].events |= POLLOUT;
+    }
+
+    ms = _msec( sec );
+    for(;;)
+    {
+        while( (n = poll( pfd, wi->portCount, ms )) == -1 )
+        {
+            if( errno != EINTR )
+            {
+                ur_error( ut, UR_ERR_INTERNAL, "poll - %s\n",
+                          strerror(errno) );
+                n = -2;
+                goto done;
+            }
+            if( deadline > 0.0 )
+            {
+                sec = deadline - ur_now();
+                ms = (sec > 0.0) ? _msec( sec ) : 0;
+            }
+        }
+        if( n < 1 )
+            break;
+
+        for( i = 0; i < wi->portCount; ++i )
+        {
+            if( pfd[ i ].revents == POLLOUT )
+            {
+                // The port is not ready until all queued output is sent.
+                if( _outFlush( ut, &wi->ports[ i ].cell ) )
+                {
+                    n = i;
+                    goto done;
+                }
+            }
+            else if( pfd[ i ].revents )
+            {
+                n = i;
+                goto done;
+            }
+        }
+
+        if( sec == 0.0 )
+            break;
+        if( deadline > 0.0 )
+        {
+            sec = deadline - ur_now();
+            if( sec <= 0.0 )
+                break;
+            ms = _msec( sec );
+        }
+    }
+    n = -1;
+
+done:
+    if( pfd != local )
+        memFree( pfd );
+    return n;
+}
+
+
+/*
+  Return ready port index, -1 if none are ready, or -2 if an error was
+  thrown.
+*/
+static int _pollPorts( UThread* ut, WaitInfo* wi )
+{
+    return _pollWait( ut, wi, 0.0 );
+}
+
+
+/*
+  The Poller tracks which WaitInfo of the thread or its coroutines is
+  waiting on each file descriptor.  Descriptors stay registered with epoll
+  only while something waits on them, so a coroutine blocked on a port
+  costs nothing each time the scheduler polls.  Without epoll, the set of
+  descriptors is passed to poll() each time.
+*/
+typedef struct
+{
+    UBuffer waiters;        // PortInfo list head for each file descriptor.
+#ifdef USE_EPOLL
+    int fd;
+#else
+    UBuffer pfd;            // struct pollfd array used by _pollerWait().
+#endif
+}
+Poller;
+
+#define waiterList(po)  ((PortInfo**) (po)->waiters.ptr.v)
+#define MAX_EVENTS  64
+
+
+static Poller* _poller( UThread* ut )
+{
+    Poller* po = (Poller*) BT->poller;
+    if( ! po )
+    {
+        po = (Poller*) memAlloc( sizeof(Poller) );
+        if( ! po )
+            return NULL;
+#ifdef USE_EPOLL
+        po->fd = epoll_create1( EPOLL_CLOEXEC );
+        if( po->fd < 0 )
+        {
+            memFree( po );
+            return NULL;
+        }
+#else
+        ur_arrInit( &po->pfd, sizeof(struct pollfd), 0 );
+#endif
+        ur_arrInit( &po->waiters, sizeof(PortInfo*), 0 );
+        BT->poller = po;
+    }
+    return po;
+}
+
+
+/*
+  Called when the thread is freed.
+*/
+void boron_freePoller( void* poller )
+{
+    Poller* po = (Poller*) poller;
+    if( po )
+    {
+#ifdef USE_EPOLL
+        close( po->fd );
+#else
+        ur_arrFree( &po->pfd );
+#endif
+        ur_arrFree( &po->waiters );
+        memFree( po );
+    }
+}
+
+
+static PortInfo** _waiterSlot( Poller* po, int fd )
+{
+    UBuffer* buf = &po->waiters;
+    if( fd >= buf->used )
+    {
+        ur_arrReserve( buf, fd + 1 );
+        memSet( waiterList(po) + buf->used, 0,
+                sizeof(PortInfo*) * (fd + 1 - buf->used) );
+        buf->used = fd + 1;
+    }
+    return waiterList(po) + fd;
+}
+
+
+/*
+  Return non-zero if the file descriptor can be polled.
+*/
+static int _pollerAdd( Poller* po, int fd, int out )
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    ev.events = out ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    return epoll_ctl( po->fd, EPOLL_CTL_ADD, fd, &ev ) == 0 ||
+           errno == EEXIST;
+#else
+    (void) po;
+    (void) fd;
+    (void) out;
+    return 1;
+#endif
+}
+
+
+static void _pollerRemove( Poller* po, int fd )
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    // Fails harmlessly if the port was closed while waiting.
+    epoll_ctl( po->fd, EPOLL_CTL_DEL, fd, &ev );
+#else
+    (void) po;
+    (void) fd;
+#endif
+}
+
+
+/*
+  Mark a WaitInfo as ready and wake its coroutine.
+*/
+static void _notify( UThread* ut, PortInfo* pi )
+{
+    WaitInfo* wi = pi->owner;
+    if( wi->ready < 0 )
+    {
+        wi->ready = pi - wi->ports;
+        if( wi->co )
+            _wakeCoroutine( ut, wi->co, wi->ready );
+    }
+}
+
+
+/*
+  Wake the waiters on a file descriptor.  If the only event is that a
+  socket can send its queued output, they are not woken until the queue is
+  empty.
+*/
+static void _pollerNotify( UThread* ut, Poller* po, int fd, int outOnly )
+{
+    PortInfo* pi = waiterList(po)[ fd ];
+    if( outOnly && pi )
+    {
+        if( ! _outFlush( ut, &pi->cell ) )
+            return;
+#ifdef USE_EPOLL
+        {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        ev.data.fd = fd;
+        epoll_ctl( po->fd, EPOLL_CTL_MOD, fd, &ev );
+        }
+#endif
+    }
+    for( ; pi; pi = pi->next )
+        _notify( ut, pi );
+}
+
+
+/*
+  \return UR_OK/UR_THROW
+*/
+static int _pollerWait( UThread* ut, Poller* po, int ms )
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev[ MAX_EVENTS ];
+    int i, n;
+
+    n = epoll_wait( po->fd, ev, MAX_EVENTS, ms );
+    if( n == -1 )
+    {
+        if( errno == EINTR )
+            return UR_OK;
+        return ur_error( ut, UR_ERR_INTERNAL, "epoll_wait - %s\n",
+                         strerror(errno) );
+    }
+    for( i = 0; i < n; ++i )
+        _pollerNotify( ut, po, ev[ i ].data.fd, ev[ i ].events == EPOLLOUT );
+    return UR_OK;
+#else
+    PortInfo** it  = waiterList(po);
+    PortInfo** end = it + po->waiters.used;
+    UBuffer* pbuf = &po->pfd;
+    struct pollfd* pfd;
+    int fd, i, n;
+
+    po->pfd.used = 0;
+    for( fd = 0; it != end; ++it, ++fd )
+    {
+        if( *it )
+        {
+            ur_arrExpand1( struct pollfd, pbuf, pfd );
+            pfd->fd      = fd;
+            pfd->events  = _outPending( ut, &(*it)->cell ) ? POLLIN | POLLOUT
+                                                           : POLLIN;
+            pfd->revents = 0;
+        }
+    }
+
+    pfd = (struct pollfd*) po->pfd.ptr.v;
+    n = poll( pfd, po->pfd.used, ms );
+    if( n == -1 )
+    {
+        if( errno == EINTR )
+            return UR_OK;
+        return ur_error( ut, UR_ERR_INTERNAL, "poll - %s\n", strerror(errno) );
+    }
+    for( i = 0; n && i < po->pfd.used; ++i )
+    {
+        if( pfd[ i ].revents )
+        {
+            _pollerNotify( ut, po, pfd[ i ].fd, pfd[ i ].revents == POLLOUT );
+            --n;
+        }
+    }
+    return UR_OK;
+#endif
+}
+
+
+/*
+  Return the coroutine of a port, or zero if it has finished or the port
+  was closed.
+*/
+static Coroutine* _runningCoroutine( UThread* ut, const UCell* portC )
+{
+    Coroutine* co;
+    PORT_SITE(dev, pbuf, portC);
+    if( dev != &port_coroutine )
+        return NULL;
+    co = (Coroutine*) pbuf->ptr.v;
+    return (co->state < CO_DONE) ? co : NULL;
+}
+
+
+/*
+  Add the ports of a WaitInfo to the scheduler Poller, or to the joiners of
+  coroutine ports.  If a port is already ready then WaitInfo::ready is set.
+
+  \return UR_OK/UR_THROW
+*/
+static int _register( UThread* ut, WaitInfo* wi )
+{
+    Poller* po = _poller( ut );
+    Coroutine* co;
+    PortInfo* pi;
+    PortInfo* pend;
+    PortInfo** slot;
+
+    if( ! po )
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for wait" );
+
+    wi->ready = -1;
+    pi   = wi->ports;
+    pend = pi + wi->portCount;
+    for( ; pi != pend; ++pi )
+    {
+        if( pi->fd == CO_PORT_FD )
+        {
+            co = _runningCoroutine( ut, &pi->cell );
+            if( ! co )
+                goto ready;
+            slot = (PortInfo**) &co->joiners;
+        }
+        else if( pi->fd == READY_FD )
+        {
+            goto ready;
+        }
+        else
+        {
+            slot = _waiterSlot( po, pi->fd );
+            if( ! *slot &&
+                ! _pollerAdd( po, pi->fd, _outPending( ut, &pi->cell ) ) )
+            {
+                // Regular files cannot be added to epoll but never block.
+                pi->fd = READY_FD;
+                goto ready;
+            }
+        }
+        pi->owner = wi;
+        pi->next = *slot;
+        *slot = pi;
+        continue;
+
+ready:
+        if( wi->ready < 0 )
+            wi->ready = pi - wi->ports;
+    }
+    return UR_OK;
+}
+
+
+static void _unregister( UThread* ut, WaitInfo* wi )
+{
+    Poller* po = (Poller*) BT->poller;
+    PortInfo* pi   = wi->ports;
+    PortInfo* pend = pi + wi->portCount;
+    PortInfo** link;
+    int fd;
+
+    for( ; pi != pend; ++pi )
+    {
+        if( ! pi->owner )
+            continue;
+        fd = pi->fd;
+        if( fd == CO_PORT_FD )
+        {
+            // boron_waitDetach() clears the owner if the port is closed.
+            const UCell* portC = &pi->cell;
+            PORT_SITE(dev, pbuf, portC);
+            (void) dev;
+            link = (PortInfo**) &((Coroutine*) pbuf->ptr.v)->joiners;
+        }
+        else
+            link = waiterList(po) + fd;
+        while( *link != pi )
+            link = &(*link)->next;
+        *link = pi->next;
+        if( fd >= 0 && ! waiterList(po)[ fd ] )
+            _pollerRemove( po, fd );
+        pi->owner = NULL;
+    }
+}
+
+
+/*
+  Called when a coroutine finishes to wake anything waiting on its port.
+*/
+void boron_waitNotify( UThread* ut, Coroutine* co )
+{
+    PortInfo* pi = (PortInfo*) co->joiners;
+    for( ; pi; pi = pi->next )
+        _notify( ut, pi );
+}
+
+
+/*
+  Called when a coroutine port is closed.  Anything waiting on it is woken
+  and no longer refers to the coroutine.
+*/
+void boron_waitDetach( UThread* ut, Coroutine* co )
+{
+    PortInfo* pi = (PortInfo*) co->joiners;
+    for( ; pi; pi = pi->next )
+    {
+        _notify( ut, pi );
+        pi->owner = NULL;
+    }
+    co->joiners = NULL;
+}
+
+
+/*
+  Wait for ports outside of any coroutine, running coroutines (if there is
+  a scheduler) until a port is ready or the timeout expires.  Return the
+  ready port index, -1 on timeout, or -2 if an error was thrown.
+*/
+static int _waitSchedule( UThread* ut, WaitInfo* wi )
+{
+    CoScheduler* cs = BT->sched;
+    double sec = _waitSeconds( wi );
+    double deadline = (sec > 0.0) ? ur_now() + sec : 0.0;
+    double due, now;
+    int ms;
+
+    wi->co = NULL;
+    if( ! _register( ut, wi ) )
+        return -2;
+
+    for(;;)
+    {
+        if( cs )
+            boron_coRunReady( ut );
+        if( wi->ready > -1 )
+            break;
+
+        if( sec == 0.0 || (cs && cs->ready.used) )
+            ms = 0;
+        else
+        {
+            due = cs ? _timerDue( cs ) : 0.0;
+            if( deadline > 0.0 && (due == 0.0 || deadline < due) )
+                due = deadline;
+            if( due > 0.0 )
+            {
+                now = ur_now();
+                ms = (due > now) ? _msec( due - now ) : 0;
+            }
+            else
+                ms = -1;
+        }
+
+        if( ! _pollerWait( ut, (Poller*) BT->poller, ms ) )
+        {
+            wi->ready = -2;
+            break;
+        }
+
+        now = ur_now();
+        if( cs )
+            _timerExpire( ut, cs, now );
+        if( wi->ready > -1 )
+            break;
+        if( sec == 0.0 || (deadline > 0.0 && now >= deadline) )
+            break;
+    }
+
+    _unregister( ut, wi );
+    return wi->ready;
+}
+#endif
+
+
+/*
+  Suspend the current coroutine until a port is ready or the timeout
+  expires.  Return the ready port index, -1 on timeout, or -2 if an error
+  was thrown.
+*/
+static int _waitCoroutine( UThread* ut, Coroutine* co, WaitInfo* wi )
+{
+    double sec = _waitSeconds( wi );
+
+    // A zero timeout polls without giving up control.
+    if( sec == 0.0 )
+        return -1;
+
+#ifndef _WIN32
+    wi->co = co;
+#endif
+    if( ! _register( ut, wi ) )
+        return -2;
+#ifndef _WIN32
+    if( wi->ready > -1 )
+    {
+        _unregister( ut, wi );
+        return wi->ready;
+    }
+#endif
+
+    co->wait = wi;
+    co->waitResult = -1;
+    co->deadline = 0.0;
+    if( sec > 0.0 )
+    {
+        co->deadline = ur_now() + sec;
+        _timerAdd( BT->sched, co );
+    }
+    co->state = CO_WAITING;
+    boron_coSuspend( ut );
+    co->wait = NULL;
+
+    _unregister( ut, wi );
+    return co->waitResult;
+}
+
+
+/*
+  Return ready port index, -1 on timeout, or -2 if an error was thrown.
+*/
+static int _wait( UThread* ut, WaitInfo* wi )
+{
+    Coroutine* co = boron_coCurrent( ut );
+    int n;
+
+    if( co )
+    {
+        n = _pollPorts( ut, wi );
+        if( n == -1 )
+            n = _waitCoroutine( ut, co, wi );
+        return n;
+    }
+    return _waitSchedule( ut, wi );
+}
+
+
+/**
+  Wait for a port to have data ready before it is read.
+
+  This lets other coroutines run when called from a coroutine, or from
+  the scheduler while there are unfinished coroutines.  Otherwise it does
+  nothing.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus boron_waitPort( UThread* ut, const UCell* portC )
+{
+    WaitInfo wi;
+    int n;
+    PORT_SITE(dev, pbuf, portC);
+
+    if( ! dev )
+        return UR_OK;
+    if( ! boron_coCurrent( ut ) && dev != &port_coroutine &&
+        ! (BT->sched && BT->sched->list.used) )
+        return UR_OK;
+#ifdef CONFIG_THREAD
+    // The event of a thread port is cleared by the first read of a batch,
+    // so it does not show if more values are queued.
+    if( dev == &port_thread )
+        return UR_OK;
+#endif
+
+    _initWaitInfo( &wi );
+    if( ! _waitOnPort( ut, &wi, portC ) )
+        return UR_THROW;
+    n = wi.portCount ? _wait( ut, &wi ) : 0;
+    _freeWaitInfo( &wi );
+    return (n == -2) ? UR_THROW : UR_OK;
+}
+
+
+/*
+  Remove a suspended coroutine from any wait.  Called when the coroutine
+  is abandoned.
+*/
+void boron_waitCancel( UThread* ut, Coroutine* co )
+{
+    WaitInfo* wi = (WaitInfo*) co->wait;
+    if( co->timerPos > -1 )
+        _timerRemove( BT->sched, co );
+    if( wi )
+    {
+        _unregister( ut, wi );
+        _freeWaitInfo( wi );
+        co->wait = NULL;
+    }
+}
+
+
+/*-cf-
+    wait
+        target  int!/double!/time!/block!/port!
+    return: Port ready for reading or none.
+    group: io
+    see: spawn, yield
+
+    Wait for data on ports.
+
+    While waiting, any coroutines spawned by the thread are run.  If called
+    from a coroutine then other coroutines run until it is ready.
+*/
+// (target -- port)
+CFUNC_PUB( cfunc_wait )
+{
+    WaitInfo wi;
+    int n;
+
+    _initWaitInfo( &wi );
+
+    if( ur_is(a1, UT_BLOCK) )
+    {
+        UBlockIt bi;
+        ur_blockIt( ut, &bi, a1 );
+        n = _fillWaitInfo( ut, &wi, bi.it, bi.end );
+    }
+    else
+    {
+        n = _fillWaitInfo( ut, &wi, a1, a1 + 1 );
+    }
+
+    n = n ? _wait( ut, &wi ) : -2;
+    if( n > -1 )
+        *res = wi.ports[ n ].cell;
+    else
+        ur_setId( res, UT_NONE );
+    _freeWaitInfo( &wi );
+    return (n == -2) ? UR_THROW : UR_OK;
+}
+
+
+#ifdef USE_EPOLL
+/*
+  Wait-set Port
+
+  A persistent epoll set of ports.  Reading it returns a block of the
+  member ports which are ready.
+*/
+
+
+#define WS_MAX_EVENTS   256
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    UThread* ut;
+    int     fd;             // epoll descriptor.
+    int     nowait;
+    int     buffered;       // Set once a buffered file port is added.
+    UIndex  blkN;           // Member ports.
+    UIndex  hold;
+    UBuffer memberFD;       // File descriptor of each member.
+    UBuffer slot;           // Member index of each file descriptor or -1.
+}
+WaitSetExt;
+
+#define memberFD(ext)   ((int*) (ext)->memberFD.ptr.v)
+
+
+static int waitset_open( UThread* ut, const UPortDevice* pdev,
+                         const UCell* from, int opt, UCell* res )
+{
+    WaitSetExt* ext;
+    (void) from;
+
+    ext = (WaitSetExt*) memAlloc( sizeof(WaitSetExt) );
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for wait-set" );
+
+    ext->fd = epoll_create1( EPOLL_CLOEXEC );
+    if( ext->fd < 0 )
+    {
+        memFree( ext );
+        return ur_error( ut, UR_ERR_ACCESS, "epoll_create1 - %s",
+                         strerror(errno) );
+    }
+    ext->ut     = ut;
+    ext->nowait = opt & UR_PORT_NOWAIT;
+    ext->buffered = 0;
+    ext->blkN   = ur_makeBlock( ut, 0 );
+    ext->hold   = ur_hold( ext->blkN );
+    ur_arrInit( &ext->memberFD, sizeof(int), 0 );
+    ur_arrInit( &ext->slot, sizeof(int), 0 );
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void waitset_close( UBuffer* port )
+{
+    WaitSetExt* ext = ur_ptr(WaitSetExt, port);
+    UThread* ut = ext->ut;
+
+    close( ext->fd );
+    ur_release( ext->hold );
+    ur_arrFree( &ext->memberFD );
+    ur_arrFree( &ext->slot );
+    memFree( ext );
+}
+
+
+/*
+  Return member index of file descriptor or -1 if it is not in the set.
+*/
+static int _waitSetIndex( const WaitSetExt* ext, int fd )
+{
+    if( fd < ext->slot.used )
+        return ext->slot.ptr.i32[ fd ];
+    return -1;
+}
+
+
+static void _waitSetSlot( WaitSetExt* ext, int fd, int index )
+{
+    UBuffer* buf = &ext->slot;
+    if( fd >= buf->used )
+    {
+        ur_arrReserve( buf, fd + 1 );
+        memSet( buf->ptr.i32 + buf->used, 0xff,
+                sizeof(int32_t) * (fd + 1 - buf->used) );
+        buf->used = fd + 1;
+    }
+    buf->ptr.i32[ fd ] = index;
+}
+
+
+static int _waitSetAdd( UThread* ut, WaitSetExt* ext, const UCell* portC )
+{
+    struct epoll_event ev;
+    UBuffer* blk;
+    int fd, i;
+    PORT_SITE(dev, pbuf, portC);
+
+    fd = (dev && dev != &port_coroutine) ? dev->waitFD( pbuf ) : -1;
+    if( fd < 0 )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "wait-set cannot hold a closed or coroutine port" );
+
+    blk = ur_buffer( ext->blkN );
+    i = _waitSetIndex( ext, fd );
+    if( i > -1 && blk->ptr.cell[ i ].port.buf == portC->port.buf )
+        return UR_OK;
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    if( epoll_ctl( ext->fd, EPOLL_CTL_ADD, fd, &ev ) == -1 &&
+        errno != EEXIST )
+        return ur_error( ut, UR_ERR_ACCESS, "wait-set add - %s",
+                         strerror(errno) );
+
+    if( dev == &port_file && pbuf->form == UR_PORT_EXT )
+        ext->buffered = 1;
+
+    if( i > -1 )
+    {
+        // Replace member whose descriptor was closed and reused.
+        blk->ptr.cell[ i ] = *portC;
+    }
+    else
+    {
+        _waitSetSlot( ext, fd, blk->used );
+        ur_blkPush( blk, portC );
+        ur_arrAppendInt32( &ext->memberFD, fd );
+    }
+    return UR_OK;
+}
+
+
+static void _waitSetRemove( UThread* ut, WaitSetExt* ext,
+                            const UCell* portC )
+{
+    struct epoll_event ev;
+    UBuffer* blk = ur_buffer( ext->blkN );
+    UCell* cells = blk->ptr.cell;
+    int i, last, fd;
+
+    for( i = 0; i < blk->used; ++i )
+    {
+        if( cells[ i ].port.buf == portC->port.buf )
+            goto found;
+    }
+    return;
+
+found:
+    fd = memberFD(ext)[ i ];
+    epoll_ctl( ext->fd, EPOLL_CTL_DEL, fd, &ev );
+    _waitSetSlot( ext, fd, -1 );
+
+    last = --blk->used;
+    --ext->memberFD.used;
+    if( i != last )
+    {
+        cells[ i ] = cells[ last ];
+        fd = memberFD(ext)[ i ] = memberFD(ext)[ last ];
+        _waitSetSlot( ext, fd, i );
+    }
+}
+
+
+static int waitset_read( UThread* ut, UBuffer* port, UCell* dest, int part )
+{
+    struct epoll_event ev[ WS_MAX_EVENTS ];
+    WaitSetExt* ext = ur_ptr(WaitSetExt, port);
+    const UCell* members;
+    const UBuffer* mblk;
+    UBuffer* blk;
+    int i, n, m;
+    int pending = 0;
+
+    if( part < 1 || part > WS_MAX_EVENTS )
+        part = WS_MAX_EVENTS;
+
+    // Buffered file ports with input already read are ready without
+    // waiting on epoll.
+    if( ext->buffered )
+    {
+        mblk = ur_buffer( ext->blkN );
+        for( i = 0; i < mblk->used; ++i )
+        {
+            if( _bufferedInput( ut, mblk->ptr.cell + i ) )
+                ++pending;
+        }
+    }
+
+    while( (n = epoll_wait( ext->fd, ev, part,
+                            (ext->nowait || pending) ? 0 : -1 )) == -1 )
+    {
+        if( errno != EINTR )
+            return ur_error( ut, UR_ERR_ACCESS, "wait-set read - %s",
+                             strerror(errno) );
+    }
+
+    blk = ur_makeBlockCell( ut, UT_BLOCK, n + pending, dest );
+    mblk = ur_buffer( ext->blkN );
+    members = mblk->ptr.cell;
+    if( pending )
+    {
+        for( i = 0; i < mblk->used; ++i )
+        {
+            if( _bufferedInput( ut, members + i ) )
+                blk->ptr.cell[ blk->used++ ] = members[ i ];
+        }
+    }
+    for( i = 0; i < n; ++i )
+    {
+        m = _waitSetIndex( ext, ev[ i ].data.fd );
+        if( m > -1 && ! (pending && _bufferedInput( ut, members + m )) )
+            blk->ptr.cell[ blk->used++ ] = members[ m ];
+    }
+    return UR_OK;
+}
+
+
+/*
+  Write a port! to add it to the set, or a block! of ports.  The words
+  'add and 'remove in the block switch between adding and removing the
+  ports which follow.
+*/
+static int waitset_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    WaitSetExt* ext = ur_ptr(WaitSetExt, port);
+
+    if( ur_is(data, UT_PORT) )
+        return _waitSetAdd( ut, ext, data );
+
+    if( ur_is(data, UT_BLOCK) )
+    {
+        UBlockIt bi;
+        const UCell* cell;
+        const char* name;
+        int remove = 0;
+
+        ur_blockIt( ut, &bi, data );
+        ur_foreach( bi )
+        {
+            cell = bi.it;
+            if( ur_isWordType( ur_type(cell) ) )
+            {
+                name = ur_atomCStr( ut, ur_atom(cell) );
+                if( ! strcmp( name, "add" ) )
+                {
+                    remove = 0;
+                    continue;
+                }
+                if( ! strcmp( name, "remove" ) )
+                {
+                    remove = 1;
+                    continue;
+                }
+                if( ! (cell = ur_wordCell( ut, cell )) )
+                    return UR_THROW;
+            }
+            if( ! ur_is(cell, UT_PORT) )
+                return ur_error( ut, UR_ERR_TYPE,
+                                 "wait-set write expected port!" );
+            if( remove )
+                _waitSetRemove( ut, ext, cell );
+            else if( ! _waitSetAdd( ut, ext, cell ) )
+                return UR_THROW;
+        }
+        return UR_OK;
+    }
+
+    return ur_error( ut, UR_ERR_TYPE, "wait-set write expected port!/block!" );
+}
+
+
+static int waitset_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot seek on wait-set port" );
+}
+
+
+static int waitset_waitFD( UBuffer* port )
+{
+    return ur_ptr(WaitSetExt, port)->fd;
+}
+
+
+UPortDevice port_waitSet =
+{
+    waitset_open, waitset_close, waitset_read, waitset_write, waitset_seek,
+    waitset_waitFD, 0
+};
+
+/*
+  Timer Port
+
+  A set of keyed timeouts held in a min-heap ordered by deadline.  A single
+  timerfd is armed for the earliest deadline, so the port can be used with
+  wait or a wait-set and any number of pending timers costs one descriptor.
+  Reading the port returns a block of the keys which have expired.
+*/
+
+
+typedef struct
+{
+    double  due;
+    UCell   key;            // int! or unbound word!
+}
+TimerEntry;
+
+
+typedef struct
+{
+    const UPortDevice* dev;
+    int     fd;             // timerfd descriptor.
+    int     nowait;
+    UBuffer heap;           // TimerEntry min-heap.
+}
+TimerExt;
+
+#define timerEntries(ext)   ((TimerEntry*) (ext)->heap.ptr.v)
+
+
+// Deadlines use the same clock as the timerfd.
+static double _timerNow()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ((double) ts.tv_sec) + ((double) ts.tv_nsec) * 1e-9;
+}
+
+
+static int timer_open( UThread* ut, const UPortDevice* pdev,
+                       const UCell* from, int opt, UCell* res )
+{
+    TimerExt* ext;
+    (void) from;
+
+    ext = (TimerExt*) memAlloc( sizeof(TimerExt) );
+    if( ! ext )
+        return ur_error( ut, UR_ERR_INTERNAL, "No memory for timer" );
+
+    ext->fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    if( ext->fd < 0 )
+    {
+        memFree( ext );
+        return ur_error( ut, UR_ERR_ACCESS, "timerfd_create - %s",
+                         strerror(errno) );
+    }
+    ext->nowait = opt & UR_PORT_NOWAIT;
+    ur_arrInit( &ext->heap, sizeof(TimerEntry), 0 );
+
+    boron_makePort( ut, pdev, ext, res );
+    return UR_OK;
+}
+
+
+static void timer_close( UBuffer* port )
+{
+    TimerExt* ext = ur_ptr(TimerExt, port);
+    close( ext->fd );
+    ur_arrFree( &ext->heap );
+    memFree( ext );
+}
+
+
+static void _timerEntryUp( TimerEntry* heap, int i )
+{
+    TimerEntry te = heap[ i ];
+    int parent;
+    while( i > 0 )
+    {
+        parent = (i - 1) / 2;
+        if( heap[ parent ].due <= te.due )
+            break;
+        heap[ i ] = heap[ parent ];
+        i = parent;
+    }
+    heap[ i ] = te;
+}
+
+
+static void _timerEntryDown( TimerEntry* heap, int count, int i )
+{
+    TimerEntry te = heap[ i ];
+    int child;
+    while( (child = 2 * i + 1) < count )
+    {
+        if( child + 1 < count && heap[ child + 1 ].due < heap[ child ].due )
+            ++child;
+        if( te.due <= heap[ child ].due )
+            break;
+        heap[ i ] = heap[ child ];
+        i = child;
+    }
+    heap[ i ] = te;
+}
+
+
+static void _timerEntryRemove( TimerExt* ext, int i )
+{
+    TimerEntry* heap = timerEntries(ext);
+    int last = --ext->heap.used;
+    if( i != last )
+    {
+        heap[ i ] = heap[ last ];
+        if( i > 0 && heap[ i ].due < heap[ (i - 1) / 2 ].due )
+            _timerEntryUp( heap, i );
+        else
+            _timerEntryDown( heap, last, i );
+    }
+}
+
+
+/*
+  Clear any expiration count and arm the timerfd for the earliest deadline,
+  or disarm it if the heap is empty.
+*/
+static void _timerArm( TimerExt* ext )
+{
+    struct itimerspec its;
+    uint64_t count;
+    double sec;
+
+    while( read( ext->fd, &count, sizeof(count) ) == -1 && errno == EINTR )
+        ;
+
+    memset( &its, 0, sizeof(its) );
+    if( ext->heap.used )
+    {
+        sec = timerEntries(ext)[0].due - _timerNow();
+        if( sec > 0.0 )
+        {
+            its.it_value.tv_sec  = (time_t) sec;
+            its.it_value.tv_nsec = (long) ((sec - floor(sec)) * 1e9);
+        }
+        if( its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0 )
+            its.it_value.tv_nsec = 1;
+    }
+    timerfd_settime( ext->fd, 0, &its, NULL );
+}
+
+
+static int _timerKeyEqual( const UCell* a, const UCell* b )
+{
+    if( ur_is(a, UT_INT) )
+        return ur_is(b, UT_INT) && ur_int(a) == ur_int(b);
+    return ! ur_is(b, UT_INT) && ur_atom(a) == ur_atom(b);
+}
+
+
+/*
+  Add a timer for key or, if sec is negative, remove all timers with key.
+*/
+static void _timerSchedule( TimerExt* ext, const UCell* key, double sec )
+{
+    UBuffer* heap = &ext->heap;
+    TimerEntry* te;
+    int i, n;
+
+    if( sec < 0.0 )
+    {
+        // Filter in place and re-heapify once; removing entries one at a
+        // time while scanning would move unchecked ones behind the scan.
+        te = timerEntries(ext);
+        for( i = n = 0; i < heap->used; ++i )
+        {
+            if( ! _timerKeyEqual( &te[ i ].key, key ) )
+                te[ n++ ] = te[ i ];
+        }
+        if( n != heap->used )
+        {
+            heap->used = n;
+            for( i = n / 2 - 1; i >= 0; --i )
+                _timerEntryDown( te, n, i );
+        }
+        return;
+    }
+
+    ur_arrExpand1( TimerEntry, heap, te );
+    te->due = _timerNow() + sec;
+    if( ur_is(key, UT_INT) )
+        te->key = *key;
+    else
+    {
+        ur_setId( &te->key, UT_WORD );
+        ur_setWordUnbound( &te->key, ur_atom(key) );
+    }
+    _timerEntryUp( timerEntries(ext), heap->used - 1 );
+}
+
+
+static int timer_read( UThread* ut, UBuffer* port, UCell* dest, int part )
+{
+    TimerExt* ext = ur_ptr(TimerExt, port);
+    UBuffer* blk;
+    struct pollfd pfd;
+    double now;
+
+    if( part < 1 )
+        part = INT32_MAX;
+
+    pfd.fd = ext->fd;
+    pfd.events = POLLIN;
+
+    // Block until the earliest timer expires unless there are none.
+    while( ! ext->nowait && ext->heap.used &&
+           timerEntries(ext)[0].due > _timerNow() )
+    {
+        _timerArm( ext );
+        if( poll( &pfd, 1, -1 ) == -1 && errno != EINTR )
+            return ur_error( ut, UR_ERR_ACCESS, "timer read - %s",
+                             strerror(errno) );
+    }
+
+    now = _timerNow();
+    blk = ur_makeBlockCell( ut, UT_BLOCK, 0, dest );
+    while( part-- && ext->heap.used && timerEntries(ext)[0].due <= now )
+    {
+        ur_blkPush( blk, &timerEntries(ext)[0].key );
+        _timerEntryRemove( ext, 0 );
+    }
+    _timerArm( ext );
+    return UR_OK;
+}
+
+
+/*
+  Write a block of key & seconds pairs to start timers.  Each key is an
+  int! or word!.  A word in place of the seconds is looked up, and none!
+  cancels the timers with that key.  Writing none! cancels all timers.
+*/
+static int timer_write( UThread* ut, UBuffer* port, const UCell* data )
+{
+    TimerExt* ext = ur_ptr(TimerExt, port);
+
+    if( ur_is(data, UT_NONE) )
+    {
+        ext->heap.used = 0;
+    }
+    else if( ur_is(data, UT_BLOCK) )
+    {
+        UBlockIt bi;
+        const UCell* val;
+        double sec;
+
+        ur_blockIt( ut, &bi, data );
+        for( ; bi.it != bi.end; bi.it += 2 )
+        {
+            if( ! ur_is(bi.it, UT_INT) && ! ur_isWordType( ur_type(bi.it) ) )
+                return ur_error( ut, UR_ERR_TYPE,
+                                 "timer key must be int!/word!" );
+            if( bi.it + 1 == bi.end )
+                return ur_error( ut, UR_ERR_SCRIPT,
+                                 "timer key is missing seconds" );
+            val = bi.it + 1;
+            if( ur_isWordType( ur_type(val) ) )
+            {
+                if( ! (val = ur_wordCell( ut, val )) )
+                    return UR_THROW;
+            }
+            if( ur_is(val, UT_INT) )
+                sec = (double) ur_int(val);
+            else if( ur_is(val, UT_DOUBLE) || ur_is(val, UT_TIME) )
+                sec = ur_double(val);
+            else if( ur_is(val, UT_NONE) )
+                sec = -1.0;
+            else
+                return ur_error( ut, UR_ERR_TYPE,
+                        "timer seconds must be int!/double!/time!/none!" );
+            if( sec < 0.0 && ! ur_is(val, UT_NONE) )
+                sec = 0.0;
+            _timerSchedule( ext, bi.it, sec );
+        }
+    }
+    else
+        return ur_error( ut, UR_ERR_TYPE, "timer write expected block!/none!" );
+
+    _timerArm( ext );
+    return UR_OK;
+}
+
+
+static int timer_seek( UThread* ut, UBuffer* port, UCell* pos, int where )
+{
+    (void) port;
+    (void) pos;
+    (void) where;
+    return ur_error( ut, UR_ERR_SCRIPT, "Cannot seek on timer port" );
+}
+
+
+static int timer_waitFD( UBuffer* port )
+{
+    return ur_ptr(TimerExt, port)->fd;
+}
+
+
+UPortDevice port_timer =
+{
+    timer_open, timer_close, timer_read, timer_write, timer_seek,
+    timer_waitFD, 0
+};
+#endif
+
+
 /*EOF*/
@@ -84,7 +84,8 @@ enum PortOpenOptions
     UR_PORT_READ    = 0x01,
     UR_PORT_WRITE   = 0x02,
     UR_PORT_NEW     = 0x04,
-    UR_PORT_NOWAIT  = 0x08
+    UR_PORT_NOWAIT  = 0x08,
+    UR_PORT_REUSE   = 0x10      // Share listening address (SO_REUSEPORT).
 };
 
 
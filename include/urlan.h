@@ -136,6 +136,19 @@ enum UrlanErrorType
 };
 
 
+enum UrlanSerializeOption
+{
+    UR_SERIAL_SHARED = 0x01,/**< Reference shared environment buffers. */
+    UR_SERIAL_BORROW = 0x02,/**< Reference data of an image in place. */
+    UR_SERIAL_INDEX  = 0x04,/**< Append index for ur_unserializePick(). */
+    UR_SERIAL_DEDUPE = 0x08,/**< Store equal binary & string data once. */
+    UR_SERIAL_COMPRESS = 0x10,/**< Deflate large binary, string, & vector
+                                   data (if built with zlib). */
+    UR_SERIAL_PARALLEL = 0x20 /**< Encode large sub-blocks on multiple
+                                   threads (if built with threads). */
+};
+
+
 enum UrlanVectorType
 {
     UR_VEC_I16 = 66,        /* Currently the same as atoms. */
@@ -291,6 +304,9 @@ struct UBuffer
 
 /* Buffer flags */
 #define UR_STRING_ENC_UP    0x01
+#define UR_BUF_MAPPED       0x02    // Read-only file mapping (binary only).
+#define UR_BUF_BORROWED     0x04    // Data is in an image (binary, string,
+                                    // and vector only).
 
 
 typedef struct UEnv         UEnv;
@@ -497,6 +513,15 @@ typedef struct
 UEnvParameters;
 
 
+/** Output function for ur_serializeStream(). Returns UR_OK/UR_THROW. */
+typedef UStatus (*UrSerialWrite)( UThread*, void* user,
+                                  const uint8_t* data, int len );
+
+/** Input function for ur_unserializeStream().  Returns bytes read, zero
+    at end of input, or -1 if an error was thrown. */
+typedef int (*UrSerialRead)( UThread*, void* user, uint8_t* dest, int len );
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -505,6 +530,8 @@ UEnvParameters* ur_envParam( UEnvParameters* par );
 UThread* ur_makeEnv( const UEnvParameters* );
 void     ur_freeEnv( UThread* );
 void     ur_freezeEnv( UThread* );
+UStatus  ur_freeze( UThread*, UCell* cell );
+void     ur_syncShared( UThread* );
 UThread* ur_makeThread( const UThread* );
 int      ur_destroyThread( UThread* );
 int      ur_datatypeCount( UThread* );
@@ -532,9 +559,22 @@ void     ur_appendTrace( UThread*, UIndex blkN, UIndex it );
 UIndex   ur_tokenize( UThread*, const char* it, const char* end, UCell* res );
 UStatus  ur_tokenizeB( UThread*, UIndex blkN, int inputEncoding,
                        const uint8_t* start, const uint8_t* end );
+int      ur_tokenizeNext( UThread*, UIndex blkN, int inputEncoding,
+                          const uint8_t* start, const uint8_t* end, int more,
+                          const uint8_t** pos );
 UStatus  ur_serialize( UThread*, UIndex blkN, UCell* res );
+UStatus  ur_serializeOpt( UThread*, UIndex blkN, int opt, UCell* res );
 UStatus  ur_unserialize( UThread*, const uint8_t* start, const uint8_t* end,
                          UCell* res );
+UStatus  ur_unserializeOpt( UThread*, const uint8_t* start,
+                            const uint8_t* end, int opt, UCell* res );
+UStatus  ur_unserializePick( UThread*, const uint8_t* start,
+                             const uint8_t* end, int opt, UIndex index,
+                             UCell* res );
+UStatus  ur_serializeStream( UThread*, UIndex blkN, int opt,
+                             UrSerialWrite func, void* user );
+UStatus  ur_unserializeStream( UThread*, int opt, UrSerialRead func,
+                               void* user, UCell* res );
 void     ur_toStr( UThread*, const UCell* cell, UBuffer* str, int depth );
 void     ur_toText( UThread*, const UCell* cell, UBuffer* str );
 const UCell* ur_wordCell( UThread*, const UCell* cell );
@@ -578,6 +618,10 @@ void     ur_binAppendArray( UBuffer*, const USeriesIter* si );
 const char* ur_binAppendBase( UBuffer* buf, const char* it, const char* end,
                               enum UrlanBinaryEncoding enc );
 void     ur_binFree( UBuffer* );
+#ifndef _WIN32
+UStatus  ur_binMapFile( UBuffer*, int fd, int size );
+#endif
+UStatus  ur_binMakeImage( UBuffer* );
 void     ur_binSlice( UThread*, UBinaryIter*, const UCell* cell );
 UStatus  ur_binSliceM( UThread*, UBinaryIterM*, const UCell* cell );
 void     ur_binToStr( UBuffer*, int encoding );
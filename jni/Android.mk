@@ -31,7 +31,9 @@ LOCAL_SRC_FILES := urlan/hashmap.c \
     eval/boron.c \
     eval/port_file.c \
     eval/port_thread.c \
+    eval/task.c \
     eval/wait.c \
+    eval/coroutine.c \
     unix/os.c
 include $(BUILD_STATIC_LIBRARY)
 
@@ -88,7 +88,7 @@ lib-spec: [
     if thread [
         cflags {-DCONFIG_THREAD}
         linux [libs %pthread]
-        sources [%eval/port_thread.c]
+        sources [%eval/port_thread.c %eval/task.c]
     ]
     if assemble [
         cflags {-DCONFIG_ASSEMBLE}
@@ -124,6 +124,7 @@ lib-spec: [
         %eval/boron.c
         %eval/port_file.c
         %eval/wait.c
+        %eval/coroutine.c
     ]
 
     macx  [sources [%unix/os.c]]
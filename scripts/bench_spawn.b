@@ -0,0 +1,40 @@
+#!/usr/bin/boron -s
+; Spawn Benchmark v1.0
+;
+; Measures the time to run a trivial command while the interpreter holds a
+; large heap.  Launching with fork() copies the page tables of the heap so
+; its cost grows with the heap size.
+
+usage: {{
+Usage: bench_spawn.b [OPTIONS]
+
+Options:
+  -c <count>    Number of commands to run.  (default: 200)
+  -h            Print this help and quit.
+  -m <MiB>      Heap size in megabytes.  (default: 1024)
+}}
+
+count: 200
+heap-mb: 1024
+
+forall args [
+    switch first args [
+        "-c" [count: to-int second ++ args]
+        "-h" [print usage quit]
+        "-m" [heap-mb: to-int second ++ args]
+    ]
+]
+
+; Touch every page so that it is mapped.
+chunk: append/repeat make binary! 1048576 1 1048576
+heap: append/repeat make binary! mul heap-mb 1048576 chunk heap-mb
+
+bench: func [name cmd /local start] [
+    start: now
+    loop count [do cmd]
+    print [name mul 1000.0 div to-double sub now start count "ms"]
+]
+
+print ["Heap:" heap-mb "MiB," count "commands"]
+bench "execute:      " [execute "true"]
+bench "execute /out: " [execute/out "true" ""]
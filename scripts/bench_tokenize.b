@@ -0,0 +1,65 @@
+#!/usr/bin/boron -s
+; Tokenize Benchmark v1.0
+;
+; Measures the throughput of to-block (the tokenizer) in MB/s on a few
+; kinds of generated input: indented data records, long strings, long
+; comments, and the Boron scripts given on the command line.
+
+usage: {{
+Usage: bench_tokenize.b [OPTIONS] [<script> ...]
+
+Options:
+  -h            Print this help and quit.
+  -n <count>    Number of records in each generated input.  (default: 20000)
+  -r <count>    Number of times to tokenize each input.  (default: 10)
+}}
+
+count:  20000
+rounds: 10
+files:  []
+
+forall args [
+    switch first args [
+        "-h" [print usage quit]
+        "-n" [count: to-int second ++ args]
+        "-r" [rounds: to-int second ++ args]
+        [append files to-file first args]
+    ]
+]
+
+text: "The quick brown fox jumps over the lazy dog."
+
+records: make string! 0
+loop count [
+    append records rejoin [
+        "[^/    id: " random 1000000
+        " name: ^"" text {"^/    pos: 1.5,2.25,-3.0 tags: [alpha beta]^/]^/}
+    ]
+]
+
+strings: make string! 0
+loop count [
+    append strings rejoin [
+        {"} text text {" ^{} text "^^^{" text "^}^/"
+    ]
+]
+
+comments: make string! 0
+loop count [
+    append comments rejoin ["        ; " text text "^/" "/* " text " */ x^/"]
+]
+
+bench: func [name input /local start time] [
+    recycle
+    start: now
+    loop rounds [to-block input]
+    time: to-double sub now start
+    print [name div mul rounds size? input mul time 1048576.0 "MB/s"]
+]
+
+bench "records: " records
+bench "strings: " strings
+bench "comments:" comments
+foreach f files [
+    bench join f ':' read/text f
+]
@@ -0,0 +1,73 @@
+#!/usr/bin/boron -s
+; Unserialize Benchmark v1.0
+;
+; Compares the load time and memory use of unserialize, which copies every
+; binary!/string!/vector! out of the serialized data, with unserialize/borrow
+; of a memory mapped file, which references them in place.  The anonymous
+; (private) & file backed resident set sizes are read from /proc after the
+; file data has been recycled, so this only runs on Linux.
+;
+; The image is written by a separate run (-w) so that the memory used to
+; create it does not hide the growth of the load.
+
+usage: {{
+Usage: bench_unserialize.b [OPTIONS]
+
+Options:
+  -f <file>     Image file.  (default: /tmp/bench_unserialize.bin)
+  -h            Print this help and quit.
+  -l <bytes>    Length of each string.  (default: 1000)
+  -n <count>    Number of strings.  (default: 200000)
+  -w            Write the image file and quit.
+}}
+
+count: 200000
+len: 1000
+file: %/tmp/bench_unserialize.bin
+write-image: false
+
+forall args [
+    switch first args [
+        "-f" [file: to-file second ++ args]
+        "-h" [print usage quit]
+        "-l" [len: to-int second ++ args]
+        "-n" [count: to-int second ++ args]
+        "-w" [write-image: true]
+    ]
+]
+
+; Return resident set sizes [anon file] in KiB.
+rss-kb: func [/local kb] [
+    kb: copy [0 0]
+    foreach-line line %/proc/self/status [
+        if find line "RssAnon:" [poke kb 1 to-int trim skip line 8]
+        if find line "RssFile:" [poke kb 2 to-int trim skip line 8]
+    ]
+    kb
+]
+
+if write-image [
+    text: append/repeat make string! len 'x' len
+    blk: make block! count
+    loop count [append blk join text random 1000000]
+    write file serialize blk
+    quit
+]
+ifn exists? file [print usage quit/return 1]
+print ["Image:" div second info? file 1048576 "MiB"]
+
+bench: func [name load /local start time mem] [
+    recycle
+    mem: rss-kb
+    start: now
+    data: do load
+    time: mul 1000.0 to-double sub now start
+    recycle
+    mem: reduce [sub first rss-kb first mem  sub second rss-kb second mem]
+    print [name time "ms," div first mem 1024 "MiB anon,"
+           div second mem 1024 "MiB file"]
+    data: none
+]
+
+bench "unserialize/borrow:" [unserialize/borrow read/mmap file]
+bench "unserialize:       " [unserialize read file]
@@ -0,0 +1,91 @@
+#!/usr/bin/boron -s
+; Wait Benchmark v1.0
+;
+; Measures echo round trips over a few active TCP connections while many
+; other connections sit idle.  Each connection uses two descriptors, so
+; the open file limit (ulimit -n) must be over twice the idle count.
+
+usage: {{
+Usage: bench_wait.b [OPTIONS]
+
+Options:
+  -a <count>    Number of active connections.  (default: 100)
+  -h            Print this help and quit.
+  -i <count>    Number of idle connections.  (default: 10000)
+  -r <count>    Number of rounds.  (default: 100)
+}}
+
+idle:   10000
+active: 100
+rounds: 100
+port-num: 4790
+
+forall args [
+    switch first args [
+        "-a" [active: to-int second ++ args]
+        "-h" [print usage quit]
+        "-i" [idle: to-int second ++ args]
+        "-r" [rounds: to-int second ++ args]
+    ]
+]
+
+listener: open join "tcp://:" port-num
+url: join "tcp://localhost:" port-num
+
+connect: func [n /local clients servers] [
+    clients: make block! n
+    servers: make block! n
+    loop n [
+        append clients open url
+        append servers read listener
+    ]
+    reduce [clients servers]
+]
+
+set [idle-c idle-s] connect idle
+set [act-c act-s] connect active
+servers: append copy idle-s act-s
+msg: "ping"
+
+; Write to each active client, then echo on the server side until every
+; client has its reply.
+round-trip: func [serve] [
+    foreach c act-c [write c msg]
+    do serve
+    foreach c act-c [read c]
+]
+
+bench: func [name serve /local start] [
+    start: now
+    loop rounds [round-trip serve]
+    print [name sub now start]
+]
+
+print ["Connections:" idle "idle," active "active," rounds "rounds"]
+
+bench "wait block: " [
+    pending: active
+    while [gt? pending 0] [
+        p: wait servers
+        write p read p
+        -- pending
+    ]
+]
+
+ws: open "wait-set://"
+write ws servers
+bench "wait-set:   " [
+    pending: active
+    while [gt? pending 0] [
+        foreach p read ws [
+            write p read p
+            -- pending
+        ]
+    ]
+]
+close ws
+
+; Reading the clients from the main flow runs the coroutines.
+echo: func [p] [forever [write p read p]]
+foreach p act-s [spawn reduce ['echo p]]
+bench "coroutines: " []
@@ -10,3 +10,22 @@ err: ""
 execute/out/err join "../boron execute_child " cmd-args out err
 probe out
 probe err
+
+print "---- port"
+p: execute/port join "../boron execute_child " cmd-args
+out: ""
+while [d: read p] [append out to-string d]
+close p
+probe out
+
+print "---- status"
+probe execute "../boron -e quit/return(7)"
+out: ""
+err: ""
+probe execute/out/err "../boron execute_child -z" out err
+probe out
+probe err
+probe error? try [execute "no-such-program-xyz"]
+probe error? try [execute/out "no-such-program-xyz" out]
+probe error? try [execute/spawn "no-such-program-xyz"]
+probe error? try [execute/port "no-such-program-xyz"]
@@ -24,3 +24,62 @@ probe find f "file"
 probe find f %file
 probe append %my-file- 23
 probe rejoin [%file- 10 %.ext]
+
+
+print "---- walk-dir"
+make-dir/all %walk-test/a/b
+write %walk-test/one.txt "1"
+write %walk-test/a/two.txt "22"
+write %walk-test/a/b/three.txt "333"
+entries: []
+walk-dir [p type size] %walk-test [
+    append/block entries reduce [p type if eq? type 'file [size]]
+]
+probe sort/field entries [1]
+paths: []
+walk-dir/threads p %walk-test/ [append paths p] 2
+probe sort paths
+n: 0
+walk-dir p %walk-test [++ n if eq? n 2 [break]]
+probe n
+foreach p reverse paths [delete p]
+delete %walk-test
+
+
+print "---- load cache"
+setenv "BORON_CACHE" 'cache-test
+script: append/repeat copy "; Padding^/" "; Padding^/" 250
+append script "a: [1 2 three] b: 'four"
+write %cache-test.b script
+probe load %cache-test.b
+probe exists? %cache-test
+probe do load %cache-test.b
+probe b
+write %cache-test.b replace script "three" "3"
+probe load %cache-test.b
+write %cache-test.b replace script "3" "9"
+probe load %cache-test.b
+foreach f read %cache-test [delete join %cache-test/ f]
+delete %cache-test
+delete %cache-test.b
+setenv "BORON_CACHE" 0
+
+
+print "---- load next"
+big: make string! 80000
+loop 8000 [append big "item 1.5,2 "]
+write %next-test.txt rejoin [
+    "; comment^/a: 1 [b {c}] 'd^/" "[" big "] %e 16#{0F} i16#[1 2] end"
+]
+p: open %next-test.txt
+buf: make binary! 0
+while [v: load/next p buf] [
+    print [type? v either series? v [size? v] [mold v]]
+]
+probe load/next p buf
+close p
+write %next-test.txt "second [port] 2"
+p: open %next-test.txt
+while [v: load/next p buf] [probe v]
+close p
+delete %next-test.txt
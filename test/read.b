@@ -15,3 +15,55 @@ while [read/part/into fp 20 str] [
 ]
 probe len
 close fp
+
+print "---- mmap"
+m: read/mmap f
+probe eq? m read f
+probe to-string read/mmap/part f 17
+probe try [append m "x"]
+probe append copy slice m 4 "!"
+probe parse m [thru "contains " a: to ' ' b:]
+probe to-string slice a b
+probe try [parse m [to "104" a: (change a "999")]]
+free m
+probe m
+
+print "---- foreach-line"
+foreach-line line f [probe line]
+fp: open f
+n: 0
+foreach-line line fp [++ n if find line "Vidit" [break]]
+probe n
+close fp
+
+print "---- buffered port"
+bf: %buffered.tmp
+p: open/new/buffer bf 512
+loop 3 [write p "abc"]
+probe read bf
+skip p 0
+probe read bf
+write p "end"
+close p
+p: open/buffer bf 512
+probe to-string read/part p 4
+write p "XY"
+probe to-string read p
+close p
+probe read/text bf
+delete bf
+
+print "---- wait on buffered port"
+execute "mkfifo fifo.tmp"
+p: open/buffer %fifo.tmp 512
+write p "abcdef"
+probe to-string read/part p 2
+probe same? p wait [p 0.2]
+ws: open "wait-set://"
+write ws p
+probe same? p first read ws
+probe to-string read/part p 4
+probe wait [p 0.05]
+close ws
+close p
+delete %fifo.tmp
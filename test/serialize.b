@@ -40,3 +40,102 @@ if eq? input-str out-str [
 
 ;print size? compress bin
 ;print size? compress out-str
+
+
+print "---- borrow"
+bin: serialize [#{DEADBEEF} "text" %file "wide^(2126)" #[1 2 3]]
+out: unserialize/borrow bin
+probe out
+append second out "-copy"
+poke first out 1 0
+probe out
+probe eq? mold unserialize bin mold unserialize/borrow bin
+bin: none
+recycle
+probe out
+
+
+print "---- pick"
+blk: reduce [1 "two" [3 four] context [a: 1 b: "hi"] make hash-map! [k "v"]]
+loop 150 [append blk join "s" size? blk]
+bin: serialize/index blk
+probe eq? mold unserialize bin mold unserialize serialize blk
+foreach i [1 2 3 5 70 155] [probe unserialize/pick bin i]
+probe in unserialize/pick bin 4 'b
+probe unserialize/pick bin 156
+probe unserialize/pick serialize blk 100
+probe unserialize/pick/borrow bin 100
+
+
+print "---- dedupe"
+blk: []
+loop 50 [append blk reduce [
+    copy "/usr/local/share" copy #{0102030405060708} copy "short"]]
+append blk [%/usr/local/share "wide^(2126) string" "wide^(2126) string"]
+bin: serialize/dedupe blk
+probe lt? size? bin div size? serialize blk 2
+probe eq? mold blk mold unserialize bin
+out: unserialize/borrow bin
+append first out "/bin"
+probe first out
+probe pick out 4
+probe last out
+probe unserialize/pick serialize/index/dedupe blk 152
+files: reduce [to-file "/usr/local/share" "/usr/local/share"]
+append files reduce [to-file "/usr/local/share" "/usr/local/share"]
+probe lt? size? serialize/dedupe files size? serialize files
+probe unserialize serialize/dedupe files
+probe unserialize/borrow serialize/dedupe files
+bin: none
+recycle
+probe first out
+probe pick out 4
+
+print "---- compress"
+big: append/repeat make string! 40000 "line of text " 3000
+blk: reduce [big "short" to-binary big append/repeat copy #[1] 2 4000
+             join "wide^(2126) " big]
+bin: serialize/compress blk
+probe to-string slice bin 4
+probe lt? size? bin div size? serialize blk 20
+probe eq? mold blk mold unserialize bin
+probe eq? mold blk mold unserialize/borrow bin
+probe eq? big unserialize/pick serialize/index/compress blk 1
+
+print "---- vector forms"
+blk: reduce [i16#[1 -2 300] u32#[7 65536] f64#[1.5 -2.0 1e+100] "wide^(2126)"]
+probe bin: serialize blk
+probe unserialize bin
+
+print "---- parallel"
+blk: reduce ['shards "end"]
+foreach n [1 2 3] [
+    shard: make block! 900
+    loop 300 [append shard reduce [n join "s" n context [id: n]]]
+    append blk reduce [shard]
+]
+bin: serialize/parallel blk
+out: unserialize bin
+probe eq? mold blk mold out
+probe slice third out 3
+append second pick out 3 "!"
+probe second pick out 4
+append pick blk 4 second third blk     ; Shared string.
+probe eq? serialize/parallel blk serialize blk
+
+print "---- stream"
+big: append/repeat make string! 70000 'x' 70000
+blk: reduce [1 "two" [3 four] context [a: 1 b: "hi"] big #[1 2 3]]
+file: %/tmp/boron-serialize.bos
+write/serialized file blk
+write/serialized/append file [second [block]]
+out: read/serialized file
+probe eq? mold blk mold out
+probe in pick out 4 'b
+probe size? pick out 5
+p: open file
+probe eq? mold blk mold read/serialized p
+probe read/serialized p
+probe read/serialized p
+close p
+delete file
@@ -0,0 +1,75 @@
+print "---- tcp transfer"
+f: %data-104
+l: open "tcp://:39302"
+c: open "tcp://localhost:39302"
+k: read wait l
+probe transfer c f
+probe transfer/part/offset c f 4 5
+fp: open f
+read/part fp 10
+probe transfer/part c fp 8
+probe transfer/part/offset c fp 4 0
+probe to-string read/part fp 4
+close fp
+close c
+got: make binary! 128
+while [read/append k got] []
+probe size? got
+probe eq? slice got 104 read f
+probe to-string skip got 104
+close k
+close l
+
+print "---- tcp queue"
+l: open "tcp://:39304"
+c: open/nowait "tcp://localhost:39304"
+k: read wait l
+big: append/repeat make binary! 20000000 #{5A} 20000000
+write c big
+probe gt? pending? c 0
+got: 0
+while [gt? pending? c 0] [
+    if same? k wait [c k 2.0] [got: add got size? read k]
+]
+probe pending? c
+close c
+while [data: read k] [got: add got size? data]
+probe got
+close k
+close l
+
+print "---- udp batch"
+u: open "udp://:39301"
+s: open "udp://127.0.0.1:39301"
+dg: []
+loop 20 [append dg reduce ["ping" none]]
+append dg reduce [append/repeat make binary! 60000 #{AB} 60000 none]
+write s dg
+buf: make block! 64
+probe size? read/into u buf
+probe to-string first buf
+probe string? second buf
+probe size? read/part/into u 3 buf
+probe size? read/part/into u 10 buf
+probe size? last-dg: pick buf 3
+probe eq? last-dg append/repeat make binary! 60000 #{AB} 60000
+write s reduce [#{01} none #{0203} none]
+foreach [data from] read/into u buf [probe data]
+close s
+close u
+
+print "---- reuse & accept batch"
+l: open/reuse "tcp://:39303"
+l2: open/reuse "tcp://:39303"
+probe port? l2
+close l2
+cons: []
+loop 3 [append cons open "tcp://localhost:39303"]
+sleep 0.1
+acc: make block! 8
+probe size? read/into l acc
+probe port? first acc
+foreach k acc [close k]
+foreach c cons [close c]
+probe error? try [open "tcp://:39303"]
+close l
@@ -170,3 +170,16 @@ probe {{{
             Text
         }}
     }}}
+
+
+print "---- long tokens"
+alpha: "0123456789abcdefghijklmnopqrstuvwxyz"
+probe to-block rejoin [{"} alpha {" "0123456789abcdef^^"} alpha {"}]
+probe to-block rejoin ["{" alpha " {" alpha "} 0^^} end}"]
+b: to-block rejoin [{"Copyright © 1930 } alpha {"}]
+print [encoding? first b  size? first b]
+probe to-block {a                    b  ^-^-       ^/              c}
+probe to-block rejoin ["a /* " alpha "*/ b /* " alpha " */ c"]
+probe to-block rejoin ["a ; " alpha "^/b ; trailing comment"]
+probe try [to-block rejoin [{"} alpha {^/"}]]
+probe try [to-block rejoin ["{" alpha " {}"]]
@@ -35,3 +35,138 @@ tp: thread/port {{
 send "apple"
 send "ball"
 close tp
+
+
+print "---- task"
+probe await task [add 1 2]
+n: 5
+probe await task reduce ['mul n 6]
+probe await reduce [task [join "a" "b"] task [[1 2 3]]]
+probe await task [
+    a: task [add 1 2]
+    b: task [mul 3 4]
+    add await a await b
+]
+probe try [await task [error "boom"]]
+f: task [sleep 0.05 'done]
+probe same? f wait f
+probe read f
+
+
+print "---- freeze"
+blk: [a "str" [1 2] ctx: context [z: 4]]
+shared: freeze blk
+probe shared
+probe blk
+c: freeze context [v: 7 double: func [n] [mul v n]]
+probe try [set in c 'v 3]
+probe await task reduce [in c 'double 5]
+probe await task reduce ['third shared]
+tp: thread/port [
+    val: read thread-port
+    prin "thread: " probe val
+    write thread-port 'done
+]
+write tp shared
+probe read tp
+c: context [z: 4]
+b: bind [z] c
+freeze c
+probe do b
+
+
+print "---- coroutine"
+a: spawn [print "a1" yield print "a2" yield print "a3" 'resultA]
+b: spawn [print "b1" yield print "b2" 10]
+print "main"
+probe read a
+probe read b
+probe try [read spawn [error "oops"]]
+d: spawn [wait 0.2 print "d woke" 4]
+e: spawn [wait 0.1 print "e woke" 5]
+probe read d
+probe read e
+probe read spawn [x: spawn [wait 0.05 7] add 1 read x]
+cs: []
+loop 200 [append cs spawn [yield yield 1]]
+n: 0 foreach c cs [n: add n read c]
+probe n
+
+
+print "---- wait-set"
+echo: [while [word? v: read thread-port] [write thread-port v]]
+tps: []
+loop 20 [append tps thread/port echo]
+t2: second tps
+write last tps 'last
+probe same? last tps wait tps
+probe read last tps
+ws: open "wait-set://"
+write ws tps
+probe read open/nowait "wait-set://"
+write t2 'two
+probe same? t2 first read ws
+probe read t2
+write ws [remove t2]
+write t2 'again
+probe wait [ws 0.1]
+probe read t2
+co: spawn [p: first read ws reduce [same? p first tps read p]]
+write first tps 'first
+probe read co
+close ws
+foreach t tps [write t 0 close t]
+
+
+print "---- timer"
+t: open "timer://"
+probe read t
+write t [c 0.4 a 0.05 b 0.3 7 0.2]
+probe read t
+probe wait [t 1.0]
+probe read t
+write t [b none]
+probe read t
+write t [x 0.02 y 0.5]
+probe read/part t 1
+write t none
+write t [r 0.01 a 0.05 z 0.02 q 0.06 a 0.07 s 0.03 u 0.035]
+write t [a none]
+keys: copy []
+while [not empty? k: read t] [append keys k]
+probe keys
+probe read open/nowait "timer://"
+ws: open "wait-set://"
+write ws t
+write t [beat 0.02]
+probe same? t first read ws
+probe read t
+close ws
+close t
+probe read spawn [x: spawn [wait 0.1 'late] wait [x 0.02]]
+
+
+print "---- udp batch per thread"
+tp: thread/port [
+    u: open "udp://:39311"
+    write thread-port 'ready
+    buf: make block! 32
+    got: make block! 10
+    while [lt? size? got 10] [
+        foreach [data from] read/into u buf [append got to-string data]
+    ]
+    write thread-port mold got
+]
+probe read tp
+u: open "udp://:39312"
+s: open "udp://127.0.0.1:39311"
+dg: []
+i: 0 loop 10 [append dg reduce [join "t" ++ i none]]
+write s dg
+close s
+s: open "udp://127.0.0.1:39312"
+write s reduce [#{6D61696E} none]
+close s
+probe to-string first read/into u make block! 8
+probe read tp
+close u
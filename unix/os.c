@@ -31,6 +31,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
 #include <time.h>
 #include "env.h"
 #include "os_file.h"
@@ -228,6 +230,503 @@ int ur_readDir( UThread* ut, const char* filename, UCell* res )
 }
 
 
+/*
+  Recursive directory walk.
+
+  Directories are opened with openat() relative to the root descriptor and
+  entry types come from the d_type of readdir() (which reads with
+  getdents64 on Linux).  An fstatat() is only done when the size or time
+  is wanted or the filesystem does not report the type.
+
+  Entries are packed into batches of about WALK_BATCH_SIZE bytes.  With
+  threads, each worker reads whole directories and queues the batches for
+  the caller; at most WALK_QUEUE_MAX batches are held before the workers
+  wait.
+*/
+
+#define WALK_BATCH_SIZE 0x10000
+#define WALK_QUEUE_MAX  32
+#define WALK_THREAD_MAX 64
+
+typedef struct WalkDir
+{
+    struct WalkDir* next;
+    int len;
+    char path[1];               // Relative to root ("" for root itself).
+}
+WalkDir;
+
+typedef struct
+{
+    int64_t  size;
+    double   modified;
+    uint32_t len;
+    uint8_t  type;
+    char     path[1];
+}
+WalkEntry;
+
+#define WE_HDR          offsetof(WalkEntry, path)
+#define WE_STRIDE(n)    ((WE_HDR + (n) + 1 + 7) & ~7)
+
+typedef struct WalkBatch
+{
+    struct WalkBatch* next;
+    uint32_t used;
+    uint32_t avail;
+    WalkEntry ent[1];
+}
+WalkBatch;
+
+struct OSWalk
+{
+    WalkDir* dirs;              // Directories waiting to be read.
+    WalkBatch* batch;           // Batch being returned to the caller.
+    uint32_t pos;
+    int rootFD;
+    int mask;
+    int prefixLen;
+    char* prefix;               // Root path with trailing slash.
+
+    // Single thread state.
+    DIR* dir;
+    WalkDir* cur;
+
+#ifdef CONFIG_THREAD
+    // Thread state (guarded by mutex).
+    OSMutex mutex;
+    OSCond cond;
+    WalkBatch* results;
+    WalkBatch* resultsTail;
+    int queued;
+    int busy;
+    int cancel;
+    int threadCount;
+    OSThread thread[1];
+#endif
+};
+
+
+static WalkDir* _walkDirNew( const char* parent, int plen, const char* name )
+{
+    int nlen = strlen( name );
+    int len = plen ? plen + 1 + nlen : nlen;
+    WalkDir* wd = (WalkDir*) memAlloc( sizeof(WalkDir) + len );
+    char* cp = wd->path;
+    if( plen )
+    {
+        memCpy( cp, parent, plen );
+        cp += plen;
+        *cp++ = '/';
+    }
+    memCpy( cp, name, nlen + 1 );
+    wd->next = NULL;
+    wd->len = len;
+    return wd;
+}
+
+
+static WalkBatch* _walkBatchNew( uint32_t avail )
+{
+    WalkBatch* batch = (WalkBatch*) memAlloc( sizeof(WalkBatch) + avail );
+    batch->next  = NULL;
+    batch->used  = 0;
+    batch->avail = avail;
+    return batch;
+}
+
+
+static DIR* _walkOpenDir( OSWalk* wk, const WalkDir* wd )
+{
+    DIR* dir;
+    int fd = openat( wk->rootFD, wd->len ? wd->path : ".",
+                     O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    if( fd < 0 )
+        return NULL;
+    dir = fdopendir( fd );
+    if( ! dir )
+        close( fd );
+    return dir;
+}
+
+
+static int _statType( mode_t mode )
+{
+    if( S_ISREG(mode) )
+        return FI_File;
+    if( S_ISDIR(mode) )
+        return FI_Dir;
+    if( S_ISLNK(mode) )
+        return FI_Link;
+#ifdef S_ISSOCK
+    if( S_ISSOCK(mode) )
+        return FI_Socket;
+#endif
+    return FI_OtherType;
+}
+
+
+/*
+  Read entries from dir into batch until it is full.  Sub-directories are
+  pushed onto the subdirs list.
+
+  Return non-zero when the directory is finished.
+*/
+static int _walkFill( OSWalk* wk, DIR* dir, const WalkDir* wd,
+                      WalkBatch** bp, WalkDir** subdirs )
+{
+    struct dirent* de;
+    struct stat st;
+    WalkBatch* batch = *bp;
+    WalkEntry* ent;
+    const char* name;
+    char* cp;
+    uint32_t need;
+    int nlen, type;
+    int statAll = wk->mask & (FI_Size | FI_Time);
+
+    while( 1 )
+    {
+        // Make sure the longest possible entry fits before reading.
+        need = WE_STRIDE( wk->prefixLen + wd->len + 1 + 256 );
+        if( batch->avail - batch->used < need )
+        {
+            if( batch->used )
+                return 0;
+            memFree( batch );
+            *bp = batch = _walkBatchNew( need );
+        }
+
+        if( ! (de = readdir( dir )) )
+            return 1;
+        name = de->d_name;
+        if( name[0] == '.' && (name[1] == '\0' ||
+                              (name[1] == '.' && name[2] == '\0')) )
+            continue;
+
+        ent = (WalkEntry*) (((char*) batch->ent) + batch->used);
+        ent->size = 0;
+        ent->modified = 0.0;
+
+        switch( statAll ? DT_UNKNOWN : de->d_type )
+        {
+            case DT_REG:  type = FI_File;      break;
+            case DT_DIR:  type = FI_Dir;       break;
+            case DT_LNK:  type = FI_Link;      break;
+#ifdef DT_SOCK
+            case DT_SOCK: type = FI_Socket;    break;
+#endif
+            case DT_UNKNOWN:
+                if( fstatat( dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW ) )
+                    continue;       // Entry has been removed.
+                type = _statType( st.st_mode );
+                ent->size = st.st_size;
+                ent->modified = (double) st.st_mtime;
+                break;
+            default:      type = FI_OtherType; break;
+        }
+        if( type == FI_Dir )
+        {
+            WalkDir* sub = _walkDirNew( wd->path, wd->len, name );
+            sub->next = *subdirs;
+            *subdirs = sub;
+        }
+
+        nlen = strlen( name );
+        cp = ent->path;
+        memCpy( cp, wk->prefix, wk->prefixLen );
+        cp += wk->prefixLen;
+        if( wd->len )
+        {
+            memCpy( cp, wd->path, wd->len );
+            cp += wd->len;
+            *cp++ = '/';
+        }
+        memCpy( cp, name, nlen + 1 );
+
+        ent->len  = (cp + nlen) - ent->path;
+        ent->type = type;
+        batch->used += WE_STRIDE( ent->len );
+    }
+}
+
+
+static void _walkFreeDirs( WalkDir* it )
+{
+    WalkDir* next;
+    for( ; it; it = next )
+    {
+        next = it->next;
+        memFree( it );
+    }
+}
+
+
+#ifdef CONFIG_THREAD
+static void _walkFreeBatches( WalkBatch* it )
+{
+    WalkBatch* next;
+    for( ; it; it = next )
+    {
+        next = it->next;
+        memFree( it );
+    }
+}
+
+
+static void* _walkThread( void* arg )
+{
+    OSWalk* wk = (OSWalk*) arg;
+    WalkDir* wd;
+    WalkDir* subdirs;
+    WalkBatch* batch;
+    DIR* dir;
+    int done;
+
+    mutexLock( wk->mutex );
+    while( 1 )
+    {
+        while( ! wk->dirs && wk->busy && ! wk->cancel )
+            condWaitF( wk->cond, wk->mutex );
+        if( wk->cancel || ! wk->dirs )
+            break;                  // No directories left & no busy workers.
+        wd = wk->dirs;
+        wk->dirs = wd->next;
+        ++wk->busy;
+        mutexUnlock( wk->mutex );
+
+        dir = _walkOpenDir( wk, wd );
+        done = dir ? 0 : 1;
+        while( ! done )
+        {
+            batch = _walkBatchNew( WALK_BATCH_SIZE );
+            subdirs = NULL;
+            done = _walkFill( wk, dir, wd, &batch, &subdirs );
+
+            mutexLock( wk->mutex );
+            if( subdirs )
+            {
+                WalkDir* last = subdirs;
+                while( last->next )
+                    last = last->next;
+                last->next = wk->dirs;
+                wk->dirs = subdirs;
+            }
+            if( batch->used )
+            {
+                if( wk->resultsTail )
+                    wk->resultsTail->next = batch;
+                else
+                    wk->results = batch;
+                wk->resultsTail = batch;
+                ++wk->queued;
+            }
+            else
+                memFree( batch );
+            condBroadcast( wk->cond );
+            while( wk->queued >= WALK_QUEUE_MAX && ! wk->cancel )
+                condWaitF( wk->cond, wk->mutex );
+            if( wk->cancel )
+                done = 1;
+            mutexUnlock( wk->mutex );
+        }
+        if( dir )
+            closedir( dir );
+        memFree( wd );
+
+        mutexLock( wk->mutex );
+        --wk->busy;
+        condBroadcast( wk->cond );
+    }
+    mutexUnlock( wk->mutex );
+    return NULL;
+}
+#endif
+
+
+/*
+  Begin walking all the files and directories below root.
+  Set threads to greater than one to read directories in parallel; the order
+  of the entries is then not fixed.
+
+  Return walk pointer or NULL if root cannot be opened.
+*/
+OSWalk* ur_walkOpen( const char* root, int mask, int threads )
+{
+    OSWalk* wk;
+    int fd;
+    int len = strlen( root );
+
+    fd = open( root, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if( fd < 0 )
+        return NULL;
+
+#ifdef CONFIG_THREAD
+    if( threads > WALK_THREAD_MAX )
+        threads = WALK_THREAD_MAX;
+    if( threads < 2 )
+        threads = 0;
+    wk = (OSWalk*) memAlloc( sizeof(OSWalk) + len + 2 +
+                             sizeof(OSThread) * threads );
+    memSet( wk, 0, sizeof(OSWalk) );
+    wk->prefix = (char*) (wk->thread + threads);
+#else
+    (void) threads;
+    wk = (OSWalk*) memAlloc( sizeof(OSWalk) + len + 2 );
+    memSet( wk, 0, sizeof(OSWalk) );
+    wk->prefix = (char*) (wk + 1);
+#endif
+
+    wk->rootFD = fd;
+    wk->mask = mask;
+    memCpy( wk->prefix, root, len );
+    if( len && root[len - 1] != '/' )
+        wk->prefix[ len++ ] = '/';
+    wk->prefix[ len ] = '\0';
+    wk->prefixLen = len;
+    wk->dirs = _walkDirNew( NULL, 0, "" );
+
+#ifdef CONFIG_THREAD
+    if( threads && ! mutexInitF( wk->mutex ) )
+    {
+        int i;
+        condInit( wk->cond );
+        for( i = 0; i < threads; ++i )
+        {
+            if( pthread_create( wk->thread + i, NULL, _walkThread, wk ) )
+                break;
+            ++wk->threadCount;
+        }
+        if( ! wk->threadCount )
+        {
+            mutexFree( wk->mutex );
+            condFree( wk->cond );
+        }
+    }
+#endif
+    return wk;
+}
+
+
+static WalkBatch* _walkNextBatch( OSWalk* wk )
+{
+    WalkBatch* batch = wk->batch;
+
+#ifdef CONFIG_THREAD
+    if( wk->threadCount )
+    {
+        memFree( batch );
+        mutexLock( wk->mutex );
+        while( ! wk->results && (wk->dirs || wk->busy) )
+            condWaitF( wk->cond, wk->mutex );
+        batch = wk->results;
+        if( batch )
+        {
+            wk->results = batch->next;
+            if( ! wk->results )
+                wk->resultsTail = NULL;
+            --wk->queued;
+            condBroadcast( wk->cond );
+        }
+        mutexUnlock( wk->mutex );
+        return batch;
+    }
+#endif
+
+    if( ! batch )
+        batch = _walkBatchNew( WALK_BATCH_SIZE );
+    batch->used = 0;
+    while( 1 )
+    {
+        while( ! wk->dir )
+        {
+            if( ! wk->dirs )
+            {
+                memFree( batch );
+                return NULL;
+            }
+            wk->cur = wk->dirs;
+            wk->dirs = wk->cur->next;
+            if( ! (wk->dir = _walkOpenDir( wk, wk->cur )) )
+            {
+                memFree( wk->cur );
+                wk->cur = NULL;
+            }
+        }
+
+        if( _walkFill( wk, wk->dir, wk->cur, &batch, &wk->dirs ) )
+        {
+            closedir( wk->dir );
+            wk->dir = NULL;
+            memFree( wk->cur );
+            wk->cur = NULL;
+        }
+        if( batch->used )
+            return batch;
+    }
+}
+
+
+/*
+  Get the next entry of a walk.  The info type is always set, and the
+  size & modified members are set if requested by the ur_walkOpen mask.
+
+  Return path or NULL when the walk is done.  The path is only valid until
+  the next call.
+*/
+const char* ur_walkNext( OSWalk* wk, OSFileInfo* info, int* pathLen )
+{
+    WalkEntry* ent;
+
+    if( ! wk->batch || wk->pos >= wk->batch->used )
+    {
+        wk->batch = _walkNextBatch( wk );
+        wk->pos = 0;
+        if( ! wk->batch )
+            return NULL;
+    }
+
+    ent = (WalkEntry*) (((char*) wk->batch->ent) + wk->pos);
+    wk->pos += WE_STRIDE( ent->len );
+
+    info->size     = ent->size;
+    info->modified = ent->modified;
+    info->type     = ent->type;
+    *pathLen = ent->len;
+    return ent->path;
+}
+
+
+/*
+  Stop any walk threads & free all walk memory.
+*/
+void ur_walkClose( OSWalk* wk )
+{
+#ifdef CONFIG_THREAD
+    if( wk->threadCount )
+    {
+        int i;
+        mutexLock( wk->mutex );
+        wk->cancel = 1;
+        condBroadcast( wk->cond );
+        mutexUnlock( wk->mutex );
+        for( i = 0; i < wk->threadCount; ++i )
+            pthread_join( wk->thread[i], NULL );
+        mutexFree( wk->mutex );
+        condFree( wk->cond );
+        _walkFreeBatches( wk->results );
+    }
+#endif
+    if( wk->dir )
+        closedir( wk->dir );
+    memFree( wk->cur );
+    memFree( wk->batch );
+    _walkFreeDirs( wk->dirs );
+    close( wk->rootFD );
+    memFree( wk );
+}
+
+
 #ifdef CONFIG_EXECUTE
 // Remove backslashes from last string in argv.
 static void compactLitQuotes( UBuffer* argv, const char* argEnd )
@@ -309,7 +808,7 @@ static void argumentList( char* cp, UBuffer* argv )
 
 static int _readIntoBuf( int fd, UBuffer* buf )
 {
-#define BUFSIZE 1024
+#define BUFSIZE 0x10000
     int n;
 
     if( buf->type == UT_STRING )
@@ -370,21 +869,46 @@ static void _closePipe( int pipe[2] )
 }
 
 
-static void _connectPipe( int to, int attachEnd, int ignoreEnd )
+/*
+  Add actions to make one end of a pipe a standard descriptor of a spawned
+  process and close both original ends.
+*/
+static void _connectPipe( posix_spawn_file_actions_t* fa, int to,
+                          int attachEnd, int ignoreEnd )
 {
-    close( ignoreEnd );
-    dup2( attachEnd, to );
-    close( attachEnd );
+    posix_spawn_file_actions_addclose( fa, ignoreEnd );
+    posix_spawn_file_actions_adddup2( fa, attachEnd, to );
+    posix_spawn_file_actions_addclose( fa, attachEnd );
+}
+
+
+extern char** environ;
+
+/*
+  Start a program with posix_spawnp().  Unlike fork(), this does not copy
+  the page tables of the interpreter so the cost does not grow with the
+  size of the heap.
+*/
+static int _spawn( UThread* ut, char** argv, posix_spawn_file_actions_t* fa,
+                   pid_t* pid )
+{
+    int err = posix_spawnp( pid, argv[0], fa, NULL, argv, environ );
+    posix_spawn_file_actions_destroy( fa );
+    if( err )
+        return ur_error( ut, UR_ERR_ACCESS, "execute %s - %s",
+                         argv[0], strerror(err) );
+    return UR_OK;
 }
 
 
 static int _execIO( UThread* ut, char** argv, UCell* res,
                     const UBuffer* in, UBuffer* out, UBuffer* err )
 {
-    const char* msg = "pipe failed";
+    posix_spawn_file_actions_t fa;
     int inPipe[2];
     int outPipe[2];
     int errPipe[2];
+    int status;
     pid_t pid;
 
 
@@ -405,67 +929,57 @@ static int _execIO( UThread* ut, char** argv, UCell* res,
             goto fail_err;
     }
 
-    pid = fork();
-    if( pid == 0 )
-    {
-        // In child process; invoke command.
+    posix_spawn_file_actions_init( &fa );
+    if( in )
+        _connectPipe( &fa, STDIN_FILENO, inPipe[0], inPipe[1] );
+    if( out )
+        _connectPipe( &fa, STDOUT_FILENO, outPipe[1], outPipe[0] );
+    if( err )
+        _connectPipe( &fa, STDERR_FILENO, errPipe[1], errPipe[0] );
 
-        if( in )
-            _connectPipe( STDIN_FILENO, inPipe[0], inPipe[1] );
-        if( out )
-            _connectPipe( STDOUT_FILENO, outPipe[1], outPipe[0] );
+    if( ! _spawn( ut, argv, &fa, &pid ) )
+    {
         if( err )
-            _connectPipe( STDERR_FILENO, errPipe[1], errPipe[0] );
-
-        if( execvp( argv[0], argv ) == -1 )
-        {
-            perror( "execvp" );
-            _exit( 255 );
-        }
-        return 0;
+            _closePipe( errPipe );
+        if( out )
+            _closePipe( outPipe );
+        if( in )
+            _closePipe( inPipe );
+        return UR_THROW;
     }
-    else if( pid > 0 )
-    {
-        // In parent process.
-
-        int status;
 
-        if( in )
-        {
-            close( inPipe[0] );
-            write( inPipe[1], in->ptr.v,
-                   (in->type == UT_STRING) ? in->used * in->elemSize
-                                           : in->used );
-            close( inPipe[1] );
-        }
+    if( in )
+    {
+        close( inPipe[0] );
+        write( inPipe[1], in->ptr.v,
+               (in->type == UT_STRING) ? in->used * in->elemSize
+                                       : in->used );
+        close( inPipe[1] );
+    }
 
-        if( out || err )
-        {
-            if( out )
-                close( outPipe[1] );
-            if( err )
-                close( errPipe[1] );
-            _readPipes( outPipe[0], out, errPipe[0], err );
-            if( out )
-                close( outPipe[0] );
-            if( err )
-                close( errPipe[0] );
-        }
+    if( out || err )
+    {
+        if( out )
+            close( outPipe[1] );
+        if( err )
+            close( errPipe[1] );
+        _readPipes( outPipe[0], out, errPipe[0], err );
+        if( out )
+            close( outPipe[0] );
+        if( err )
+            close( errPipe[0] );
+    }
 
-        waitpid( pid, &status, 0 );
-        if( WIFEXITED(status) )
-        {
-            ur_setId(res, UT_INT);
-            ur_int(res) = WEXITSTATUS(status);
-            return UR_OK;
-        }
-        ur_setId(res, UT_NONE);
+    waitpid( pid, &status, 0 );
+    if( WIFEXITED(status) )
+    {
+        ur_setId(res, UT_INT);
+        ur_int(res) = WEXITSTATUS(status);
         return UR_OK;
     }
+    ur_setId(res, UT_NONE);
+    return UR_OK;
 
-    msg = "fork failed";
-    if( err )
-        _closePipe( errPipe );
 fail_err:
     if( out )
         _closePipe( outPipe );
@@ -473,53 +987,115 @@ fail_out:
     if( in )
         _closePipe( inPipe );
 fail_in:
-    return ur_error( ut, UR_ERR_INTERNAL, msg );
+    return ur_error( ut, UR_ERR_INTERNAL, "pipe failed" );
 }
 
 
-#define MAX_SPAWN   4
-static pid_t _spawnPids[ MAX_SPAWN ] = { 0, 0, 0, 0 };
-static char  _sigchldInstalled = 0;
+/*
+  Table of /spawn child processes which are reaped by _childHandler().
+  Free slots are zero.  As the handler can run at any time (in any thread),
+  the table is a list of chunks which are never moved or freed.  When all
+  slots are used a chunk twice the size of the last is linked on.
+*/
+typedef struct SpawnTable SpawnTable;
+
+struct SpawnTable
+{
+    SpawnTable* volatile next;
+    int avail;
+    pid_t pid[1];
+};
+
+static SpawnTable* volatile _spawnTable = NULL;
+static char _sigchldInstalled = 0;
 
 
 /*
     Must call wait() or waitpid() when SIGCHLD is received to avoid zombies.
     Using wait() is not an option since it may get the status of a process
-    forked by _execIO.
+    started by _execIO.  As signals from several children may be merged,
+    every spawned process is checked.
 */
 static void _childHandler( int signum, siginfo_t* info, void* context )
 {
+    SpawnTable* st;
     int status;
     int i;
-    pid_t pid = info->si_pid;
+    pid_t pid;
 
     (void) signum;
+    (void) info;
     (void) context;
 
-    for( i = 0; i < MAX_SPAWN; ++i )
+    for( st = _spawnTable; st; st = st->next )
+    {
+        for( i = 0; i < st->avail; ++i )
+        {
+            pid = st->pid[i];
+            if( pid > 0 && waitpid( pid, &status, WNOHANG ) == pid )
+                st->pid[i] = 0;
+        }
+    }
+}
+
+
+/*
+  Return a free slot in the spawn table or NULL if there is no memory.
+  Must be called with LOCK_GLOBAL and SIGCHLD blocked, and the slot stays
+  free until the lock is released.
+*/
+static pid_t* _spawnTableSlot()
+{
+    SpawnTable* st;
+    SpawnTable* last = NULL;
+    SpawnTable* nt;
+    int i, avail;
+
+    for( st = _spawnTable; st; st = st->next )
     {
-        if( pid == _spawnPids[i] )
+        for( i = 0; i < st->avail; ++i )
         {
-            waitpid( pid, &status, 0 );
-            _spawnPids[i] = 0;
-            return;
+            if( ! st->pid[i] )
+                return st->pid + i;
         }
+        last = st;
     }
+
+    avail = last ? last->avail * 2 : 16;
+    nt = (SpawnTable*) memAlloc( sizeof(SpawnTable) +
+                                 sizeof(pid_t) * (avail - 1) );
+    if( ! nt )
+        return NULL;
+    nt->next  = NULL;
+    nt->avail = avail;
+    memSet( nt->pid, 0, sizeof(pid_t) * avail );
+    if( last )
+        last->next = nt;
+    else
+        _spawnTable = nt;
+    return nt->pid;
 }
 
 
-extern UPortDevice port_file;
+extern UPortDevice port_pipe;
 #define FD  used
 
+#if defined(__linux__) && ! defined(F_SETPIPE_SZ)
+#define F_SETPIPE_SZ    1031
+#endif
+
 /*
     NOTE: Cannot use _execSpawn if using Qt's QProcess (it uses SIGCHLD).
 */
 static int _execSpawn( UThread* ut, char** argv, int port, UCell* res )
 {
     UEnv* env = ut->env;
+    posix_spawn_file_actions_t fa;
+    sigset_t childSet, oldSet;
     pid_t pid;
-    int pslot;
+    pid_t* slot;
     int outPipe[2];
+    int ok;
 
 
     if( port )
@@ -528,6 +1104,28 @@ static int _execSpawn( UThread* ut, char** argv, int port, UCell* res )
             return ur_error( ut, UR_ERR_INTERNAL, "pipe failed" );
     }
 
+    posix_spawn_file_actions_init( &fa );
+    posix_spawn_file_actions_addclose( &fa, STDIN_FILENO );
+    if( port )
+    {
+        // Redirect stdout & stderr to pipe.
+        posix_spawn_file_actions_addclose( &fa, outPipe[0] );
+        posix_spawn_file_actions_adddup2( &fa, outPipe[1], STDOUT_FILENO );
+        posix_spawn_file_actions_adddup2( &fa, outPipe[1], STDERR_FILENO );
+        posix_spawn_file_actions_addclose( &fa, outPipe[1] );
+    }
+    else
+    {
+        // Don't change stderr so errors will be seen.
+        posix_spawn_file_actions_addopen( &fa, STDOUT_FILENO, "/dev/null",
+                                          O_WRONLY, 0 );
+    }
+
+    // Hold SIGCHLD until the pid is in the table.
+    sigemptyset( &childSet );
+    sigaddset( &childSet, SIGCHLD );
+    pthread_sigmask( SIG_BLOCK, &childSet, &oldSet );
+
     LOCK_GLOBAL
 
     if( ! _sigchldInstalled )
@@ -537,98 +1135,51 @@ static int _execSpawn( UThread* ut, char** argv, int port, UCell* res )
         _sigchldInstalled = 1;
 
         childSA.sa_sigaction = _childHandler;
-        childSA.sa_flags     = SA_SIGINFO | SA_NOCLDSTOP;
+        childSA.sa_flags     = SA_SIGINFO | SA_NOCLDSTOP | SA_RESTART;
         sigemptyset( &childSA.sa_mask );
 
         sigaction( SIGCHLD, &childSA, NULL );
     }
 
-    for( pslot = 0; pslot < MAX_SPAWN; ++pslot )
+    // Get the table slot first so the child can always be reaped.
+    if( (slot = _spawnTableSlot()) )
     {
-        if( ! _spawnPids[ pslot ] )
-        {
-            // Using PID 1 as placeholder till fork returns the actual PID.
-            _spawnPids[ pslot ] = 1;
-            break;
-        }
+        ok = _spawn( ut, argv, &fa, &pid );
+        if( ok )
+            *slot = pid;
     }
+    else
+        ok = ur_error( ut, UR_ERR_INTERNAL, "No memory for spawn table" );
 
     UNLOCK_GLOBAL
 
-    if( pslot == MAX_SPAWN )
+    pthread_sigmask( SIG_SETMASK, &oldSet, NULL );
+
+    if( ! ok )
     {
         if( port )
             _closePipe( outPipe );
-        return ur_error( ut, UR_ERR_INTERNAL,
-                         "execute only handles %d spawn", MAX_SPAWN );
+        return UR_THROW;
     }
 
-    pid = fork();
-    if( pid == 0 )
-    {
-        // In child process; invoke command.
-
-        close( STDIN_FILENO );
-
-        if( port )
-        {
-            // Redirect stdout & stderr to pipe.
-            close( outPipe[0] );
-            dup2( outPipe[1], STDOUT_FILENO );
-            dup2( outPipe[1], STDERR_FILENO );
-            close( outPipe[1] );
-        }
-        else
-        {
-            int nul = open( "/dev/null", O_WRONLY );
-            dup2( nul, STDOUT_FILENO );
-            close( nul );
-
-            // Don't change stderr so perror() will be seen.
-        }
-
-        if( execvp( argv[0], argv ) == -1 )
-        {
-            perror( "execvp" );
-            _exit( 255 );
-        }
-        return 0;
-    }
-    else if( pid > 0 )
+    if( port )
     {
-        // In parent process.
-
-        // NOTE: If somehow the child exits and _childHandler is called
-        //       before _spawnPids is set here then we'll get a zombie and
-        //       the pslot will remain forever.
+        UBuffer* pbuf;
 
-        _spawnPids[ pslot ] = pid;
-
-        if( port )
-        {
-            UBuffer* pbuf;
-
-            close( outPipe[1] );
-
-            // file_open
-            pbuf = boron_makePort( ut, &port_file, 0, res );
-            pbuf->FD = outPipe[0];
-        }
-        else
-        {
-            ur_setId(res, UT_INT);
-            ur_int(res) = pid;
-        }
-        return UR_OK;
+        close( outPipe[1] );
+#ifdef F_SETPIPE_SZ
+        // Let the child get further ahead of the reader.
+        fcntl( outPipe[0], F_SETPIPE_SZ, 0x100000 );
+#endif
+        pbuf = boron_makePort( ut, &port_pipe, 0, res );
+        pbuf->FD = outPipe[0];
     }
     else
     {
-        // fork failed.
-
-        if( port )
-            _closePipe( outPipe );
-        return ur_error( ut, UR_ERR_INTERNAL, "fork failed" );
+        ur_setId(res, UT_INT);
+        ur_int(res) = pid;
     }
+    return UR_OK;
 }
 
 
@@ -671,13 +1222,17 @@ static const UBuffer* _execBuf( UThread* ut, const UCell* cell, int fd )
         /err        Store error output of command.
             error   binary!/string!
         /spawn      Run command asynchronously.
-        /port       Return port to read spawn output.
+        /port       Run command asynchronously and return port to read output.
     return: int! status of command or spawn port!
     group: os
 
     Runs an external program.
 
-    If /spawn is used then /in, /out, and /err are ignored.
+    If /spawn or /port is used then /in, /out, and /err are ignored.
+
+    The /port option streams the standard output & error of the command
+    through a port! which can be used with wait.  Reading it returns up to
+    64K of output at a time, or none when the command has finished.
 */
 CFUNC_PUB( cfunc_execute )
 {
@@ -705,7 +1260,7 @@ CFUNC_PUB( cfunc_execute )
     ur_arrInit( &argv, sizeof(char*), 8 );
     argumentList( boron_cstr( ut, a1, 0 ), &argv );
 
-    if( opt & OPT_EXECUTE_SPAWN )
+    if( opt & (OPT_EXECUTE_SPAWN | OPT_EXECUTE_PORT) )
     {
         ok = _execSpawn( ut, (char**) argv.ptr.v, opt & OPT_EXECUTE_PORT, res );
     }
@@ -35,6 +35,8 @@
 // Align for 64-bit pointers or doubles if size > 4.
 #define FORWARD(s)      ((s > 4) ? 8 : 4)
 
+extern void ur_binImageRelease( const uint8_t* data );
+
 
 /**
   Initialize array buffer.
@@ -80,6 +82,13 @@ void ur_arrFree( UBuffer* buf )
 {
     if( buf->ptr.b )
     {
+        if( (buf->flags & UR_BUF_BORROWED) &&
+            (buf->type == UT_VECTOR || ur_isStringType(buf->type)) )
+        {
+            ur_binImageRelease( buf->ptr.b );
+            buf->flags &= ~UR_BUF_BORROWED;
+        }
+        else
         memFree( buf->ptr.b - FORWARD(buf->elemSize) );
         buf->ptr.b = 0;
     }
@@ -21,7 +21,7 @@
     type        UT_BINARY
     elemSize    Unused
     form        UR_BENC_*
-    flags       Unused
+    flags       UR_BUF_MAPPED, UR_BUF_BORROWED
     used        Number of bytes used
     ptr.b       Data
     ptr.i[-1]   Number of bytes available
@@ -30,10 +30,15 @@
 
 #include "urlan.h"
 #include "os.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 
 #define FORWARD     sizeof(int32_t)
 
+void ur_binImageRelease( const uint8_t* data );
+
 
 /** \defgroup dt_binary Datatype Binary
   \ingroup urlan
@@ -121,6 +126,21 @@ void ur_binFree( UBuffer* buf )
 {
     if( buf->ptr.b )
     {
+        if( buf->flags & UR_BUF_BORROWED )
+        {
+            ur_binImageRelease( buf->ptr.b );
+            buf->flags &= ~UR_BUF_BORROWED;
+        }
+        else
+#ifndef _WIN32
+        if( buf->flags & UR_BUF_MAPPED )
+        {
+            long page = sysconf( _SC_PAGESIZE );
+            munmap( buf->ptr.b - page, ur_avail(buf) + page );
+            buf->flags &= ~UR_BUF_MAPPED;
+        }
+        else
+#endif
         memFree( buf->ptr.b - FORWARD );
         buf->ptr.b = 0;
     }
@@ -128,6 +148,238 @@ void ur_binFree( UBuffer* buf )
 }
 
 
+#ifndef _WIN32
+/**
+  Map a file into memory as the data of a binary buffer.
+
+  The data is read-only; ur_bufferSeriesM() will refuse to modify the buffer
+  and ur_binFree() unmaps it.
+
+  \param buf    Binary buffer with no data.
+  \param fd     Open file descriptor.
+  \param size   Number of bytes to map from the start of the file.
+
+  \return UR_OK or UR_THROW if the mapping failed (errno is set).
+*/
+UStatus ur_binMapFile( UBuffer* buf, int fd, int size )
+{
+    long page = sysconf( _SC_PAGESIZE );
+    uint8_t* mem;
+
+    // The file is mapped after an anonymous page which holds the available
+    // count just as for allocated data.
+    mem = (uint8_t*) mmap( NULL, page + size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( mem == MAP_FAILED )
+        return UR_THROW;
+    if( mmap( mem + page, size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+              fd, 0 ) == MAP_FAILED )
+    {
+        munmap( mem, page + size );
+        return UR_THROW;
+    }
+
+    buf->ptr.b = mem + page;
+    buf->used  = size;
+    buf->flags |= UR_BUF_MAPPED;
+    ur_avail(buf) = size;
+    mprotect( mem, page, PROT_READ );
+    return UR_OK;
+}
+#endif
+
+
+/*
+  An image is a block of binary data (such as serialized data) which other
+  buffers reference in place.  Those buffers have the UR_BUF_BORROWED flag
+  and are read-only; ur_bufferSeriesM() gives them a private copy of their
+  data before any modification.  The image memory is freed along with the
+  last buffer referencing it.
+*/
+
+typedef struct BinImage
+{
+    struct BinImage* next;
+    uint8_t* start;
+    uint8_t* end;
+    int refs;
+    int mapPage;        // Size of page before mapped data or zero.
+}
+BinImage;
+
+static BinImage* _imageList = 0;
+static OSMutex _imageMutex;
+static int _imageMutexInit = 0;
+
+
+void ur_binImageInit()
+{
+    if( ! _imageMutexInit )
+        _imageMutexInit = mutexInitF( _imageMutex ) ? 0 : 1;
+}
+
+
+/**
+  Make the data of a binary buffer an image which other buffers can
+  reference in place.
+
+  The binary itself becomes a read-only reference to the image.  Nothing
+  is done if the binary already references an image.
+
+  \param buf    Binary buffer.
+
+  \return UR_OK or UR_THROW if the binary has no data.
+*/
+UStatus ur_binMakeImage( UBuffer* buf )
+{
+    BinImage* img;
+
+    if( buf->flags & UR_BUF_BORROWED )
+        return UR_OK;
+    if( ! buf->ptr.b || ! buf->used )
+        return UR_THROW;
+
+    img = (BinImage*) memAlloc( sizeof(BinImage) );
+    img->start = buf->ptr.b;
+    img->end   = buf->ptr.b + ur_avail(buf);
+    img->refs  = 1;
+    img->mapPage = 0;
+#ifndef _WIN32
+    if( buf->flags & UR_BUF_MAPPED )
+    {
+        img->mapPage = sysconf( _SC_PAGESIZE );
+        buf->flags &= ~UR_BUF_MAPPED;
+    }
+#endif
+    buf->flags |= UR_BUF_BORROWED;
+
+    mutexLock( _imageMutex );
+    img->next = _imageList;
+    _imageList = img;
+    mutexUnlock( _imageMutex );
+    return UR_OK;
+}
+
+
+/*
+  Return image containing the memory from it to end or zero if there is
+  none.  A reference is added to the image which the caller must remove
+  with ur_binImageRef( image, -1 ).
+*/
+void* ur_binImageFind( const uint8_t* it, const uint8_t* end )
+{
+    BinImage* img;
+
+    mutexLock( _imageMutex );
+    for( img = _imageList; img; img = img->next )
+    {
+        if( it >= img->start && end <= img->end )
+        {
+            ++img->refs;
+            break;
+        }
+    }
+    mutexUnlock( _imageMutex );
+    return img;
+}
+
+
+static void _imageFree( BinImage* img )
+{
+#ifndef _WIN32
+    if( img->mapPage )
+        munmap( img->start - img->mapPage,
+                (img->end - img->start) + img->mapPage );
+    else
+#endif
+    memFree( img->start - FORWARD );
+    memFree( img );
+}
+
+
+/*
+  Add (or remove, if count is negative) references to an image found with
+  ur_binImageFind().
+*/
+void ur_binImageRef( void* image, int count )
+{
+    BinImage* img;
+    BinImage** prev = &_imageList;
+
+    mutexLock( _imageMutex );
+    img = (BinImage*) image;
+    img->refs += count;
+    if( img->refs > 0 )
+        img = 0;
+    else
+    {
+        while( *prev != img )
+            prev = &(*prev)->next;
+        *prev = img->next;
+    }
+    mutexUnlock( _imageMutex );
+
+    if( img )
+        _imageFree( img );
+}
+
+
+/*
+  Remove the reference of a borrowed buffer to its image.
+*/
+void ur_binImageRelease( const uint8_t* data )
+{
+    BinImage* img;
+    BinImage** prev = &_imageList;
+
+    mutexLock( _imageMutex );
+    for( img = _imageList; img; img = img->next )
+    {
+        if( data >= img->start && data < img->end )
+        {
+            if( --img->refs )
+                img = 0;
+            else
+                *prev = img->next;
+            break;
+        }
+        prev = &img->next;
+    }
+    mutexUnlock( _imageMutex );
+
+    if( img )
+        _imageFree( img );
+}
+
+
+/*
+  Give a borrowed binary, string, or vector buffer a private copy of its
+  data.
+*/
+void ur_binUnborrow( UBuffer* buf )
+{
+    const uint8_t* data = buf->ptr.b;
+
+    buf->flags &= ~UR_BUF_BORROWED;
+    buf->ptr.b = 0;
+    if( data )
+    {
+        if( buf->type == UT_BINARY )
+        {
+            ur_binReserve( buf, buf->used );
+            memCpy( buf->ptr.b, data, buf->used );
+        }
+        else
+        {
+            ur_arrReserve( buf, buf->used );
+            memCpy( buf->ptr.b, data, buf->used * buf->elemSize );
+        }
+        ur_binImageRelease( data );
+    }
+}
+
+
+
 /**
   Allocates enough memory to hold size bytes.
   buf->used is not changed.
@@ -276,6 +276,8 @@ extern UDatatype dt_hashmap;
 #if CONFIG_TIMECODE
 extern UDatatype dt_timecode;
 #endif
+extern void ur_binImageInit();
+extern void ur_binUnborrow( UBuffer* );
 
 
 /**
@@ -346,6 +348,7 @@ UThread* ur_makeEnv( const UEnvParameters* par )
         return 0;
 
     ur_arrInit( &env->sharedStore, sizeof(UBuffer), 0 );
+    ur_arrInit( &env->sharedRetired, sizeof(UBuffer), 0 );
 
     ur_binInit( &env->atomNames, par->atomNamesSize );
     ur_arrInit( &env->atomTable, sizeof(AtomRec), par->atomLimit );
@@ -356,6 +359,8 @@ UThread* ur_makeEnv( const UEnvParameters* par )
     env->threadSize = par->threadSize;
     env->threadFunc = par->threadMethod;
 
+    ur_binImageInit();
+
     if( mutexInitF( env->mutex ) )
     {
 #ifdef _WIN32
@@ -489,6 +494,13 @@ void ur_freeEnv( UThread* ut )
 #endif
 
     _destroyDataStore( env, &env->sharedStore );
+    {
+    UBuffer* it  = env->sharedRetired.ptr.buf;
+    UBuffer* end = it + env->sharedRetired.used;
+    for( ; it != end; ++it )
+        ur_arrFree( it );
+    ur_arrFree( &env->sharedRetired );
+    }
 
     mutexFree( env->mutex );
     ur_binFree( &env->atomNames );
@@ -567,6 +579,335 @@ void ur_freezeEnv( UThread* ut )
 }
 
 
+typedef struct
+{
+    UBuffer map;        // New shared position of each thread buffer (or 0).
+    UBuffer list;       // Thread buffers to move, in shared store order.
+    UIndex  base;       // Shared store position of first moved buffer.
+    int     pass;
+}
+Freezer;
+
+enum FreezePass
+{
+    FREEZE_COLLECT,
+    FREEZE_REMAP
+};
+
+extern void unset_toShared( UCell* );
+#if CONFIG_HASHMAP
+extern void ur_mapInit( UBuffer* map, int size );
+#endif
+
+
+/*
+  During the collect pass add buffer to list, and during the remap pass
+  return the new shared buffer index.
+*/
+static UIndex _freezeRef( UThread* ut, Freezer* fz, UIndex n )
+{
+    UIndex* pos = fz->map.ptr.i + n;
+
+    if( fz->pass == FREEZE_REMAP )
+        return -(fz->base + *pos - 1);
+
+    if( ! *pos )
+    {
+        UBuffer* buf = ur_buffer(n);
+        switch( buf->type )
+        {
+            case UT_BINARY:
+            case UT_BITSET:
+            case UT_STRING:
+            case UT_FILE:
+            case UT_VECTOR:
+            case UT_BLOCK:
+            case UT_PAREN:
+            case UT_PATH:
+            case UT_LITPATH:
+            case UT_SETPATH:
+            case UT_CONTEXT:
+#if CONFIG_HASHMAP
+            case UT_HASHMAP:
+#endif
+                break;
+            default:
+                return ur_error( ut, UR_ERR_TYPE, "Cannot freeze %s buffer",
+                                 ur_atomCStr( ut, buf->type ) );
+        }
+        ur_arrAppendInt32( &fz->list, n );
+        *pos = fz->list.used;
+    }
+    return n;
+}
+
+
+/*
+  Return UR_OK/UR_THROW.
+*/
+static UStatus _freezeCell( UThread* ut, Freezer* fz, UCell* cell )
+{
+    int type = ur_type(cell);
+    UIndex n;
+
+    if( type < UT_REFERENCE_BUF )
+        return UR_OK;
+
+    if( ur_isWordType(type) )
+    {
+        n = cell->word.ctx;
+        switch( ur_binding(cell) )
+        {
+            case UR_BIND_UNBOUND:
+            case UR_BIND_ENV:
+            case UR_BIND_STACK:
+                break;
+
+            case UR_BIND_THREAD:
+            case UR_BIND_SECURE:
+                if( n == UR_MAIN_CONTEXT )
+                {
+                    // Thread globals are not moved; use any shared global
+                    // of the same name.
+                    if( fz->pass == FREEZE_REMAP )
+                    {
+                        int wi = ur_ctxLookup( ur_envContext(ut),
+                                               ur_atom(cell) );
+                        if( wi < 0 )
+                        {
+                            ur_setBinding( cell, UR_BIND_UNBOUND );
+                            cell->word.ctx = UR_INVALID_BUF;
+                        }
+                        else
+                        {
+                            ur_setBinding( cell, UR_BIND_ENV );
+                            cell->word.ctx   = -UR_MAIN_CONTEXT;
+                            cell->word.index = wi;
+                        }
+                    }
+                    break;
+                }
+                if( fz->pass == FREEZE_REMAP )
+                    ur_setBinding( cell, UR_BIND_ENV );
+                // Fall through...
+
+            default:
+                if( n > UR_MAIN_CONTEXT )
+                {
+                    n = _freezeRef( ut, fz, n );
+                    if( ! n )
+                        return UR_THROW;
+                    cell->word.ctx = n;
+                }
+                break;
+        }
+    }
+    else
+    {
+        // Any index changed by toShared() references a buffer.
+        UCell tmp;
+        UIndex* ci;
+        UIndex* ti;
+        int i;
+
+        if( ut->types[ type ]->toShared == unset_toShared )
+            goto bad_type;
+
+        tmp = *cell;
+        ut->types[ type ]->toShared( &tmp );
+        ci = (UIndex*) cell;
+        ti = (UIndex*) &tmp;
+        for( i = 1; i < (int) (sizeof(UCell) / sizeof(UIndex)); ++i )
+        {
+            n = ci[i];
+            if( n > UR_INVALID_BUF && ti[i] == -n )
+            {
+                if( n == UR_MAIN_CONTEXT )
+                    goto bad_type;
+                n = _freezeRef( ut, fz, n );
+                if( ! n )
+                    return UR_THROW;
+                ci[i] = n;
+            }
+        }
+    }
+    return UR_OK;
+
+bad_type:
+    return ur_error( ut, UR_ERR_TYPE, "Cannot freeze %s",
+                     ur_atomCStr( ut, type ) );
+}
+
+
+static UStatus _freezeBuffers( UThread* ut, Freezer* fz, UCell* cell )
+{
+    UBuffer* buf;
+    UCell* it;
+    UCell* end;
+    UIndex i;
+
+    if( ! _freezeCell( ut, fz, cell ) )
+        return UR_THROW;
+
+    // NOTE: fz->list changes inside the loop as new buffers are seen.
+
+    for( i = 0; i < fz->list.used; ++i )
+    {
+        buf = ur_buffer( fz->list.ptr.i[ i ] );
+        if( BLOCK_MASK & (1 << buf->type) )
+        {
+            it  = buf->ptr.cell;
+            end = it + buf->used;
+            for( ; it != end; ++it )
+            {
+                if( ! _freezeCell( ut, fz, it ) )
+                    return UR_THROW;
+            }
+        }
+    }
+    return UR_OK;
+}
+
+
+/*
+  Replace a moved thread buffer with an empty one of the same type.
+
+  Words may still be bound to a moved context, so it is replaced with a
+  shallow copy (which references the shared buffers) rather than emptied.
+*/
+static void _freezeEmpty( UBuffer* buf, const UBuffer* moved )
+{
+    switch( buf->type )
+    {
+        case UT_CONTEXT:
+            ur_ctxInit( buf, moved->used );
+            if( moved->used )
+            {
+                UAtom* atoms;
+                int i;
+
+                atoms = (UAtom*) memAlloc( sizeof(UAtom) * moved->used );
+                ur_ctxWordAtoms( moved, atoms );
+                for( i = 0; i < moved->used; ++i )
+                    ur_ctxAppendWord( buf, atoms[ i ] );
+                memFree( atoms );
+                memCpy( buf->ptr.cell, moved->ptr.cell,
+                        sizeof(UCell) * moved->used );
+                ur_ctxSort( buf );
+            }
+            break;
+#if CONFIG_HASHMAP
+        case UT_HASHMAP:
+            ur_mapInit( buf, 0 );
+            break;
+#endif
+        default:
+            buf->used  = 0;
+            buf->ptr.v = 0;
+            break;
+    }
+}
+
+
+/**
+  Move a value and all the thread buffers it references to the shared
+  environment so that it can be read by any thread.
+
+  This may be called at any time after ur_freezeEnv().  The moved buffers
+  become read-only and are never recycled.  Any other references to them in
+  the thread dataStore will see an empty series, except for moved contexts
+  which are left as a copy so that words still bound to them remain valid.
+
+  Words bound to the thread context become bound to the shared environment
+  context if it has a word of the same name, otherwise they are unbound.
+
+  Other threads can see the new buffers after calling ur_syncShared().
+
+  \param cell   Value to freeze.  It is modified to reference the shared
+                buffers.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_freeze( UThread* ut, UCell* cell )
+{
+    UEnv* env = ut->env;
+    UBuffer* store;
+    Freezer fz;
+    UIndex i;
+    UIndex n;
+    UStatus ok;
+
+    if( ! env->sharedStore.used )
+        return ur_error( ut, UR_ERR_SCRIPT, "Environment is not frozen" );
+
+    ur_arrInit( &fz.map, sizeof(UIndex), ut->dataStore.used );
+    memSet( fz.map.ptr.i, 0, sizeof(UIndex) * ut->dataStore.used );
+    ur_arrInit( &fz.list, sizeof(UIndex), 0 );
+
+    fz.pass = FREEZE_COLLECT;
+    ok = _freezeBuffers( ut, &fz, cell );
+    if( ok && fz.list.used )
+    {
+        LOCK_GLOBAL
+
+        store = &env->sharedStore;
+        fz.base = store->used;
+        n = fz.base + fz.list.used;
+
+        // Other threads may be reading the current array, so it is retired
+        // rather than reallocated.
+        if( n > ur_avail(store) )
+        {
+            UBuffer grown;
+            ur_arrInit( &grown, sizeof(UBuffer), n + n / 2 );
+            memCpy( grown.ptr.buf, store->ptr.buf, sizeof(UBuffer) * store->used );
+            grown.used = store->used;
+
+            ur_arrReserve( &env->sharedRetired, env->sharedRetired.used + 1 );
+            env->sharedRetired.ptr.buf[ env->sharedRetired.used++ ] = *store;
+            *store = grown;
+        }
+
+        fz.pass = FREEZE_REMAP;
+        _freezeBuffers( ut, &fz, cell );
+
+        for( i = 0; i < fz.list.used; ++i )
+        {
+            UBuffer* buf = ur_buffer( fz.list.ptr.i[ i ] );
+            UBuffer* sbuf = store->ptr.buf + fz.base + i;
+            *sbuf = *buf;
+            _freezeEmpty( buf, sbuf );
+            if( sbuf->type == UT_CONTEXT )
+                ur_ctxSort( sbuf );
+        }
+        store->used = n;
+        ut->sharedStoreBuf = store->ptr.buf;
+
+        UNLOCK_GLOBAL
+    }
+
+    ur_arrFree( &fz.map );
+    ur_arrFree( &fz.list );
+    return ok;
+}
+
+
+/**
+  Update the thread view of the shared environment to include buffers
+  added by ur_freeze() in other threads.
+
+  This must be called before using any shared values which the thread
+  receives from another thread.
+*/
+void ur_syncShared( UThread* ut )
+{
+    UEnv* env = ut->env;
+    LOCK_GLOBAL
+    ut->sharedStoreBuf = env->sharedStore.ptr.buf;
+    UNLOCK_GLOBAL
+}
+
+
 /**
   Get number of datatypes installed in the environment.
 
@@ -1292,10 +1633,13 @@ const UBuffer* ur_bufferSeries( const UThread* ut, const UCell* cell )
   \param cell   Pointer to valid series or bound word cell.
 
   \return Pointer to buffer referenced by cell->series.buf.  If the buffer
-          is in shared storage then an error is generated and zero is returned.
+          is in shared storage or is a read-only file mapping then an error
+          is generated and zero is returned.  A buffer which references an
+          image is first given a copy of its data.
 */
 UBuffer* ur_bufferSeriesM( UThread* ut, const UCell* cell )
 {
+    UBuffer* buf;
     UIndex n = cell->series.buf;
     if( ur_isShared(n) )
     {
@@ -1303,7 +1647,19 @@ UBuffer* ur_bufferSeriesM( UThread* ut, const UCell* cell )
                   ur_atomCStr( ut, ut->sharedStoreBuf[-n].type ) );
         return 0;
     }
-    return ut->dataStore.ptr.buf + n;
+    buf = ut->dataStore.ptr.buf + n;
+    if( buf->flags & UR_BUF_BORROWED )
+    {
+        if( buf->type == UT_BINARY || buf->type == UT_VECTOR ||
+            ur_isStringType(buf->type) )
+            ur_binUnborrow( buf );      // Copy on write.
+    }
+    else if( buf->type == UT_BINARY && (buf->flags & UR_BUF_MAPPED) )
+    {
+        ur_error( ut, UR_ERR_SCRIPT, "Cannot modify memory mapped binary!" );
+        return 0;
+    }
+    return buf;
 }
 
 
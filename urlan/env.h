@@ -31,7 +31,8 @@
 struct UEnv
 {
     OSMutex     mutex;
-    UBuffer     sharedStore;
+    UBuffer     sharedStore;    // Grown by ur_freeze() under mutex.
+    UBuffer     sharedRetired;  // Old sharedStore arrays still in use.
     UBuffer     atomNames;      // Protected by mutex.
     UBuffer     atomTable;      // Protected by mutex.
     uint16_t    typeCount;
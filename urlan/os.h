@@ -48,6 +48,7 @@ typedef CONDITION_VARIABLE  OSCond;
 #define condFree(cond)
 #define condWaitF(cond,mh)  (! SleepConditionVariableCS(&cond,&mh,INFINITE))
 #define condSignal(cond)    WakeConditionVariable(&cond)
+#define condBroadcast(cond) WakeAllConditionVariable(&cond)
 
 #else
 
@@ -68,6 +69,7 @@ typedef pthread_cond_t      OSCond;
 #define condFree(cond)      pthread_cond_destroy(&cond)
 #define condWaitF(cond,mh)  pthread_cond_wait(&cond,&mh)
 #define condSignal(cond)    pthread_cond_signal(&cond)
+#define condBroadcast(cond) pthread_cond_broadcast(&cond)
 
 #endif
 
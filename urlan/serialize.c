@@ -18,12 +18,18 @@
 */
 
 
-#include "urlan.h"
-#include "os.h"
+#include "env.h"
+
+#if CONFIG_COMPRESS == 1
+#include <zlib.h>
+#define SERIAL_DEFLATE
+#endif
 
 #ifdef CONFIG_HASHMAP
 extern void ur_mapInitV( UThread* ut, UBuffer* map, const UBuffer* valueBlk );
 #endif
+extern void* ur_binImageFind( const uint8_t* it, const uint8_t* end );
+extern void  ur_binImageRef( void* image, int count );
 
 
 /*
@@ -46,6 +52,63 @@ extern void ur_mapInitV( UThread* ut, UBuffer* map, const UBuffer* valueBlk );
         0D 0001     ;   word!
 
     6120706C616E00  ; Atoms string "a plan^0"
+
+    When UR_SERIAL_SHARED is used, buffers in the shared environment are
+    not copied.  Their entry is the BUF_SHARED code followed by the packed
+    shared buffer number.  This form is only valid within the process that
+    made it.
+
+    When UR_SERIAL_INDEX is used, an index follows the atoms string so that
+    single values can be unserialized without decoding everything:
+
+    42494458        ; "BIDX"
+    00000003        ; Buffer count
+    0000000C ...    ; Offset of each buffer entry
+    00000040        ; Stride (cells between first block offsets)
+    00000001        ; Offset count
+    0000000E ...    ; Offset of every 64th cell of the first block
+    00000030        ; Offset of index
+    42494458        ; "BIDX"
+
+    All offsets are from the start of the data.  Readers which do not know
+    of the index ignore it.
+
+    When UR_SERIAL_DEDUPE is used, a binary or string buffer with the same
+    contents as an earlier one is written as the BUF_DUP code followed by
+    the packed number of that earlier buffer.
+
+    When UR_SERIAL_COMPRESS is used the ID is "BORZ" and large binary,
+    bitset, string, and vector entries may have their data deflated with
+    zlib.  Such an entry is the BUF_DEFLATE code, the usual entry header
+    (type, form, & packed used), the 32-bit compressed length, and then
+    the compressed data.  Each entry is inflated directly into its buffer.
+
+    When UR_SERIAL_PARALLEL is used, large blocks referenced by the first
+    block may be encoded by other threads.  Each such block and the
+    buffers it references are a group which is written in place of the
+    block entry:
+
+    FC 05 03 02 00 04   ; BUF_GROUP base, count, atom count, atoms 0 & 4
+    17 02 ...           ;   Group buffer #0 (the block) entry
+    14 0005 ...         ;   Group buffer #1 entry
+    ...
+
+    The group entries use their own buffer & atom numbers.  Group buffer
+    #0 is the block and the others are numbered from base, which follows
+    all the buffers outside of groups.  The group atoms are indices into
+    the atoms string.
+
+    The stream form made by ur_serializeStream() has a "BOS2" ID followed by
+    records which each start with a type byte and two 32-bit numbers:
+
+    41 00000002 00000006 ...    ; 'A' count, length, new atoms "a plan"
+    45 00000003 00000019 ...    ; 'E' buffer count, length, buffer entries
+    44 00000003 00100005 ...    ; 'D' buffer count, length, one large entry
+    5A 00000000 00000000        ; 'Z' end of stream
+
+    The buffer count is the number of buffers referenced by all the entries
+    so far.  Atom records always preceed the entries which use them.
+    Shared buffers (UR_SERIAL_SHARED) are not supported in streams.
 */
 
 
@@ -54,6 +117,11 @@ typedef struct
     UBuffer atomMap;
     UBuffer bufMap;     // BufferIndex
     UBuffer ctxAtoms;   // Temporary buffer for ur_ctxWordAtoms().
+    UBuffer atomSlot;   // atomMap index + 1 of each atom.
+    UBuffer bufSlot;    // Hash table of bufMap index + 1.
+    UBuffer dupSlot;    // Hash table of content hash & bufMap index + 1.
+    int dupCount;
+    int opt;
 }
 Serializer;
 
@@ -61,6 +129,16 @@ Serializer;
 #define CTYPE_FLAG  0x40
 #define CTYPE_SOL   0x80    // Currently identical to UR_FLAG_SOL
 
+#define BUF_SHARED  0xff    // Buffer type for UR_SERIAL_SHARED references.
+#define BUF_DUP     0xfe    // Buffer type for UR_SERIAL_DEDUPE references.
+#define BUF_DEFLATE 0xfd    // Buffer type for UR_SERIAL_COMPRESS entries.
+#define BUF_GROUP   0xfc    // Buffer type for UR_SERIAL_PARALLEL groups.
+
+#define DEDUPE_MIN  8       // Smallest payload checked for duplicates.
+#define DEFLATE_MIN 1024    // Smallest payload which is compressed.
+
+#define INDEX_STRIDE    64  // Cells between first block index offsets.
+
 
 typedef struct
 {
@@ -86,21 +164,51 @@ enum SeriesRange
 static int _mapAtom( Serializer* ser, UAtom atom )
 {
     UBuffer* map = &ser->atomMap;
-    UAtom* it  = map->ptr.u16;
-    UAtom* end = it + map->used;
+    UBuffer* slot = &ser->atomSlot;
 
-    for( ; it != end; ++it )
+    if( atom >= slot->used )
     {
-        if( *it == atom )
-            return it - map->ptr.u16;
+        ur_arrReserve( slot, atom + 256 );
+        memSet( slot->ptr.i + slot->used, 0,
+                (ur_avail(slot) - slot->used) * sizeof(int32_t) );
+        slot->used = ur_avail(slot);
     }
+    else if( slot->ptr.i[ atom ] )
+        return slot->ptr.i[ atom ] - 1;
 
     ur_arrReserve( map, map->used + 1 );
     map->ptr.u16[ map->used++ ] = atom;
+    slot->ptr.i[ atom ] = map->used;
     return map->used - 1;
 }
 
 
+#define BUF_HASH(N,mask)    ((((uint32_t) (N)) * 2654435761u) & mask)
+
+static void _rehashBuffers( Serializer* ser )
+{
+    UBuffer* slot = &ser->bufSlot;
+    const BufferIndex* bi = (const BufferIndex*) ser->bufMap.ptr.v;
+    uint32_t mask;
+    uint32_t h;
+    int i;
+
+    i = slot->used ? slot->used * 2 : 256;     // Power of two.
+    ur_arrReserve( slot, i );
+    slot->used = i;
+    memSet( slot->ptr.i, 0, slot->used * sizeof(int32_t) );
+    mask = slot->used - 1;
+
+    for( i = 0; i < ser->bufMap.used; ++i )
+    {
+        h = BUF_HASH( bi[i].bufN, mask );
+        while( slot->ptr.i[ h ] )
+            h = (h + 1) & mask;
+        slot->ptr.i[ h ] = i + 1;
+    }
+}
+
+
 /*
   Add buffer to map if it's not present.
 
@@ -110,22 +218,154 @@ static int _mapBuffer( Serializer* ser, UIndex bufN )
 {
 #define mapBegin    ur_ptr(BufferIndex, map)
     UBuffer* map = &ser->bufMap;
-    BufferIndex* it  = mapBegin;
-    BufferIndex* end = it + map->used;
+    UBuffer* slot = &ser->bufSlot;
+    BufferIndex* it;
+    uint32_t mask;
+    uint32_t h;
+    int n;
 
-    for( ; it != end; ++it )
+    if( map->used * 2 >= slot->used )
+        _rehashBuffers( ser );
+
+    mask = slot->used - 1;
+    h = BUF_HASH( bufN, mask );
+    while( (n = slot->ptr.i[ h ]) )
     {
-        if( it->bufN == bufN )
-            return it - mapBegin;
+        if( mapBegin[ n - 1 ].bufN == bufN )
+            return n - 1;
+        h = (h + 1) & mask;
     }
 
     ur_arrExpand1( BufferIndex, map, it );
     it->bufN = bufN;
     //it->offset = 0;
+    slot->ptr.i[ h ] = map->used;
     return it - mapBegin;
 }
 
 
+static uint32_t _hashBytes( const uint8_t* it, const uint8_t* end )
+{
+    uint32_t h = 2166136261u;       // FNV-1a
+    while( it != end )
+        h = (h ^ *it++) * 16777619u;
+    return h;
+}
+
+
+static void _rehashDups( Serializer* ser )
+{
+    UBuffer* slot = &ser->dupSlot;
+    UBuffer table;
+    const uint32_t* it;
+    const uint32_t* end;
+    uint32_t* sp;
+    uint32_t mask;
+    uint32_t h;
+    int size = slot->used ? slot->used * 2 : 512;   // Power of two.
+
+    ur_arrInit( &table, sizeof(uint32_t), size );
+    table.used = size;
+    memSet( table.ptr.u32, 0, size * sizeof(uint32_t) );
+    mask = (size / 2) - 1;
+
+    it  = slot->ptr.u32;
+    end = it + slot->used;
+    for( ; it != end; it += 2 )
+    {
+        if( it[1] )
+        {
+            h = it[0] & mask;
+            while( table.ptr.u32[ h * 2 + 1 ] )
+                h = (h + 1) & mask;
+            sp = table.ptr.u32 + h * 2;
+            sp[0] = it[0];
+            sp[1] = it[1];
+        }
+    }
+
+    ur_arrFree( slot );
+    *slot = table;
+}
+
+
+/*
+  Find an earlier binary, string, or file buffer with the same type and
+  contents as buf (bufMap entry i).  If there is none then buf is added to
+  the table.
+
+  Returns bufMap index + 1 of the duplicate or zero.
+*/
+static int _dedupe( UThread* ut, Serializer* ser, const UBuffer* buf, int i )
+{
+    UBuffer* slot = &ser->dupSlot;
+    const UBuffer* dup;
+    uint32_t* sp;
+    uint32_t mask;
+    uint32_t hash;
+    uint32_t h;
+    int size;
+    int n;
+
+    if( buf->type == UT_BINARY )
+        size = buf->used;
+    else if( buf->type == UT_STRING || buf->type == UT_FILE )
+        size = buf->used * buf->elemSize;
+    else
+        return 0;
+    if( size < DEDUPE_MIN )
+        return 0;
+
+    if( ser->dupCount * 4 >= slot->used )
+        _rehashDups( ser );
+
+    hash = _hashBytes( buf->ptr.b, buf->ptr.b + size );
+    mask = (slot->used / 2) - 1;
+    h = hash & mask;
+    while( (n = (sp = slot->ptr.u32 + h * 2)[1]) )
+    {
+        if( sp[0] == hash )
+        {
+            dup = ur_bufferE( ((BufferIndex*) ser->bufMap.ptr.v)[n - 1].bufN );
+            if( dup->type == buf->type && dup->form == buf->form &&
+                dup->used == buf->used &&
+                memcmp( dup->ptr.b, buf->ptr.b, size ) == 0 )
+                return n;
+        }
+        h = (h + 1) & mask;
+    }
+
+    sp[0] = hash;
+    sp[1] = i + 1;
+    ++ser->dupCount;
+    return 0;
+}
+
+
+static void _serInit( Serializer* ser, int opt )
+{
+    ser->opt = opt;
+    ser->dupCount = 0;
+    ur_arrInit( &ser->atomMap, sizeof(UAtom), 0 );
+    ur_arrInit( &ser->bufMap, sizeof(BufferIndex), 0 );
+    ur_arrInit( &ser->ctxAtoms, sizeof(UAtom), 0 );
+    ur_arrInit( &ser->atomSlot, sizeof(int32_t), 0 );
+    ur_arrInit( &ser->bufSlot, sizeof(int32_t), 0 );
+    ur_arrInit( &ser->dupSlot, sizeof(uint32_t), 0 );
+}
+
+
+static void _serFree( Serializer* ser )
+{
+    ur_arrFree( &ser->atomMap );
+    ur_arrFree( &ser->bufMap );
+    ur_arrFree( &ser->ctxAtoms );
+    ur_arrFree( &ser->atomSlot );
+    ur_arrFree( &ser->bufSlot );
+    ur_arrFree( &ser->dupSlot );
+}
+
+
 static inline uint32_t _zigZag32( int32_t n )
 {
     return (n < 0) ? (((uint32_t)(-n)) << 1) - 1 : ((uint32_t) n) << 1;
@@ -266,9 +506,13 @@ static void _packU64( UBuffer* bin, uint64_t n )
 #define packS64(N)  _packU64( bin, _zigZag64(N) )
 
 /*
+  If cellIndex is not zero then the offset of every INDEX_STRIDE cell is
+  appended to it.
+
   Return zero if successful or unknown data type.
 */
-static int _serializeBlock( Serializer* ser, UBuffer* bin, const UBuffer* blk )
+static int _serializeBlock( Serializer* ser, UBuffer* bin, const UBuffer* blk,
+                            UBuffer* cellIndex )
 {
     UBlockIter bi;
 
@@ -279,6 +523,9 @@ static int _serializeBlock( Serializer* ser, UBuffer* bin, const UBuffer* blk )
     {
         int type = ur_type(bi.it);
 
+        if( cellIndex && ! ((bi.it - blk->ptr.cell) % INDEX_STRIDE) )
+            ur_arrAppendInt32( cellIndex, bin->used );
+
         ur_binReserve( bin, bin->used + 12 );
         push8( type | ur_flags(bi.it, UR_FLAG_SOL) );
 
@@ -431,281 +678,894 @@ static int _serializeBlock( Serializer* ser, UBuffer* bin, const UBuffer* blk )
 
 
 #ifdef __BIG_ENDIAN__
-static void _binAppendSwap2( UBuffer* bin, uint16_t* it, int count )
+#if defined(__GNUC__) || defined(__clang__)
+#define _bswap16(n)     __builtin_bswap16(n)
+#define _bswap32(n)     __builtin_bswap32(n)
+#define _bswap64(n)     __builtin_bswap64(n)
+#else
+static inline uint16_t _bswap16( uint16_t n )
 {
-    uint8_t* dest;
-    uint16_t* end = it + count;
-    int size = count * 2;
+    return (n << 8) | (n >> 8);
+}
 
-    ur_binReserve( bin, bin->used + size );
-    dest = bin->ptr.b + bin->used;
-    bin->used += size;
-    while( it != end )
+static inline uint32_t _bswap32( uint32_t n )
+{
+    return (((uint32_t) _bswap16( n )) << 16) | _bswap16( n >> 16 );
+}
+
+static inline uint64_t _bswap64( uint64_t n )
+{
+    return (((uint64_t) _bswap32( n )) << 32) | _bswap32( n >> 32 );
+}
+#endif
+
+
+/*
+  Copy count elements from src to dest, reversing the byte order of each.
+  Each element is loaded whole before it is stored, so dest may equal src
+  and compilers can vectorize the loops.
+*/
+static inline void _swap16( uint8_t* dest, const uint8_t* src, uint32_t count )
+{
+    const uint8_t* end = src + count * 2;
+    uint16_t n;
+    for( ; src != end; src += 2, dest += 2 )
     {
-        *dest++ = *it >> 8;
-        *dest++ = *it++;
+        memCpy( &n, src, 2 );
+        n = _bswap16( n );
+        memCpy( dest, &n, 2 );
     }
 }
 
+static inline void _swap32( uint8_t* dest, const uint8_t* src, uint32_t count )
+{
+    const uint8_t* end = src + count * 4;
+    uint32_t n;
+    for( ; src != end; src += 4, dest += 4 )
+    {
+        memCpy( &n, src, 4 );
+        n = _bswap32( n );
+        memCpy( dest, &n, 4 );
+    }
+}
 
-static void _binAppendSwap4( UBuffer* bin, uint32_t* it, int count )
+static inline void _swap64( uint8_t* dest, const uint8_t* src, uint32_t count )
 {
-    uint8_t* dest;
-    uint32_t* end = it + count;
-    int size = count * 4;
+    const uint8_t* end = src + count * 8;
+    uint64_t n;
+    for( ; src != end; src += 8, dest += 8 )
+    {
+        memCpy( &n, src, 8 );
+        n = _bswap64( n );
+        memCpy( dest, &n, 8 );
+    }
+}
 
-    ur_binReserve( bin, bin->used + size );
-    dest = bin->ptr.b + bin->used;
-    bin->used += size;
-    while( it != end )
+
+/*
+  Copy count elements of elemSize bytes from src to dest, reversing the
+  byte order of each.  Serialized data is little-endian so this is only
+  used on big-endian systems.
+*/
+static void _memCpySwap( uint8_t* dest, const uint8_t* src, uint32_t count,
+                         int elemSize )
+{
+    switch( elemSize )
     {
-        *dest++ = *it >> 24;
-        *dest++ = *it >> 16;
-        *dest++ = *it >> 8;
-        *dest++ = *it++;
+        case 2:
+            _swap16( dest, src, count );
+            break;
+        case 4:
+            _swap32( dest, src, count );
+            break;
+        case 8:
+            _swap64( dest, src, count );
+            break;
+        default:
+            if( dest != src )
+                memMove( dest, src, count * elemSize );
+            break;
     }
 }
 
 
-static void _memCpySwap2(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
+static void _binAppendSwap( UBuffer* bin, const UBuffer* buf )
+{
+    int size = buf->used * buf->elemSize;
+
+    ur_binReserve( bin, bin->used + size );
+    _memCpySwap( bin->ptr.b + bin->used, buf->ptr.b, buf->used,
+                 buf->elemSize );
+    bin->used += size;
+}
+#endif
+
+
+/*
+  Return the byte size of the data for a binary, bitset, string, file, or
+  vector buffer which is stored without byte swapping, or -1 for any other
+  buffer.
+*/
+static int _payloadSize( const UBuffer* buf )
 {
-    while( elemCount-- )
+    switch( buf->type )
     {
-        *dest++ = src[1];
-        *dest++ = src[0];
-        src += 2;
+        case UT_BINARY:
+        case UT_BITSET:
+            return buf->used;
+        case UT_STRING:
+        case UT_FILE:
+        case UT_VECTOR:
+#ifdef __BIG_ENDIAN__
+            if( buf->elemSize > 1 )
+                return -1;
+#endif
+            return buf->used * buf->elemSize;
     }
+    return -1;
 }
 
 
-static void _memCpySwap4(uint8_t* dest, const uint8_t* src, uint32_t elemCount)
+#ifdef SERIAL_DEFLATE
+/*
+  Append a BUF_DEFLATE entry for a large payload buffer.
+  Return zero if the buffer is not compressed.
+*/
+static int _deflateBuffer( UBuffer* bin, const UBuffer* buf )
 {
-    while( elemCount-- )
+    uLongf zlen;
+    UIndex start = bin->used;
+    UIndex lenPos;
+    int size = _payloadSize( buf );
+
+    if( size < DEFLATE_MIN )
+        return 0;
+
+    zlen = compressBound( size );
+    ur_binReserve( bin, bin->used + 12 + zlen );
+    push8( BUF_DEFLATE );
+    push8( buf->type );
+    if( buf->type == UT_BITSET )
+        push8( 0 );             // Storage format.
+    else if( buf->type != UT_BINARY )
+        push8( buf->form );
+    packU32( buf->used );
+    lenPos = bin->used;
+    bin->used += 4;
+
+    if( compress( bin->ptr.b + bin->used, &zlen, buf->ptr.b, size ) != Z_OK ||
+        zlen + 8 >= (uLongf) size )
     {
-        *dest++ = src[3];
-        *dest++ = src[2];
-        *dest++ = src[1];
-        *dest++ = src[0];
-        src += 4;
+        bin->used = start;
+        return 0;
     }
+    _pokeU32( bin->ptr.b + lenPos, zlen );
+    bin->used += zlen;
+    return 1;
 }
 #endif
 
 
-/**
-  Serialize block.
+#define ENC_BAD_BUFFER  0x100   // Error code flag for invalid buffer type.
+#define ENC_BAD_CELL    0x200   // Error code flag for invalid cell type.
 
-  \param  blkN  Index to valid block buffer.
-  \param  res   Cell to be set to new output binary.
+/*
+  Append buffer entry i of ser->bufMap to bin.
+  If cellIndex is not zero then offsets of the first block cells are
+  appended to it.
 
-  \return UR_OK/UR_THROW
+  This does not modify the thread, so it can be called from other threads
+  while the owner waits.
+
+  Return zero if successful or an ENC_BAD_BUFFER/ENC_BAD_CELL code ORed
+  with the invalid type.
 */
-UStatus ur_serialize( UThread* ut, UIndex blkN, UCell* res )
+static int _encodeBuffer( UThread* ut, Serializer* ser, UBuffer* bin,
+                          int i, UBuffer* cellIndex )
 {
-    Serializer ser;
-    UBuffer* bin;
-    UStatus ok = UR_OK;
+    const BufferIndex* it = ((BufferIndex*) ser->bufMap.ptr.v) + i;
+    const UBuffer* buf;
     int btype;
+    int dup;
 
-    ur_arrInit( &ser.atomMap, sizeof(UAtom), 0 );
-    ur_arrInit( &ser.bufMap, sizeof(BufferIndex), 0 );
-    ur_arrInit( &ser.ctxAtoms, sizeof(UAtom), 0 );
-
-    bin = ur_makeBinaryCell( ut, 256, res );
-    ur_binAppendData( bin, (const uint8_t*) "BOR2", 4 );
-    _pushU32( bin, 0 );     // Reserve atoms offset.
-    _pushU32( bin, 0 );     // Reserve buffer count.
-    _mapBuffer( &ser, blkN );
+    ur_binReserve( bin, bin->used + 7 );
 
+    if( ur_isShared( it->bufN ) && (ser->opt & UR_SERIAL_SHARED) && i )
     {
-        const BufferIndex* it;
-        const UBuffer* buf;
-        int i;
+        push8( BUF_SHARED );
+        packU32( -it->bufN );
+        return 0;
+    }
 
-        // NOTE: ser.bufMap changes inside the loop as new buffers are seen.
+    buf = ur_bufferE( it->bufN );
 
-        for( i = 0; i < ser.bufMap.used; ++i )
-        {
-            it = ((BufferIndex*) ser.bufMap.ptr.v) + i;
-            buf = ur_bufferE( it->bufN );
+    if( (ser->opt & UR_SERIAL_DEDUPE) && (dup = _dedupe( ut, ser, buf, i )) )
+    {
+        push8( BUF_DUP );
+        packU32( dup - 1 );
+        return 0;
+    }
 
-            ur_binReserve( bin, bin->used + 7 );
+#ifdef SERIAL_DEFLATE
+    if( (ser->opt & UR_SERIAL_COMPRESS) && _deflateBuffer( bin, buf ) )
+        return 0;
+#endif
 
-            switch( buf->type )
-            {
-            case UT_BINARY:
-                push8( buf->type );
+    switch( buf->type )
+    {
+    case UT_BINARY:
+        push8( buf->type );
 pack_binary:
-                packU32( buf->used );
-                if( buf->used )
-                    ur_binAppendData( bin, buf->ptr.b, buf->used );
-                break;
-
-            case UT_BITSET:
-                push8( UT_BITSET );
-                push8( 0 );             // Storage format.
-                goto pack_binary;
-
-            case UT_STRING:
-            case UT_FILE:
-            case UT_VECTOR:
-                push8( buf->type );
-                push8( buf->form );
-                packU32( buf->used );
-                if( buf->used )
-                {
+        packU32( buf->used );
+        if( buf->used )
+            ur_binAppendData( bin, buf->ptr.b, buf->used );
+        break;
+
+    case UT_BITSET:
+        push8( UT_BITSET );
+        push8( 0 );             // Storage format.
+        goto pack_binary;
+
+    case UT_STRING:
+    case UT_FILE:
+    case UT_VECTOR:
+        push8( buf->type );
+        push8( buf->form );
+        packU32( buf->used );
+        if( buf->used )
+        {
 #ifdef __BIG_ENDIAN__
-                    switch( buf->elemSize )
-                    {
-                        case 2:
-                            _binAppendSwap2( bin, buf->ptr.u16, buf->used );
-                            break;
-                        case 4:
-                            _binAppendSwap4( bin, buf->ptr.u32, buf->used );
-                            break;
-                        default:
-                            ur_binAppendData( bin, buf->ptr.b,
-                                              buf->elemSize * buf->used );
-                            break;
-                    }
+            _binAppendSwap( bin, buf );
 #else
-                    ur_binAppendData( bin, buf->ptr.b,
-                                      buf->elemSize * buf->used );
+            ur_binAppendData( bin, buf->ptr.b,
+                              buf->elemSize * buf->used );
 #endif
-                }
-                break;
-
-            case UT_BLOCK:
-            case UT_PAREN:
-            case UT_PATH:
-            case UT_LITPATH:
-            case UT_SETPATH:
-                push8( buf->type );
-                packU32( buf->used );
-                if( buf->used )
-                {
-                    if( (btype = _serializeBlock( &ser, bin, buf )) )
-                        goto bad_type;
-                }
-                break;
+        }
+        break;
+
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+        push8( buf->type );
+        packU32( buf->used );
+        if( buf->used )
+        {
+            if( (btype = _serializeBlock( ser, bin, buf, i ? 0 : cellIndex )) )
+                goto bad_type;
+        }
+        break;
 
-            case UT_CONTEXT:
-                push8( buf->type );
-                packU32( buf->used );
-                if( buf->used )
-                {
-                    // Words
-                    int ai;
-                    ur_binReserve( bin, bin->used + (buf->used * 3) );
-                    ur_arrReserve( &ser.ctxAtoms, buf->used );
-                    ur_ctxWordAtoms( buf, ser.ctxAtoms.ptr.u16 );
-                    for( ai = 0; ai < buf->used; ++ai )
-                        packU32( _mapAtom( &ser, ser.ctxAtoms.ptr.u16[ai] ) );
-
-                    // Values
-                    if( (btype = _serializeBlock( &ser, bin, buf )) )
-                        goto bad_type;
-                }
-                break;
+    case UT_CONTEXT:
+        push8( buf->type );
+        packU32( buf->used );
+        if( buf->used )
+        {
+            // Words
+            int ai;
+            ur_binReserve( bin, bin->used + (buf->used * 3) );
+            ur_arrReserve( &ser->ctxAtoms, buf->used );
+            ur_ctxWordAtoms( buf, ser->ctxAtoms.ptr.u16 );
+            for( ai = 0; ai < buf->used; ++ai )
+                packU32( _mapAtom( ser, ser->ctxAtoms.ptr.u16[ai] ) );
+
+            // Values
+            if( (btype = _serializeBlock( ser, bin, buf, 0 )) )
+                goto bad_type;
+        }
+        break;
 
 #ifdef CONFIG_HASHMAP
-            case UT_HASHMAP:
-            {
-                // NOTE: Assuming value index always preceeds map index.
-                int valueIndex = it - ((BufferIndex*) ser.bufMap.ptr.v) - 1;
+    case UT_HASHMAP:
+    {
+        // NOTE: Assuming value index always preceeds map index.
+        int valueIndex = i - 1;
 
-                push8( buf->type );
-                packU32( valueIndex );
-            }
-                break;
+        push8( buf->type );
+        packU32( valueIndex );
+    }
+        break;
 #endif
 
-            default:
-                ok = ur_error( ut, UR_ERR_SCRIPT,
-                        "Invalid serialized buffer type (%d)", buf->type );
-                goto cleanup;
-            }
-        }
+    default:
+        return ENC_BAD_BUFFER | buf->type;
     }
+    return 0;
 
-    if( ser.atomMap.used )
-    {
-        const UAtom* it  = ser.atomMap.ptr.u16;
-        const UAtom* end = it + ser.atomMap.used;
-        const char* str;
-#define replaceLast(B,C)  B->ptr.b[ B->used - 1 ] = C
-
-        _pokeU32( bin->ptr.b + 4, bin->used );      // Atoms offset.
-        while( it != end )
-        {
-            str = ur_atomCStr( ut, *it++ );
-            ur_binAppendData( bin, (const uint8_t*) str, strLen(str) + 1 );
-            replaceLast( bin, ' ' );
-        }
-        replaceLast( bin, '\0' );
-    }
+bad_type:
 
-    _pokeU32( bin->ptr.b + 8, ser.bufMap.used );    // Buffer count.
+    return ENC_BAD_CELL | btype;
+}
 
-cleanup:
 
-    ur_arrFree( &ser.atomMap );
-    ur_arrFree( &ser.bufMap );
-    ur_arrFree( &ser.ctxAtoms );
-    return ok;
+static UStatus _encodeError( UThread* ut, int code )
+{
+    if( code & ENC_BAD_CELL )
+        return ur_error( ut, UR_ERR_SCRIPT, "Cannot serialize data type %d",
+                         code & 0xff );
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized buffer type (%d)",
+                     code & 0xff );
+}
 
-bad_type:
 
-    ok = ur_error( ut, UR_ERR_SCRIPT, "Cannot serialize data type %d", btype );
-    goto cleanup;
+static UStatus _serializeBuffer( UThread* ut, Serializer* ser, UBuffer* bin,
+                                 int i, UBuffer* cellIndex )
+{
+    int code = _encodeBuffer( ut, ser, bin, i, cellIndex );
+    return code ? _encodeError( ut, code ) : UR_OK;
 }
 
 
-/*--------------------------------------------------------------------------*/
+static void _appendIndex( UBuffer* bin, const UBuffer* bufIndex,
+                          const UBuffer* cellIndex )
+{
+    const uint32_t* it;
+    const uint32_t* end;
+    uint32_t start = bin->used;
 
+    ur_binReserve( bin, bin->used + 24 +
+                        (bufIndex->used + cellIndex->used) * 4 );
+    ur_binAppendData( bin, (const uint8_t*) "BIDX", 4 );
 
-typedef struct
-{
-    const uint8_t* it;
-    const uint8_t* end;
+    _pushU32( bin, bufIndex->used );
+    it  = bufIndex->ptr.u32;
+    end = it + bufIndex->used;
+    while( it != end )
+        _pushU32( bin, *it++ );
+
+    _pushU32( bin, INDEX_STRIDE );
+    _pushU32( bin, cellIndex->used );
+    it  = cellIndex->ptr.u32;
+    end = it + cellIndex->used;
+    while( it != end )
+        _pushU32( bin, *it++ );
+
+    _pushU32( bin, start );
+    ur_binAppendData( bin, (const uint8_t*) "BIDX", 4 );
 }
-BinaryIter;
 
 
-static uint32_t _pullU32( BinaryIter* bi )
+#define replaceLast(B,C)  B->ptr.b[ B->used - 1 ] = C
+
+/*
+  Append atoms string & set the atoms offset in the header.
+*/
+static void _appendAtoms( UThread* ut, UBuffer* bin, const UBuffer* atomMap )
 {
-    uint32_t n;
-    n = (bi->it[0] << 24) | (bi->it[1] << 16) | (bi->it[2] << 8) | bi->it[3];
-    bi->it += 4;
-    return n;
+    const UAtom* it  = atomMap->ptr.u16;
+    const UAtom* end = it + atomMap->used;
+    const char* str;
+
+    _pokeU32( bin->ptr.b + 4, bin->used );      // Atoms offset.
+    while( it != end )
+    {
+        str = ur_atomCStr( ut, *it++ );
+        ur_binAppendData( bin, (const uint8_t*) str, strLen(str) + 1 );
+        replaceLast( bin, ' ' );
+    }
+    replaceLast( bin, '\0' );
 }
 
 
-static void _pullU64( BinaryIter* bi, uint64_t* dest )
+static void _appendHeader( UBuffer* bin, int opt )
 {
-#ifdef __BIG_ENDIAN__
-    const uint8_t* bp = bi->it;
-    uint8_t* dp = (uint8_t*) dest;
-    *dp++ = bp[7];
-    *dp++ = bp[6];
-    *dp++ = bp[5];
-    *dp++ = bp[4];
-    *dp++ = bp[3];
-    *dp++ = bp[2];
-    *dp++ = bp[1];
-    *dp   = bp[0];
+#ifdef SERIAL_DEFLATE
+    if( opt & UR_SERIAL_COMPRESS )
+        ur_binAppendData( bin, (const uint8_t*) "BORZ", 4 );
+    else
 #else
-    memCpy( dest, bi->it, 8 );
+    (void) opt;
 #endif
-    bi->it += 8;
+    ur_binAppendData( bin, (const uint8_t*) "BOR2", 4 );
+    _pushU32( bin, 0 );     // Reserve atoms offset.
+    _pushU32( bin, 0 );     // Reserve buffer count.
 }
 
 
-static uint32_t _unpackU32( BinaryIter* bi )
+#ifdef CONFIG_THREAD
+#define GROUP_MIN_CELLS     256 // Smallest block encoded as a group.
+#define GROUP_THREAD_MAX    16
+
+typedef struct
 {
-    uint32_t n = bi->it[0];
-    int pack = n & PACK_ANY;
-    if( pack )
+    Serializer ser;
+    UBuffer bin;        // Group entries.
+    UIndex blkN;
+    UIndex index;       // Main bufMap index of blkN.
+    UIndex pos;         // Offset in main entries where group is inserted.
+    int code;           // _encodeBuffer() error.
+}
+SerialGroup;
+
+typedef struct
+{
+    UThread* ut;
+    SerialGroup* groups;
+    int count;
+    int next;
+    OSMutex mutex;
+}
+SerialWork;
+
+
+/*
+  Encode groups until there are none left.
+*/
+static void _encodeGroups( SerialWork* work )
+{
+    SerialGroup* grp;
+    int i;
+
+    while( 1 )
+    {
+        mutexLock( work->mutex );
+        i = work->next++;
+        mutexUnlock( work->mutex );
+        if( i >= work->count )
+            break;
+
+        // The group bufMap was filled by _mapRefs().
+        grp = work->groups + i;
+        for( i = 0; i < grp->ser.bufMap.used; ++i )
+        {
+            grp->code = _encodeBuffer( work->ut, &grp->ser, &grp->bin, i, 0 );
+            if( grp->code )
+                break;
+        }
+    }
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI _encodeThread( LPVOID arg )
+#else
+static void* _encodeThread( void* arg )
+#endif
+{
+    _encodeGroups( (SerialWork*) arg );
+    return 0;
+}
+
+
+static int _cpuCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+    return si.dwNumberOfProcessors;
+#else
+    return sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+}
+
+
+/*
+  Add the buffers referenced by the bufMap entries to the map, in the same
+  order that _encodeBuffer() would.  The entries of any groups (which must
+  be ordered by index) are not followed.
+*/
+static void _mapRefs( UThread* ut, Serializer* ser,
+                      const SerialGroup* grp, int count )
+{
+    const UBuffer* buf;
+    const UCell* it;
+    const UCell* end;
+    int i;
+
+    // NOTE: bufMap changes inside the loop as new buffers are seen.
+
+    for( i = 0; i < ser->bufMap.used; ++i )
+    {
+        if( count && grp->index == i )
+        {
+            ++grp;
+            --count;
+            continue;
+        }
+        buf = ur_bufferE( ((const BufferIndex*) ser->bufMap.ptr.v)[ i ].bufN );
+        if( ! ur_isBlockType( buf->type ) && buf->type != UT_CONTEXT )
+            continue;
+
+        it  = buf->ptr.cell;
+        end = it + buf->used;
+        for( ; it != end; ++it )
+        {
+            switch( ur_type(it) )
+            {
+            case UT_WORD:
+            case UT_LITWORD:
+            case UT_SETWORD:
+            case UT_GETWORD:
+            case UT_OPTION:
+                if( (ur_binding(it) == UR_BIND_THREAD ||
+                     ur_binding(it) == UR_BIND_ENV) &&
+                    (it->word.ctx > UR_MAIN_CONTEXT ||
+                     it->word.ctx < -UR_MAIN_CONTEXT) )
+                    _mapBuffer( ser, it->word.ctx );
+                break;
+
+            case UT_BINARY:
+            case UT_STRING:
+            case UT_FILE:
+            case UT_VECTOR:
+            case UT_BLOCK:
+            case UT_PAREN:
+            case UT_PATH:
+            case UT_LITPATH:
+            case UT_SETPATH:
+                _mapBuffer( ser, it->series.buf );
+                break;
+
+            case UT_BITSET:
+            case UT_CONTEXT:
+                _mapBuffer( ser, it->context.buf );
+                break;
+
+#ifdef CONFIG_HASHMAP
+            case UT_HASHMAP:
+                _mapBuffer( ser, it->series.it );
+                _mapBuffer( ser, it->series.buf );
+                break;
+#endif
+            }
+        }
+    }
+}
+
+
+/*
+  Return non-zero if no buffer is in more than one group or in both a group
+  and the main entries.
+*/
+static int _groupsDisjoint( const Serializer* ser, const SerialGroup* grp,
+                            int count )
+{
+    Serializer all;
+    const BufferIndex* it;
+    const BufferIndex* end;
+    int used;
+    int ok = 1;
+
+    _serInit( &all, 0 );
+    it  = (const BufferIndex*) ser->bufMap.ptr.v;
+    end = it + ser->bufMap.used;
+    for( ; it != end; ++it )
+        _mapBuffer( &all, it->bufN );
+
+    for( ; count && ok; --count, ++grp )
+    {
+        it  = ((const BufferIndex*) grp->ser.bufMap.ptr.v) + 1;
+        end = it + grp->ser.bufMap.used - 1;
+        for( ; it != end; ++it )
+        {
+            used = all.bufMap.used;
+            if( _mapBuffer( &all, it->bufN ) < used )
+            {
+                ok = 0;
+                break;
+            }
+        }
+    }
+
+    _serFree( &all );
+    return ok;
+}
+
+
+/*
+  Serialize with groups of buffers encoded by multiple threads.
+
+  Return UR_OK/UR_THROW, or -1 if there are not enough disjoint groups and
+  the data should be serialized normally.
+*/
+static int _serializeParallel( UThread* ut, UIndex blkN, int opt, UCell* res )
+{
+    Serializer ser;
+    SerialWork work;
+    SerialGroup* grp;
+    UBuffer groups;
+    UBuffer entries;
+    UBuffer* gbuf = &groups;
+    UBuffer* bin;
+    OSThread thread[ GROUP_THREAD_MAX ];
+    const UBuffer* buf;
+    UIndex bufN;
+    UIndex base;
+    UIndex prev;
+    int threadCount = 0;
+    int size;
+    int code;
+    int ok = -1;
+    int i;
+    int g;
+
+    _serInit( &ser, opt );
+    ur_binInit( &entries, 256 );
+    ur_arrInit( &groups, sizeof(SerialGroup), 0 );
+
+    _mapBuffer( &ser, blkN );
+    if( (code = _encodeBuffer( ut, &ser, &entries, 0, 0 )) )
+    {
+        ok = _encodeError( ut, code );
+        goto cleanup;
+    }
+
+    // Large blocks referenced by the root block become groups.
+    for( i = 1; i < ser.bufMap.used; ++i )
+    {
+        bufN = ((const BufferIndex*) ser.bufMap.ptr.v)[ i ].bufN;
+        buf = ur_bufferE( bufN );
+        if( (buf->type == UT_BLOCK || buf->type == UT_PAREN) &&
+            buf->used >= GROUP_MIN_CELLS )
+        {
+            ur_arrExpand1( SerialGroup, gbuf, grp );
+            _serInit( &grp->ser, opt );
+            ur_binInit( &grp->bin, 0 );
+            grp->blkN  = bufN;
+            grp->index = i;
+            grp->code  = 0;
+        }
+    }
+    if( groups.used < 2 )
+        goto cleanup;
+
+    // Map all the buffers first so that shared buffers are found before
+    // any work is done.
+    grp = (SerialGroup*) groups.ptr.v;
+    _mapRefs( ut, &ser, grp, groups.used );
+    for( g = 0; g < groups.used; ++g )
+    {
+        _mapBuffer( &grp[ g ].ser, grp[ g ].blkN );
+        _mapRefs( ut, &grp[ g ].ser, NULL, 0 );
+    }
+    if( ! _groupsDisjoint( &ser, grp, groups.used ) ||
+        mutexInitF( work.mutex ) )
+        goto cleanup;
+
+    work.ut     = ut;
+    work.groups = (SerialGroup*) groups.ptr.v;
+    work.count  = groups.used;
+    work.next   = 0;
+
+    size = _cpuCount() - 1;
+    if( size > GROUP_THREAD_MAX )
+        size = GROUP_THREAD_MAX;
+    if( size > work.count - 1 )
+        size = work.count - 1;
+    for( ; threadCount < size; ++threadCount )
+    {
+#ifdef _WIN32
+        DWORD winId;
+        thread[ threadCount ] = CreateThread( NULL, 0, _encodeThread, &work,
+                                              0, &winId );
+        if( thread[ threadCount ] == NULL )
+#else
+        if( pthread_create( thread + threadCount, 0, _encodeThread, &work ) )
+#endif
+            break;
+    }
+
+    // Encode the main entries (leaving room for the groups) & then help
+    // with the groups.
+
+    grp = work.groups;
+    g = 0;
+    for( i = 1; i < ser.bufMap.used; ++i )
+    {
+        if( g < work.count && grp[ g ].index == i )
+        {
+            grp[ g++ ].pos = entries.used;
+            continue;
+        }
+        if( (code = _encodeBuffer( ut, &ser, &entries, i, 0 )) )
+            break;
+    }
+    _encodeGroups( &work );
+
+    for( i = 0; i < threadCount; ++i )
+    {
+#ifdef _WIN32
+        WaitForSingleObject( thread[ i ], INFINITE );
+        CloseHandle( thread[ i ] );
+#else
+        pthread_join( thread[ i ], NULL );
+#endif
+    }
+    mutexFree( work.mutex );
+
+    for( g = 0; ! code && g < work.count; ++g )
+        code = grp[ g ].code;
+    if( code )
+    {
+        ok = _encodeError( ut, code );
+        goto cleanup;
+    }
+
+    // Join the main entries & groups.
+
+    size = entries.used + 64;
+    for( g = 0; g < work.count; ++g )
+        size += grp[ g ].bin.used + 16 + grp[ g ].ser.atomMap.used * 3;
+    bin = ur_makeBinaryCell( ut, size, res );
+    _appendHeader( bin, opt );
+
+    base = ser.bufMap.used;
+    prev = 0;
+    for( g = 0; g < work.count; ++g, ++grp )
+    {
+        const UAtom* it  = grp->ser.atomMap.ptr.u16;
+        const UAtom* end = it + grp->ser.atomMap.used;
+
+        ur_binAppendData( bin, entries.ptr.b + prev, grp->pos - prev );
+        prev = grp->pos;
+
+        ur_binReserve( bin, bin->used + 16 + (end - it) * 5 );
+        push8( BUF_GROUP );
+        packU32( base );
+        packU32( grp->ser.bufMap.used );
+        packU32( end - it );
+        for( ; it != end; ++it )
+            packU32( _mapAtom( &ser, *it ) );
+        ur_binAppendData( bin, grp->bin.ptr.b, grp->bin.used );
+
+        base += grp->ser.bufMap.used - 1;
+    }
+    ur_binAppendData( bin, entries.ptr.b + prev, entries.used - prev );
+
+    if( ser.atomMap.used )
+        _appendAtoms( ut, bin, &ser.atomMap );
+    _pokeU32( bin->ptr.b + 8, base );               // Buffer count.
+    ok = UR_OK;
+
+cleanup:
+
+    grp = (SerialGroup*) groups.ptr.v;
+    for( g = 0; g < groups.used; ++g, ++grp )
+    {
+        _serFree( &grp->ser );
+        ur_binFree( &grp->bin );
+    }
+    ur_arrFree( &groups );
+    ur_binFree( &entries );
+    _serFree( &ser );
+    return ok;
+}
+#endif
+
+
+/**
+  Serialize block.
+
+  \param  blkN  Index to valid block buffer.
+  \param  res   Cell to be set to new output binary.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_serialize( UThread* ut, UIndex blkN, UCell* res )
+{
+    return ur_serializeOpt( ut, blkN, 0, res );
+}
+
+
+/**
+  Serialize block with options.
+
+  With UR_SERIAL_PARALLEL, large blocks referenced by blkN are encoded by
+  multiple threads.  If there are fewer than two such blocks, or they
+  share any buffers, then the data is serialized normally.  This option is
+  ignored with UR_SERIAL_SHARED or UR_SERIAL_INDEX.
+
+  \param  blkN  Index to valid block buffer.
+  \param  opt   Mask of UrlanSerializeOption values.
+  \param  res   Cell to be set to new output binary.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_serializeOpt( UThread* ut, UIndex blkN, int opt, UCell* res )
+{
+    Serializer ser;
+    UBuffer* bin;
+    UBuffer bufIndex;
+    UBuffer cellIndex;
+    UStatus ok = UR_OK;
+    int index = opt & UR_SERIAL_INDEX;
+
+#ifdef CONFIG_THREAD
+    if( (opt & UR_SERIAL_PARALLEL) &&
+        ! (opt & (UR_SERIAL_SHARED | UR_SERIAL_INDEX)) )
+    {
+        int pok = _serializeParallel( ut, blkN, opt, res );
+        if( pok >= 0 )
+            return (UStatus) pok;
+    }
+#endif
+
+    _serInit( &ser, opt );
+    ur_arrInit( &bufIndex, sizeof(uint32_t), 0 );
+    ur_arrInit( &cellIndex, sizeof(uint32_t), 0 );
+
+    bin = ur_makeBinaryCell( ut, 256, res );
+    _appendHeader( bin, opt );
+    _mapBuffer( &ser, blkN );
+
+    {
+        int i;
+
+        // NOTE: ser.bufMap changes inside the loop as new buffers are seen.
+
+        for( i = 0; i < ser.bufMap.used; ++i )
+        {
+            if( index )
+                ur_arrAppendInt32( &bufIndex, bin->used );
+            if( ! (ok = _serializeBuffer( ut, &ser, bin, i,
+                                          index ? &cellIndex : 0 )) )
+                goto cleanup;
+        }
+    }
+
+    if( ser.atomMap.used )
+        _appendAtoms( ut, bin, &ser.atomMap );
+
+    _pokeU32( bin->ptr.b + 8, ser.bufMap.used );    // Buffer count.
+
+    if( index )
+        _appendIndex( bin, &bufIndex, &cellIndex );
+
+cleanup:
+
+    _serFree( &ser );
+    ur_arrFree( &bufIndex );
+    ur_arrFree( &cellIndex );
+    return ok;
+}
+
+
+/*--------------------------------------------------------------------------*/
+
+
+typedef struct
+{
+    const uint8_t* it;
+    const uint8_t* end;
+}
+BinaryIter;
+
+
+static uint32_t _pullU32( BinaryIter* bi )
+{
+    uint32_t n;
+    n = (bi->it[0] << 24) | (bi->it[1] << 16) | (bi->it[2] << 8) | bi->it[3];
+    bi->it += 4;
+    return n;
+}
+
+
+static void _pullU64( BinaryIter* bi, uint64_t* dest )
+{
+#ifdef __BIG_ENDIAN__
+    const uint8_t* bp = bi->it;
+    uint8_t* dp = (uint8_t*) dest;
+    *dp++ = bp[7];
+    *dp++ = bp[6];
+    *dp++ = bp[5];
+    *dp++ = bp[4];
+    *dp++ = bp[3];
+    *dp++ = bp[2];
+    *dp++ = bp[1];
+    *dp   = bp[0];
+#else
+    memCpy( dest, bi->it, 8 );
+#endif
+    bi->it += 8;
+}
+
+
+static uint32_t _unpackU32( BinaryIter* bi )
+{
+    uint32_t n = bi->it[0];
+    int pack = n & PACK_ANY;
+    if( pack )
     {
         if( pack == PACK_2 )
         {
@@ -763,7 +1623,7 @@ static uint64_t _unpackU64( BinaryIter* bi )
 /*
   Returns non-zero if successful
 */
-static int _unserializeBlock( UAtom* atoms, UIndex* ids,
+static int _unserializeBlock( const UAtom* atoms, const UIndex* ids,
                               BinaryIter* bi, UBuffer* blk )
 {
     UCell* cell = blk->ptr.cell;
@@ -931,226 +1791,1419 @@ static int _unserializeBlock( UAtom* atoms, UIndex* ids,
 }
 
 
-int ur_serializedHeader( const uint8_t* data, int len )
+/*
+  Shared buffer entries follow the blocks which reference them, so those
+  references are first set to a placeholder buffer (type UT_UNSET and used
+  holding the shared index) and then replaced here.
+*/
+#define SHARED_SLOT(N) \
+    { const UBuffer* sb = ur_buffer(N); \
+      if( sb->type == UT_UNSET ) N = -sb->used; }
+
+static void _resolveSharedCell( UThread* ut, UCell* cell )
+{
+    switch( ur_type(cell) )
+    {
+    case UT_WORD:
+    case UT_LITWORD:
+    case UT_SETWORD:
+    case UT_GETWORD:
+    case UT_OPTION:
+        if( ur_binding(cell) == UR_BIND_THREAD )
+        {
+            SHARED_SLOT( cell->word.ctx );
+            if( ur_isShared( cell->word.ctx ) )
+                ur_binding(cell) = UR_BIND_ENV;
+        }
+        break;
+
+    case UT_BINARY:
+    case UT_STRING:
+    case UT_FILE:
+    case UT_VECTOR:
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+    case UT_BITSET:
+    case UT_CONTEXT:
+        SHARED_SLOT( cell->series.buf );
+        break;
+
+#ifdef CONFIG_HASHMAP
+    case UT_HASHMAP:
+        SHARED_SLOT( cell->series.buf );
+        SHARED_SLOT( cell->series.it );
+        break;
+#endif
+    }
+}
+
+
+static void _resolveShared( UThread* ut, const UIndex* ids, int count )
+{
+    UBuffer* buf;
+    UCell* cell;
+    UCell* end;
+    int i;
+
+    for( i = 0; i < count; ++i )
+    {
+        if( ur_isShared( ids[i] ) )
+            continue;
+        buf = ur_buffer( ids[i] );
+        if( ! ur_isBlockType( buf->type ) && buf->type != UT_CONTEXT )
+            continue;
+
+        cell = buf->ptr.cell;
+        end  = cell + buf->used;
+        for( ; cell != end; ++cell )
+            _resolveSharedCell( ut, cell );
+    }
+}
+
+
+/*
+  Set buffer to reference its data in the image rather than a copy.
+  Return zero if the data is not aligned for the buffer elements.
+*/
+static int _borrowData( UBuffer* buf, BinaryIter* bi, int used, int elemSize )
+{
+    int size = used * elemSize;
+    if( (((size_t) bi->it) & (elemSize - 1)) || size > bi->end - bi->it )
+        return 0;
+    buf->ptr.b = (uint8_t*) bi->it;
+    buf->used  = used;
+    buf->flags |= UR_BUF_BORROWED;
+    bi->it += size;
+    return 1;
+}
+
+
+int ur_serializedHeader( const uint8_t* data, int len )
 {
     if( len > 12 )
     {
-        return data[0] == 'B' && data[1] == 'O' && data[2] == 'R' &&
-               data[3] == '2' && data[12] == UT_BLOCK;
+        return data[0] == 'B' && data[1] == 'O' && data[2] == 'R' &&
+               (data[3] == '2' || data[3] == 'Z') && data[12] == UT_BLOCK;
+    }
+    return 0;
+}
+
+
+/**
+  Unserialize binary.
+
+  \param  start     Pointer to serialized binary.
+  \param  end       Pointer to end of binary.
+  \param  res       Cell to be set to new output block.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
+                        UCell* res )
+{
+    return ur_unserializeOpt( ut, start, end, 0, res );
+}
+
+
+typedef struct
+{
+    const UAtom* atoms;
+    UIndex* ids;
+    void* image;
+    int opt;
+    int borrowed;
+    int sharedCount;
+}
+Unserializer;
+
+
+/*
+  Initialize buffer to hold used elements of a binary, bitset, string, or
+  vector.  Return the byte size of the data or -1 if the type is invalid.
+*/
+static int _initPayload( UBuffer* buf, int type, int form, int used )
+{
+    switch( type )
+    {
+        case UT_BINARY:
+        case UT_BITSET:
+            ur_binInit( buf, used );
+            buf->type = type;
+            return used;
+        case UT_STRING:
+        case UT_FILE:
+            ur_strInit( buf, form, used );
+            return used * buf->elemSize;
+        case UT_VECTOR:
+            ur_vecInit( buf, form, 0, used );
+            return used * buf->elemSize;
+    }
+    return -1;
+}
+
+
+#ifdef SERIAL_DEFLATE
+/*
+  Inflate a BUF_DEFLATE entry into ur_buffer(us->ids[i]).
+  The iterator must be after the BUF_DEFLATE code.
+
+  Return UR_OK/UR_THROW.
+*/
+static UStatus _inflateBuffer( UThread* ut, Unserializer* us,
+                               BinaryIter* bi, int i )
+{
+    UBuffer* buf = ur_buffer( us->ids[ i ] );
+    uLongf len;
+    uint32_t zlen;
+    int type;
+    int form = 0;
+    int used;
+    int size;
+
+    if( bi->end - bi->it < 6 )
+        goto invalid;
+    type = *bi->it++;
+    if( type != UT_BINARY )
+        form = *bi->it++;
+    used = _unpackU32(bi);
+
+    if( (size = _initPayload( buf, type, form, used )) < 0 )
+        goto invalid;
+    if( bi->end - bi->it < 4 )
+        goto invalid;
+    zlen = _pullU32(bi);
+    if( zlen > (uint32_t) (bi->end - bi->it) )
+        goto invalid;
+
+    len = size;
+    if( uncompress( buf->ptr.b, &len, bi->it, zlen ) != Z_OK ||
+        len != (uLongf) size )
+        goto invalid;
+#ifdef __BIG_ENDIAN__
+    if( type != UT_BINARY && type != UT_BITSET )
+        _memCpySwap( buf->ptr.b, buf->ptr.b, used, buf->elemSize );
+#endif
+
+    bi->it += zlen;
+    buf->used = used;
+    return UR_OK;
+
+invalid:
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid compressed serialized data" );
+}
+#endif
+
+
+/*
+  Unserialize buffer entry i into ur_buffer(us->ids[i]).
+  The iterator must be at the entry type.
+
+  Return UR_OK/UR_THROW.
+*/
+static UStatus _unserializeBuffer( UThread* ut, Unserializer* us,
+                                   BinaryIter* bi, int i )
+{
+    UBuffer* buf;
+    int type;
+    int used;
+
+    if( bi->it >= bi->end )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Unexpected end of serialized data" );
+
+    type = *bi->it++;
+
+    switch( type )
+    {
+    case UT_BINARY:
+unpack_binary:
+        used = _unpackU32(bi);
+
+        buf = ur_buffer( us->ids[ i ] );
+        if( us->image && used && type == UT_BINARY )
+        {
+            ur_binInit( buf, 0 );
+            if( _borrowData( buf, bi, used, 1 ) )
+            {
+                ++us->borrowed;
+                break;
+            }
+        }
+        ur_binInit( buf, used );
+        if( type != UT_BINARY )
+            buf->type = type;
+        if( used )
+        {
+            ur_binAppendData( buf, bi->it, used );
+            bi->it += used;
+        }
+        break;
+
+    case UT_BITSET:
+        assert( *bi->it == 0 );
+        bi->it++;               // Storage format.
+        goto unpack_binary;
+
+    case UT_STRING:
+    case UT_FILE:
+    {
+        int form = *bi->it++;
+        used = _unpackU32(bi);
+
+        buf = ur_buffer( us->ids[ i ] );
+        if( us->image && used )
+        {
+            ur_strInit( buf, form, 0 );
+#ifdef __BIG_ENDIAN__
+            if( buf->elemSize == 1 )
+#endif
+            if( _borrowData( buf, bi, used, buf->elemSize ) )
+            {
+                ++us->borrowed;
+                break;
+            }
+        }
+        ur_strInit( buf, form, used );
+        if( used )
+        {
+            buf->used = used;
+#ifdef __BIG_ENDIAN__
+            _memCpySwap( buf->ptr.b, bi->it, used, buf->elemSize );
+            used *= buf->elemSize;
+#else
+            used *= buf->elemSize;
+            memCpy( buf->ptr.v, bi->it, used );
+#endif
+            bi->it += used;
+        }
+    }
+        break;
+
+    case UT_VECTOR:
+    {
+        int form = *bi->it++;
+        used = _unpackU32(bi);
+
+        buf = ur_buffer( us->ids[ i ] );
+#ifndef __BIG_ENDIAN__
+        if( us->image && used )
+        {
+            ur_vecInit( buf, form, 0, 0 );
+            if( _borrowData( buf, bi, used, buf->elemSize ) )
+            {
+                ++us->borrowed;
+                break;
+            }
+        }
+#endif
+        ur_vecInit( buf, form, 0, used );
+        if( used )
+        {
+            buf->used = used;
+#ifdef __BIG_ENDIAN__
+            _memCpySwap( buf->ptr.b, bi->it, used, buf->elemSize );
+            used *= buf->elemSize;
+#else
+            used *= buf->elemSize;
+            memCpy( buf->ptr.v, bi->it, used );
+#endif
+            bi->it += used;
+        }
+    }
+        break;
+
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+        used = _unpackU32(bi);
+
+        buf = ur_buffer( us->ids[ i ] );
+        ur_blkInit( buf, type, used );
+        if( used )
+        {
+unser_block:
+            buf->used = used;
+            if( ! _unserializeBlock( us->atoms, us->ids, bi, buf ) )
+            {
+                buf->used = 0;
+                return ur_error( ut, UR_ERR_SCRIPT,
+                                 "Invalid serialized block" );
+            }
+        }
+        break;
+
+    case UT_CONTEXT:
+        used = _unpackU32(bi);
+
+        buf = ur_buffer( us->ids[ i ] );
+        ur_ctxInit( buf, used );
+        if( used )
+        {
+#define ENTRIES(buf)    ((UAtomEntry*) (buf->ptr.cell + ur_avail(buf)))
+            int ai;
+            uint32_t an;
+            UAtomEntry* ent = ENTRIES(buf);
+
+            for( ai = 0; ai < used; ++ai, ++ent )
+            {
+                an = _unpackU32(bi);
+                ent->atom  = us->atoms[ an ];
+                ent->index = ai;
+            }
+
+            ur_ctxSort( buf );
+            goto unser_block;
+        }
+        break;
+
+    case BUF_DUP:
+    {
+        const UBuffer* src;
+
+        used = _unpackU32(bi);
+        if( used >= i )
+            goto bad_type;
+        src = ur_buffer( us->ids[ used ] );
+        buf = ur_buffer( us->ids[ i ] );
+        if( src->type == UT_BINARY )
+            ur_binInit( buf, (src->flags & UR_BUF_BORROWED) ? 0 : src->used );
+        else if( src->type == UT_STRING )
+            ur_strInit( buf, src->form,
+                        (src->flags & UR_BUF_BORROWED) ? 0 : src->used );
+        else
+            goto bad_type;
+
+        if( src->flags & UR_BUF_BORROWED )
+        {
+            // Share the image data; either buffer is copied if modified.
+            buf->ptr.b = src->ptr.b;
+            buf->flags |= UR_BUF_BORROWED;
+            ++us->borrowed;
+        }
+        else if( src->used )
+        {
+            memCpy( buf->ptr.b, src->ptr.b, (src->type == UT_BINARY) ?
+                    src->used : src->used * src->elemSize );
+        }
+        buf->form = src->form;
+        buf->used = src->used;
+    }
+        break;
+
+    case BUF_DEFLATE:
+#ifdef SERIAL_DEFLATE
+        return _inflateBuffer( ut, us, bi, i );
+#else
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Compressed serialized data is not supported" );
+#endif
+
+    case BUF_SHARED:
+        if( ! (us->opt & UR_SERIAL_SHARED) || ! i )
+            goto bad_type;
+        used = _unpackU32(bi);
+        if( used < 1 || used >= ut->env->sharedStore.used )
+            return ur_error( ut, UR_ERR_SCRIPT,
+                             "Invalid shared buffer (%d)", used );
+        buf = ur_buffer( us->ids[ i ] );
+        buf->type  = UT_UNSET;
+        buf->used  = used;
+        buf->ptr.v = 0;
+        ++us->sharedCount;
+        break;
+
+#ifdef CONFIG_HASHMAP
+    case UT_HASHMAP:
+    {
+        const UBuffer* blk;
+
+        used = _unpackU32(bi);
+        blk = ur_buffer( us->ids[ used ] );
+        buf = ur_buffer( us->ids[ i ] );
+
+        assert( blk->type == UT_BLOCK );
+        ur_mapInitV( ut, buf, blk );
+    }
+        break;
+#endif
+
+    default:
+bad_type:
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Invalid serialized buffer type (%d)", type );
+    }
+    return UR_OK;
+}
+
+
+/*
+  Unserialize the BUF_GROUP entry i.  The iterator must be at the entry
+  type.
+
+  The group buffers after the first follow all the buffers outside of
+  groups, so the first group sets the limit of the main entries.
+
+  Return UR_OK/UR_THROW.
+*/
+static UStatus _unserializeGroup( UThread* ut, Unserializer* us,
+                                  BinaryIter* bi, int i, int n,
+                                  int* limit, int* next )
+{
+    UBuffer ids;
+    UBuffer atoms;
+    const UAtom* mainAtoms = us->atoms;
+    UIndex* mainIds = us->ids;
+    uint32_t base;
+    uint32_t count;
+    uint32_t j;
+    UStatus ok = UR_THROW;
+
+    ++bi->it;
+    base  = _unpackU32(bi);
+    count = _unpackU32(bi);
+    if( *limit == n )
+    {
+        if( base <= (uint32_t) i )
+            goto invalid;
+        *limit = *next = base;
+    }
+    if( base != (uint32_t) *next || base > (uint32_t) n || ! count ||
+        count - 1 > (uint32_t) n - base )
+        goto invalid;
+
+    j = _unpackU32(bi);
+    if( j > (uint32_t) (bi->end - bi->it) )
+        goto invalid;
+    ur_arrInit( &atoms, sizeof(UAtom), j );
+    atoms.used = j;
+    for( j = 0; j < (uint32_t) atoms.used; ++j )
+        atoms.ptr.u16[ j ] = mainAtoms[ _unpackU32(bi) ];
+
+    ur_arrInit( &ids, sizeof(UIndex), count );
+    ids.ptr.i[ 0 ] = mainIds[ i ];
+    for( j = 1; j < count; ++j )
+        ids.ptr.i[ j ] = mainIds[ base + j - 1 ];
+
+    us->atoms = atoms.ptr.u16;
+    us->ids   = ids.ptr.i;
+    for( j = 0; j < count; ++j )
+    {
+        if( ! _unserializeBuffer( ut, us, bi, j ) )
+            goto restore;
+    }
+    *next = base + count - 1;
+    ok = UR_OK;
+
+restore:
+
+    us->atoms = mainAtoms;
+    us->ids   = mainIds;
+    ur_arrFree( &atoms );
+    ur_arrFree( &ids );
+    return ok;
+
+invalid:
+
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized group" );
+}
+
+
+/*
+  Set unset buffers to something & release any shared placeholders.
+*/
+static void _unserializeDone( UThread* ut, Unserializer* us,
+                              const UIndex* it, const UIndex* end )
+{
+    UBuffer* buf;
+
+    // Swap the reference taken by ur_binImageFind() for one per borrowing
+    // buffer.
+    if( us->image )
+        ur_binImageRef( us->image, us->borrowed - 1 );
+
+    // Placeholders for shared buffers are left as empty binaries.
+    for( ; us->sharedCount && it != end; ++it )
+    {
+        buf = ur_buffer( *it );
+        if( buf->type == UT_UNSET )
+        {
+            ur_binInit( buf, 0 );
+            --us->sharedCount;
+        }
+    }
+}
+
+
+/**
+  Unserialize binary with options.
+
+  UR_SERIAL_SHARED must only be used with data serialized by the same
+  process.
+
+  With UR_SERIAL_BORROW, if the serialized data is inside an image made by
+  ur_binMakeImage() then binary, string, and vector buffers will reference
+  their data in the image rather than copying it.  Otherwise the data is
+  copied as usual.
+
+  \param  start     Pointer to serialized binary.
+  \param  end       Pointer to end of binary.
+  \param  opt       Mask of UrlanSerializeOption values.
+  \param  res       Cell to be set to new output block.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_unserializeOpt( UThread* ut, const uint8_t* start,
+                           const uint8_t* end, int opt, UCell* res )
+{
+    Unserializer us;
+    BinaryIter bi;
+    UBuffer atoms;
+    UBuffer ids;
+    int i;
+    int n;
+    int limit;
+    int next;
+    UStatus ok = UR_OK;
+
+
+    if( ! ur_serializedHeader( start, end - start ) )
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data header" );
+
+    us.image = (opt & UR_SERIAL_BORROW) ? ur_binImageFind( start, end ) : 0;
+    us.opt = opt;
+    us.borrowed = us.sharedCount = 0;
+
+    bi.it  = start + 4;
+    bi.end = end;
+    n = _pullU32(&bi);
+    ur_arrInit( &atoms, sizeof(UAtom), n );
+    if( n )
+    {
+        start += n;
+        ur_internAtoms( ut, (const char*) start, atoms.ptr.u16 ); 
+        bi.end = start;
+    }
+
+    n = _pullU32(&bi);
+    ur_arrInit( &ids, sizeof(UIndex), n );
+    ur_genBuffers( ut, n, ids.ptr.i );
+
+    if( opt & UR_SERIAL_SHARED )
+        ur_syncShared( ut );
+
+    us.atoms = atoms.ptr.u16;
+    us.ids   = ids.ptr.i;
+
+    limit = next = n;
+    for( i = 0; i < limit; ++i )
+    {
+        if( bi.it < bi.end && *bi.it == BUF_GROUP )
+        {
+            if( ! _unserializeGroup( ut, &us, &bi, i, n, &limit, &next ) )
+                goto fail;
+        }
+        else if( ! _unserializeBuffer( ut, &us, &bi, i ) )
+            goto fail;
+    }
+    if( next != n )
+    {
+        ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized group" );
+        goto fail;
+    }
+
+    if( us.sharedCount )
+        _resolveShared( ut, ids.ptr.i, n );
+
+    ur_initSeries( res, UT_BLOCK, ids.ptr.i[0] );
+    goto cleanup;
+
+fail:
+
+    // Initialize any unset buffers to something.
+    for( ; i < limit; ++i )
+        ur_binInit( ur_buffer( ids.ptr.i[ i ] ), 0 );
+    for( i = next; i < n; ++i )
+        ur_binInit( ur_buffer( ids.ptr.i[ i ] ), 0 );
+    ok = UR_THROW;
+
+cleanup:
+
+    _unserializeDone( ut, &us, ids.ptr.i + 1, ids.ptr.i + n );
+    ur_arrFree( &atoms );
+    ur_arrFree( &ids );
+    return ok;
+}
+
+
+typedef struct
+{
+    const uint8_t* bufOffset;   // Big-endian u32 offset of each buffer.
+    const uint8_t* cellOffset;  // Big-endian u32 offset of first block cells.
+    uint32_t bufCount;
+    uint32_t cellCount;
+    uint32_t stride;
+}
+SerialIndex;
+
+
+static uint32_t _peekU32( const uint8_t* bp )
+{
+    return (bp[0] << 24) | (bp[1] << 16) | (bp[2] << 8) | bp[3];
+}
+
+
+/*
+  Return non-zero if the data has a valid UR_SERIAL_INDEX index.
+*/
+static int _readIndex( SerialIndex* si, const uint8_t* start,
+                       const uint8_t* end )
+{
+    const uint8_t* it;
+    size_t len = end - start;
+    uint32_t off;
+
+    if( len < 24 || memcmp( end - 4, "BIDX", 4 ) )
+        return 0;
+    off = _peekU32( end - 8 );
+    if( off < 12 || off > len - 24 )
+        return 0;
+    it = start + off;
+    if( memcmp( it, "BIDX", 4 ) )
+        return 0;
+
+    si->bufCount = _peekU32( it + 4 );
+    if( si->bufCount != _peekU32( start + 8 ) ||
+        si->bufCount > (len - off - 24) / 4 )
+        return 0;
+    si->bufOffset = it + 8;
+    it = si->bufOffset + si->bufCount * 4;
+
+    si->stride    = _peekU32( it );
+    si->cellCount = _peekU32( it + 4 );
+    si->cellOffset = it + 8;
+    if( ! si->stride || si->stride > INDEX_STRIDE ||
+        si->cellCount > (size_t) (end - 8 - si->cellOffset) / 4 )
+        return 0;
+    return 1;
+}
+
+
+/*
+  Decode the root block cell at zero-based index into cell.
+  Return non-zero if successful.
+*/
+static int _unserializeCell( const SerialIndex* si, Unserializer* us,
+                             BinaryIter* bi, const uint8_t* start,
+                             uint32_t index, UCell* cell )
+{
+    UCell tmp[ INDEX_STRIDE ];
+    UBuffer blk;
+    uint32_t n = index / si->stride;
+
+    if( n >= si->cellCount )
+        return 0;
+    n = _peekU32( si->cellOffset + n * 4 );
+    if( start + n >= bi->end )
+        return 0;
+    bi->it = start + n;
+
+    blk.ptr.cell = tmp;
+    blk.used = (index % si->stride) + 1;
+    if( ! _unserializeBlock( us->atoms, us->ids, bi, &blk ) )
+        return 0;
+    *cell = tmp[ blk.used - 1 ];
+    return 1;
+}
+
+
+#define NEED_BUF(N) \
+    if( (uint32_t) (N) >= si->bufCount ) return 0; \
+    if( ! need[N] ) { need[N] = 1; ur_arrAppendInt32( queue, N ); }
+
+/*
+  Add any buffers referenced by the cells to the queue.
+  The cells must be decoded with identity ids.
+*/
+static int _needCells( const SerialIndex* si, uint8_t* need, UBuffer* queue,
+                       const UCell* it, const UCell* end )
+{
+    for( ; it != end; ++it )
+    {
+        switch( ur_type(it) )
+        {
+        case UT_WORD:
+        case UT_LITWORD:
+        case UT_SETWORD:
+        case UT_GETWORD:
+        case UT_OPTION:
+            if( ur_binding(it) == UR_BIND_THREAD )
+            {
+                NEED_BUF( it->word.ctx );
+            }
+            break;
+
+        case UT_BINARY:
+        case UT_STRING:
+        case UT_FILE:
+        case UT_VECTOR:
+        case UT_BLOCK:
+        case UT_PAREN:
+        case UT_PATH:
+        case UT_LITPATH:
+        case UT_SETPATH:
+        case UT_BITSET:
+        case UT_CONTEXT:
+            NEED_BUF( it->series.buf );
+            break;
+
+#ifdef CONFIG_HASHMAP
+        case UT_HASHMAP:
+            NEED_BUF( it->series.buf );
+            NEED_BUF( it->series.it );
+            break;
+#endif
+        }
+    }
+    return 1;
+}
+
+
+/*
+  Add any buffers referenced by buffer entry n to the queue.
+*/
+static int _needBuffer( const SerialIndex* si, Unserializer* us,
+                        uint8_t* need, UBuffer* queue, UBuffer* cells,
+                        const uint8_t* start, BinaryIter* bi, uint32_t n )
+{
+    uint32_t used;
+    int type;
+
+    n = _peekU32( si->bufOffset + n * 4 );
+    if( start + n >= bi->end )
+        return 0;
+    bi->it = start + n;
+    type = *bi->it++;
+
+    switch( type )
+    {
+    case UT_CONTEXT:
+        used = _unpackU32(bi);
+        for( n = 0; n < used; ++n )
+            _unpackU32(bi);
+        goto block;
+
+    case UT_BLOCK:
+    case UT_PAREN:
+    case UT_PATH:
+    case UT_LITPATH:
+    case UT_SETPATH:
+        used = _unpackU32(bi);
+block:
+        if( used )
+        {
+            ur_arrReserve( cells, used );
+            cells->used = used;
+            if( ! _unserializeBlock( us->atoms, us->ids, bi, cells ) )
+                return 0;
+            return _needCells( si, need, queue, cells->ptr.cell,
+                               cells->ptr.cell + used );
+        }
+        break;
+
+    case BUF_DUP:
+        used = _unpackU32(bi);
+        NEED_BUF( used );
+        break;
+
+#ifdef CONFIG_HASHMAP
+    case UT_HASHMAP:
+        used = _unpackU32(bi);
+        NEED_BUF( used );
+        break;
+#endif
     }
-    return 0;
+    return 1;
 }
 
 
 /**
-  Unserialize binary.
+  Unserialize a single value from the first block of serialized data.
+
+  If the data was made with the UR_SERIAL_INDEX option then only the buffers
+  which the value references are decoded.  Otherwise the entire data is
+  unserialized and the value picked from the result.
 
   \param  start     Pointer to serialized binary.
   \param  end       Pointer to end of binary.
-  \param  res       Cell to be set to new output block.
+  \param  opt       Mask of UrlanSerializeOption values.
+  \param  index     Zero-based index of value in the first block.
+  \param  res       Cell to be set to the value, or none if index is out
+                    of range.
 
   \return UR_OK/UR_THROW
 */
-UStatus ur_unserialize( UThread* ut, const uint8_t* start, const uint8_t* end,
-                        UCell* res )
+UStatus ur_unserializePick( UThread* ut, const uint8_t* start,
+                            const uint8_t* end, int opt, UIndex index,
+                            UCell* res )
 {
+    SerialIndex si;
+    Unserializer us;
     BinaryIter bi;
     UBuffer atoms;
     UBuffer ids;
-    UBuffer* buf;
+    UBuffer need;
+    UBuffer queue;
+    UBuffer cells;
+    UCell cell;
+    uint32_t n;
     int i;
-    int n;
-    int type;
-    int used;
     UStatus ok = UR_OK;
 
 
     if( ! ur_serializedHeader( start, end - start ) )
         return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data header" );
 
-    bi.it  = start + 4;
-    bi.end = end;
-    n = _pullU32(&bi);
+    if( ! _readIndex( &si, start, end ) )
+    {
+        const UBuffer* blk;
+
+        if( ! ur_unserializeOpt( ut, start, end, opt, res ) )
+            return UR_THROW;
+        blk = ur_bufferSer( res );
+        if( index < 0 || index >= blk->used )
+            ur_setId( res, UT_NONE );
+        else
+            *res = blk->ptr.cell[ index ];
+        return UR_OK;
+    }
+
+    // Buffer entries end at the atoms or the index.
+    n = _peekU32( start + 4 );
+    bi.end = n ? start + n : si.bufOffset - 8;
+    if( bi.end > si.bufOffset - 8 )
+        goto invalid;
+    bi.it = start + 13;
+    n = _unpackU32(&bi);        // Root block size.
+    if( index < 0 || (uint32_t) index >= n )
+    {
+        ur_setId( res, UT_NONE );
+        return UR_OK;
+    }
+
+    us.image = (opt & UR_SERIAL_BORROW) ? ur_binImageFind( start, end ) : 0;
+    us.opt = opt;
+    us.borrowed = us.sharedCount = 0;
+
+    n = bi.end - start;
     ur_arrInit( &atoms, sizeof(UAtom), n );
-    if( n )
+    if( bi.end != si.bufOffset - 8 )
+        ur_internAtoms( ut, (const char*) bi.end, atoms.ptr.u16 );
+
+    // Discover the buffers referenced by the value using serial numbers
+    // as the buffer ids.
+    ur_arrInit( &ids, sizeof(UIndex), si.bufCount );
+    ur_binInit( &need, si.bufCount );
+    ur_arrInit( &queue, sizeof(UIndex), 0 );
+    ur_arrInit( &cells, sizeof(UCell), 0 );
+    memSet( need.ptr.b, 0, si.bufCount );
+    for( n = 0; n < si.bufCount; ++n )
+        ids.ptr.i[ n ] = n;
+
+    us.atoms = atoms.ptr.u16;
+    us.ids   = ids.ptr.i;
+
+    if( ! _unserializeCell( &si, &us, &bi, start, index, &cell ) ||
+        ! _needCells( &si, need.ptr.b, &queue, &cell, &cell + 1 ) )
+        goto invalid_free;
+    for( i = 0; i < queue.used; ++i )
     {
-        start += n;
-        ur_internAtoms( ut, (const char*) start, atoms.ptr.u16 ); 
-        bi.end = start;
+        if( ! _needBuffer( &si, &us, need.ptr.b, &queue, &cells, start, &bi,
+                           queue.ptr.i[ i ] ) )
+            goto invalid_free;
     }
 
-    n = _pullU32(&bi);
-    ur_arrInit( &ids, sizeof(UIndex), n );
-    ur_genBuffers( ut, n, ids.ptr.i );
+    // Decode the needed buffers in serial order so hash-map blocks are
+    // made before their map.
+    if( queue.used )
+        ur_genBuffers( ut, queue.used, queue.ptr.i );
+    for( n = i = 0; n < si.bufCount; ++n )
+    {
+        if( need.ptr.b[ n ] )
+            ids.ptr.i[ n ] = queue.ptr.i[ i++ ];
+    }
+
+    if( opt & UR_SERIAL_SHARED )
+        ur_syncShared( ut );
 
-    for( i = 0; i < n; ++i )
+    for( n = i = 0; n < si.bufCount; ++n )
     {
-        if( bi.it >= bi.end )
+        if( need.ptr.b[ n ] )
         {
-            ur_error( ut, UR_ERR_SCRIPT, "Unexpected end of serialized data" );
-            goto fail;
+            bi.it = start + _peekU32( si.bufOffset + n * 4 );
+            if( ! _unserializeBuffer( ut, &us, &bi, n ) )
+                goto fail;
+            ++i;
         }
+    }
+
+    if( ! _unserializeCell( &si, &us, &bi, start, index, res ) )
+    {
+        ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized block" );
+        goto fail;
+    }
+    if( us.sharedCount )
+    {
+        _resolveShared( ut, queue.ptr.i, queue.used );
+        _resolveSharedCell( ut, res );
+    }
+    goto cleanup;
 
-        type = *bi.it++;
+fail:
 
-        switch( type )
-        {
-        case UT_BINARY:
-unpack_binary:
-            used = _unpackU32(&bi);
+    // Initialize any unset buffers to something.
+    for( ; n < si.bufCount; ++n )
+    {
+        if( need.ptr.b[ n ] )
+            ur_binInit( ur_buffer( ids.ptr.i[ n ] ), 0 );
+    }
+    ok = UR_THROW;
 
-            buf = ur_buffer( ids.ptr.i[ i ] );
-            ur_binInit( buf, used );
-            if( type != UT_BINARY )
-                buf->type = type;
-            if( used )
-            {
-                ur_binAppendData( buf, bi.it, used );
-                bi.it += used;
-            }
-            break;
+cleanup:
 
-        case UT_BITSET:
-            assert( *bi.it == 0 );
-            bi.it++;                // Storage format.
-            goto unpack_binary;
+    _unserializeDone( ut, &us, queue.ptr.i, queue.ptr.i + queue.used );
+    ur_arrFree( &atoms );
+    ur_arrFree( &ids );
+    ur_binFree( &need );
+    ur_arrFree( &queue );
+    ur_arrFree( &cells );
+    return ok;
 
-        case UT_STRING:
-        case UT_FILE:
+invalid_free:
+
+    if( us.image )
+        ur_binImageRef( us.image, -1 );
+    ur_arrFree( &atoms );
+    ur_arrFree( &ids );
+    ur_binFree( &need );
+    ur_arrFree( &queue );
+    ur_arrFree( &cells );
+
+invalid:
+
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized data index" );
+}
+
+
+/*--------------------------------------------------------------------------*/
+
+
+#define STREAM_CHUNK    0x10000 // Entries are batched into records this size.
+#define RECORD_HEAD     9
+
+static UStatus _writeRecord( UThread* ut, UrSerialWrite func, void* user,
+                             int type, uint32_t count, const UBuffer* data,
+                             uint32_t len )
+{
+    uint8_t head[ RECORD_HEAD ];
+
+    head[0] = type;
+    _pokeU32( head + 1, count );
+    _pokeU32( head + 5, len );
+    if( ! func( ut, user, head, RECORD_HEAD ) )
+        return UR_THROW;
+    if( data && data->used )
+        return func( ut, user, data->ptr.b, data->used );
+    return UR_OK;
+}
+
+
+/*
+  Write any new atoms & the pending buffer entries.
+*/
+static UStatus _writeBatch( UThread* ut, Serializer* ser, UBuffer* entries,
+                            int* atomsSent, UrSerialWrite func, void* user )
+{
+    if( ser->atomMap.used > *atomsSent )
+    {
+        UBuffer names;
+        const UAtom* it  = ser->atomMap.ptr.u16 + *atomsSent;
+        const UAtom* end = ser->atomMap.ptr.u16 + ser->atomMap.used;
+        const char* str;
+        int count = end - it;
+        UStatus ok;
+
+        ur_binInit( &names, count * 8 );
+        while( it != end )
         {
-            int form = *bi.it++;
-            used = _unpackU32(&bi);
+            str = ur_atomCStr( ut, *it++ );
+            ur_binAppendData( &names, (const uint8_t*) str, strLen(str) + 1 );
+            replaceLast( (&names), ' ' );
+        }
+        ok = _writeRecord( ut, func, user, 'A', count, &names,
+                           names.used );
+        ur_binFree( &names );
+        if( ! ok )
+            return UR_THROW;
+        *atomsSent = ser->atomMap.used;
+    }
 
-            buf = ur_buffer( ids.ptr.i[ i ] );
-            ur_strInit( buf, form, used );
-            if( used )
+    if( entries->used )
+    {
+        if( ! _writeRecord( ut, func, user, 'E', ser->bufMap.used, entries,
+                            entries->used ) )
+            return UR_THROW;
+        entries->used = 0;
+    }
+    return UR_OK;
+}
+
+
+/*
+  Return the byte size of the data for a large binary, string, or vector
+  buffer which can be written directly, or zero.
+*/
+static int _directSize( const UBuffer* buf )
+{
+    int size = _payloadSize( buf );
+    return (size >= STREAM_CHUNK) ? size : 0;
+}
+
+
+/**
+  Serialize block to a stream.
+
+  The data is passed to the output function in pieces as it is encoded,
+  so only about STREAM_CHUNK bytes (or the size of the largest block) are
+  buffered.  Large binary!, string!, and vector! data is passed directly
+  from its buffer.  The UR_SERIAL_SHARED, UR_SERIAL_INDEX,
+  UR_SERIAL_COMPRESS, and UR_SERIAL_PARALLEL options are ignored.
+
+  \param  blkN  Index to valid block buffer.
+  \param  opt   Mask of UrlanSerializeOption values.
+  \param  func  Output function.
+  \param  user  User data passed to func.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_serializeStream( UThread* ut, UIndex blkN, int opt,
+                            UrSerialWrite func, void* user )
+{
+    Serializer ser;
+    UBuffer entries;
+    const UBuffer* buf;
+    UStatus ok = UR_THROW;
+    int atomsSent = 0;
+    int size;
+    int i;
+
+    _serInit( &ser, opt & ~(UR_SERIAL_SHARED | UR_SERIAL_INDEX |
+                            UR_SERIAL_COMPRESS | UR_SERIAL_PARALLEL) );
+    ur_binInit( &entries, STREAM_CHUNK + 64 );
+
+    if( ! func( ut, user, (const uint8_t*) "BOS2", 4 ) )
+        goto cleanup;
+    _mapBuffer( &ser, blkN );
+
+    // NOTE: ser.bufMap changes inside the loop as new buffers are seen.
+
+    for( i = 0; i < ser.bufMap.used; ++i )
+    {
+        buf = ur_bufferE( ((BufferIndex*) ser.bufMap.ptr.v)[ i ].bufN );
+        if( (size = _directSize( buf )) &&
+            ! ((ser.opt & UR_SERIAL_DEDUPE) && _dedupe( ut, &ser, buf, i )) )
+        {
+            // Write the entry header & then the data from the buffer.
+            if( ! _writeBatch( ut, &ser, &entries, &atomsSent, func, user ) )
+                goto cleanup;
             {
-                buf->used = used;
-                used *= buf->elemSize;
-                memCpy( buf->ptr.v, bi.it, used );
-                bi.it += used;
+            UBuffer* bin = &entries;
+            push8( buf->type );
+            if( buf->type == UT_BITSET )
+                push8( 0 );
+            else if( buf->type != UT_BINARY )
+                push8( buf->form );
+            packU32( buf->used );
             }
+            if( ! _writeRecord( ut, func, user, 'D', ser.bufMap.used,
+                                &entries, entries.used + size ) ||
+                ! func( ut, user, buf->ptr.b, size ) )
+                goto cleanup;
+            entries.used = 0;
+        }
+        else
+        {
+            if( ! _serializeBuffer( ut, &ser, &entries, i, 0 ) )
+                goto cleanup;
+            if( entries.used >= STREAM_CHUNK &&
+                ! _writeBatch( ut, &ser, &entries, &atomsSent, func, user ) )
+                goto cleanup;
         }
+    }
+
+    if( _writeBatch( ut, &ser, &entries, &atomsSent, func, user ) )
+        ok = _writeRecord( ut, func, user, 'Z', 0, 0, 0 );
+
+cleanup:
+
+    _serFree( &ser );
+    ur_binFree( &entries );
+    return ok;
+}
+
+
+/*
+  Read exactly len bytes.  Return the number of bytes read (which is less
+  than len only at the end of input) or -1 if an error was thrown.
+*/
+static int _readFull( UThread* ut, UrSerialRead func, void* user,
+                      uint8_t* dest, int len )
+{
+    int n;
+    int total = 0;
+
+    while( total < len )
+    {
+        n = func( ut, user, dest + total, len - total );
+        if( n < 0 )
+            return -1;
+        if( n == 0 )
             break;
+        total += n;
+    }
+    return total;
+}
 
-        case UT_VECTOR:
-        {
-            int form = *bi.it++;
-            used = _unpackU32(&bi);
 
-            buf = ur_buffer( ids.ptr.i[ i ] );
-            ur_vecInit( buf, form, 0, used );
-            if( used )
-            {
-                buf->used = used;
+static UStatus _readExact( UThread* ut, UrSerialRead func, void* user,
+                           uint8_t* dest, int len )
+{
+    int n = _readFull( ut, func, user, dest, len );
+    if( n < 0 )
+        return UR_THROW;
+    if( n != len )
+        return ur_error( ut, UR_ERR_SCRIPT,
+                         "Unexpected end of serialized stream" );
+    return UR_OK;
+}
+
+
+/*
+  Read a large entry directly into its buffer.
+  The first part bytes of the entry are in head.
+*/
+static UStatus _readDirect( UThread* ut, Unserializer* us, const uint8_t* head,
+                            int part, uint32_t len, int i,
+                            UrSerialRead func, void* user )
+{
+    BinaryIter bi;
+    UBuffer* buf;
+    UIndex bufN = us->ids[ i ];
+    int type;
+    int form = 0;
+    int used;
+    int n;
+    uint32_t size;
+    uint32_t have;
+
+    bi.it = head;
+    type = *bi.it++;
+    if( type != UT_BINARY )
+        form = *bi.it++;
+    used = _unpackU32(&bi);
+    have = part - (bi.it - head);
+
+    if( (n = _initPayload( ur_buffer( bufN ), type, form, used )) < 0 )
+        goto invalid;
+    size = n;
+    if( size != len - (bi.it - head) || have > size )
+        goto invalid;
+    buf = ur_buffer( bufN );
+
+    memCpy( buf->ptr.b, bi.it, have );
+    if( ! _readExact( ut, func, user, buf->ptr.b + have, size - have ) )
+        return UR_THROW;
 #ifdef __BIG_ENDIAN__
-                switch( buf->elemSize )
-                {
-                    case 2:
-                        _memCpySwap2( buf->ptr.b, bi.it, used );
-                        used *= 2;
-                        break;
-                    case 4:
-                        _memCpySwap4( buf->ptr.b, bi.it, used );
-                        used *= 4;
-                        break;
-                    default:
-                        used *= buf->elemSize;
-                        memCpy( buf->ptr.v, bi.it, used );
-                        break;
-                }
-#else
-                used *= buf->elemSize;
-                memCpy( buf->ptr.v, bi.it, used );
+    buf = ur_buffer( bufN );
+    if( type != UT_BINARY && type != UT_BITSET )
+        _memCpySwap( buf->ptr.b, buf->ptr.b, used, buf->elemSize );
 #endif
-                bi.it += used;
-            }
-        }
-            break;
 
-        case UT_BLOCK:
-        case UT_PAREN:
-        case UT_PATH:
-        case UT_LITPATH:
-        case UT_SETPATH:
-            used = _unpackU32(&bi);
+    ur_buffer( bufN )->used = used;
+    return UR_OK;
 
-            buf = ur_buffer( ids.ptr.i[ i ] );
-            ur_blkInit( buf, type, used );
-            if( used )
-            {
-unser_block:
-                buf->used = used;
-                if( ! _unserializeBlock( atoms.ptr.u16, ids.ptr.i, &bi, buf ) )
-                {
-                    buf->used = 0;
-                    ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized block" );
-                    goto fail;
-                }
-            }
-            break;
+invalid:
+    return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized stream entry" );
+}
 
-        case UT_CONTEXT:
-            used = _unpackU32(&bi);
 
-            buf = ur_buffer( ids.ptr.i[ i ] );
-            ur_ctxInit( buf, used );
-            if( used )
+/**
+  Unserialize block from a stream made by ur_serializeStream().
+
+  Input is read one record at a time so only about STREAM_CHUNK bytes (or
+  the size of the largest block entry) are buffered.  Large binary!,
+  string!, and vector! data is read directly into its buffer.  Nothing is
+  read past the end of the stream.
+
+  \param  opt   Mask of UrlanSerializeOption values.  Only UR_SERIAL_BORROW
+                is recognized, and it has no effect.
+  \param  func  Input function.  It must return the number of bytes read,
+                zero at the end of input, or -1 if an error was thrown.
+  \param  user  User data passed to func.
+  \param  res   Cell to be set to new output block, or none if the input
+                was already at its end.
+
+  \return UR_OK/UR_THROW
+*/
+UStatus ur_unserializeStream( UThread* ut, int opt, UrSerialRead func,
+                              void* user, UCell* res )
+{
+    Unserializer us;
+    BinaryIter bi;
+    UBuffer atoms;
+    UBuffer ids;
+    UBuffer rec;
+    uint8_t* head;
+    uint32_t count;
+    uint32_t len;
+    int type;
+    int n;
+    int i = 0;
+    UIndex hold = UR_INVALID_HOLD;
+    UStatus ok = UR_THROW;
+    (void) opt;
+
+
+    ur_binInit( &rec, STREAM_CHUNK + RECORD_HEAD + 1 );
+    n = _readFull( ut, func, user, rec.ptr.b, 4 + RECORD_HEAD );
+    if( n < 1 )
+    {
+        ur_binFree( &rec );
+        if( n < 0 )
+            return UR_THROW;
+        ur_setId( res, UT_NONE );
+        return UR_OK;
+    }
+    if( n != 4 + RECORD_HEAD || memcmp( rec.ptr.b, "BOS2", 4 ) )
+    {
+        ur_binFree( &rec );
+        return ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized stream header" );
+    }
+    head = rec.ptr.b + 4;
+
+    us.image = 0;
+    us.opt = 0;
+    us.borrowed = us.sharedCount = 0;
+    ur_arrInit( &atoms, sizeof(UAtom), 0 );
+    ur_arrInit( &ids, sizeof(UIndex), 0 );
+
+    while( 1 )
+    {
+        type  = head[0];
+        count = _peekU32( head + 1 );
+        len   = _peekU32( head + 5 );
+        if( type == 'Z' )
+            break;
+
+        if( type == 'E' || type == 'D' )
+        {
+            if( count > (uint32_t) ids.used )
             {
-#define ENTRIES(buf)    ((UAtomEntry*) (buf->ptr.cell + ur_avail(buf)))
-                int ai;
-                uint32_t an;
-                UAtomEntry* ent = ENTRIES(buf);
-
-                for( ai = 0; ai < used; ++ai, ++ent )
-                {
-                    an = _unpackU32(&bi);
-                    ent->atom  = atoms.ptr.u16[ an ];
-                    ent->index = ai;
-                }
-
-                ur_ctxSort( buf );
-                goto unser_block;
+                // Make new buffers valid in case the garbage collector
+                // runs before their entries are read.
+                UIndex* it;
+                UIndex* end;
+                ur_arrReserve( &ids, count );
+                it  = ids.ptr.i + ids.used;
+                end = ids.ptr.i + count;
+                ur_genBuffers( ut, count - ids.used, it );
+                for( ; it != end; ++it )
+                    ur_binInit( ur_buffer( *it ), 0 );
+                if( ! ids.used )
+                    hold = ur_hold( ids.ptr.i[0] );
+                ids.used = count;
             }
-            break;
+            us.ids = ids.ptr.i;
+        }
 
-#ifdef CONFIG_HASHMAP
-        case UT_HASHMAP:
+        if( type == 'D' )
         {
-            const UBuffer* blk;
+            if( i >= ids.used )
+                goto invalid;
+            n = (len < 8) ? len : 8;
+            if( ! _readExact( ut, func, user, rec.ptr.b, n ) )
+                goto fail;
+            if( ! _readDirect( ut, &us, rec.ptr.b, n, len, i, func, user ) )
+                goto fail;
+            ++i;
+            len = 0;
+        }
+        else
+        {
+            ur_binReserve( &rec, len + RECORD_HEAD + 1 );
+        }
 
-            used = _unpackU32(&bi);
-            blk = ur_buffer( ids.ptr.i[ used ] );
-            buf = ur_buffer( ids.ptr.i[ i ] );
+        if( ! _readExact( ut, func, user, rec.ptr.b, len + RECORD_HEAD ) )
+            goto fail;
+        head = rec.ptr.b + len;
+
+        switch( type )
+        {
+        case 'A':
+            if( ! len )
+                break;
+            // Terminate names in place of the next record type.
+            type = *head;
+            *head = '\0';
+            ur_arrReserve( &atoms, atoms.used + len / 2 + 1 );
+            atoms.used = ur_internAtoms( ut, (const char*) rec.ptr.b,
+                                         atoms.ptr.u16 + atoms.used )
+                         - atoms.ptr.u16;
+            *head = type;
+            break;
 
-            assert( blk->type == UT_BLOCK );
-            ur_mapInitV( ut, buf, blk );
+        case 'E':
+            us.atoms = atoms.ptr.u16;
+            bi.it  = rec.ptr.b;
+            bi.end = head;
+            while( bi.it < bi.end )
+            {
+                if( i >= ids.used )
+                    goto invalid;
+                if( ! _unserializeBuffer( ut, &us, &bi, i ) )
+                    goto fail;
+                ++i;
+            }
+            break;
 
-        }
+        case 'D':
             break;
-#endif
 
         default:
-            ur_error( ut, UR_ERR_SCRIPT,
-                      "Invalid serialized buffer type (%d)", type );
-            goto fail;
+            goto invalid;
         }
     }
 
+    if( ! ids.used )
+        goto invalid;
     ur_initSeries( res, UT_BLOCK, ids.ptr.i[0] );
+    ok = UR_OK;
     goto cleanup;
 
-fail:
-
-    // Initialize any unset buffers to something.
-    for( ; i < n; ++i )
-        ur_binInit( ur_buffer( ids.ptr.i[ i ] ), 0 );
-    ok = UR_THROW;
+invalid:
+    ur_error( ut, UR_ERR_SCRIPT, "Invalid serialized stream" );
 
+fail:
 cleanup:
-
+    if( hold != UR_INVALID_HOLD )
+        ur_release( hold );
     ur_arrFree( &atoms );
     ur_arrFree( &ids );
+    ur_binFree( &rec );
     return ok;
 }
 
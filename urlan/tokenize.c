@@ -29,6 +29,11 @@
 #define inline  __inline
 #endif
 
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#include <emmintrin.h>
+#define SCAN_SSE2
+#endif
+
 extern double ur_stringToDate(const uint8_t*,const uint8_t*,const uint8_t**);
 extern int vector_append( UThread*, UBuffer*, const UCell* );
 
@@ -238,11 +243,11 @@ double str_toTime( const uint8_t* start, const uint8_t* end,
         neg = 0;
 
     sec = 3600.0 * str_toInt64( start, end, &start );
-    if( *start == ':' )
+    if( start != end && *start == ':' )
     {
         ++start;
         sec += 60.0 * str_toInt64( start, end, &start );
-        if( *start == ':' )
+        if( start != end && *start == ':' )
         {
             ++start;
             sec += str_toDouble( start, end, &start );
@@ -412,7 +417,10 @@ int ur_caretChar( const uint8_t* it, const uint8_t* end, const uint8_t** pos )
 static int ur_charUtf8ToUcs2( const uint8_t* it, const uint8_t* end,
                               const uint8_t** pos )
 {
-    int c = *it++;
+    int c;
+    if( it == end )
+        return -1;
+    c = *it++;
     if( c <= 0x7f )
     {
         if( c == '^' )
@@ -489,6 +497,8 @@ static int _bracketNewline( const uint8_t* start, const uint8_t* end,
                 *strEnd   = lastLf + 1;
                 return len;
             }
+            if( it == end )
+                break;
         }
 
         if( *it == LF )
@@ -552,13 +562,152 @@ static int _convertToDatatype( UCell* cell, int len )
 }
 
 
+/*
+  The scanners below find the end of long runs (whitespace, strings, and
+  comments) sixteen bytes at a time using SSE2 when it is available.
+  The remaining bytes (and everything on other CPUs) are checked one at
+  a time.
+*/
+
+/*
+  Return pointer to first occurance of c0, c1, c2, or c3 in the input,
+  or end if none are found.
+*/
+static const uint8_t* _scanTo( const uint8_t* it, const uint8_t* end,
+                               int c0, int c1, int c2, int c3 )
+{
+    int ch;
+#ifdef SCAN_SSE2
+    const __m128i v0 = _mm_set1_epi8( (char) c0 );
+    const __m128i v1 = _mm_set1_epi8( (char) c1 );
+    const __m128i v2 = _mm_set1_epi8( (char) c2 );
+    const __m128i v3 = _mm_set1_epi8( (char) c3 );
+    __m128i data;
+    int mask;
+
+    while( end - it >= 16 )
+    {
+        data = _mm_loadu_si128( (const __m128i*) it );
+        mask = _mm_movemask_epi8( _mm_or_si128(
+                    _mm_or_si128( _mm_cmpeq_epi8( data, v0 ),
+                                  _mm_cmpeq_epi8( data, v1 ) ),
+                    _mm_or_si128( _mm_cmpeq_epi8( data, v2 ),
+                                  _mm_cmpeq_epi8( data, v3 ) ) ) );
+        if( mask )
+            return it + __builtin_ctz( mask );
+        it += 16;
+    }
+#endif
+    for( ; it != end; ++it )
+    {
+        ch = *it;
+        if( ch == c0 || ch == c1 || ch == c2 || ch == c3 )
+            break;
+    }
+    return it;
+}
+
+
+/*
+  Skip space, tab, carriage return, & newline characters.
+
+  \param pos    Pointer to input position which is advanced past the
+                whitespace.
+  \param end    End of input.
+
+  \return Non-zero if any newlines were skipped.
+*/
+static int _skipWhite( const uint8_t** pos, const uint8_t* end )
+{
+    const uint8_t* it = *pos;
+    int nl = 0;
+    int ch;
+#ifdef SCAN_SSE2
+    const __m128i vsp = _mm_set1_epi8( ' ' );
+    const __m128i vtab = _mm_set1_epi8( '\t' );
+    const __m128i vcr = _mm_set1_epi8( '\r' );
+    const __m128i vlf = _mm_set1_epi8( '\n' );
+    __m128i data, lf;
+    int white, lfMask;
+
+    while( end - it >= 16 )
+    {
+        data = _mm_loadu_si128( (const __m128i*) it );
+        lf = _mm_cmpeq_epi8( data, vlf );
+        lfMask = _mm_movemask_epi8( lf );
+        white = _mm_movemask_epi8( _mm_or_si128(
+                    _mm_or_si128( _mm_cmpeq_epi8( data, vsp ),
+                                  _mm_cmpeq_epi8( data, vtab ) ),
+                    _mm_or_si128( _mm_cmpeq_epi8( data, vcr ), lf ) ) );
+        if( white != 0xffff )
+        {
+            // Only count newlines before the first non-white character.
+            white = __builtin_ctz( ~white );
+            if( lfMask & ((1 << white) - 1) )
+                nl = 1;
+            *pos = it + white;
+            return nl;
+        }
+        if( lfMask )
+            nl = 1;
+        it += 16;
+    }
+#endif
+    for( ; it != end; ++it )
+    {
+        ch = *it;
+        if( ch == '\n' )
+            nl = 1;
+        else if( ch != ' ' && ch != '\t' && ch != '\r' )
+            break;
+    }
+    *pos = it;
+    return nl;
+}
+
+
+/*
+  Return non-zero if all characters are 7-bit ASCII.
+*/
+static int _isAscii( const uint8_t* it, const uint8_t* end )
+{
+#ifdef SCAN_SSE2
+    __m128i acc = _mm_setzero_si128();
+
+    for( ; end - it >= 16; it += 16 )
+        acc = _mm_or_si128( acc, _mm_loadu_si128( (const __m128i*) it ) );
+    if( _mm_movemask_epi8( acc ) )
+        return 0;
+#endif
+    for( ; it != end; ++it )
+    {
+        if( *it > 0x7f )
+            return 0;
+    }
+    return 1;
+}
+
+
+// Pseudo-encoding for _makeStringEnc() when _isAscii() is true.
+#define ENC_ASCII   UR_ENC_COUNT
+
 static UCell* _makeStringEnc( UThread* ut, UIndex blkN, const uint8_t* it,
                               const uint8_t* end, int enc )
 {
     UIndex strN;
     UCell* cell;
 
-    if( enc == UR_ENC_LATIN1 )
+    if( enc == ENC_ASCII )
+    {
+        // No escape sequences or multi-byte characters; copy directly.
+        UBuffer* str;
+        int len = end - it;
+        strN = ur_makeString( ut, UR_ENC_LATIN1, len );
+        str = ur_buffer( strN );
+        memCpy( str->ptr.b, it, len );
+        str->used = len;
+    }
+    else if( enc == UR_ENC_LATIN1 )
         strN = ur_makeStringLatin1( ut, it, end );
     else
         strN = ur_makeStringUtf8( ut, it, end );
@@ -629,20 +778,22 @@ static uint8_t firstCharOp[ 127 ] =
 
 extern UAtom ur_internAtomUnlocked( UThread*, const char*, const char* );
 
-/**
-  \ingroup urlan_core
+#define TOK_ONE     1   // Stop after the first top-level value.
+#define TOK_PART    2   // More input may follow end.
+#define TOK_MORE    -1
 
-  Parse UTF-8 or Latin1 data into block.
+/*
+  Parse input into block.  See ur_tokenizeB() & ur_tokenizeNext().
 
-  \param blkN           Index of initialized block buffer.
-  \param inputEncoding  UR_ENC_UTF8 or UR_ENC_LATIN1
-  \param start          Pointer to start of input data.
-  \param end            Pointer to end of input data.
+  \param flags  Mask of TOK_ONE & TOK_PART.
+  \param pos    Set to the end of the first value if TOK_ONE is used.
 
-  \return UR_OK if all input successfully parsed, or UR_THROW on syntax error.
+  \return UR_OK, UR_THROW, or TOK_MORE if TOK_PART is used and the input
+          ends before a value is complete.
 */
-UStatus ur_tokenizeB( UThread* ut, UIndex blkN, int inputEncoding,
-                      const uint8_t* start, const uint8_t* end )
+static int _tokenize( UThread* ut, UIndex blkN, int inputEncoding,
+                      const uint8_t* start, const uint8_t* end, int flags,
+                      const uint8_t** pos )
 {
 #define STACK   stack.ptr.i32
 #define BLOCK   ur_buffer( STACK[stack.used - 1] )
@@ -672,6 +823,11 @@ UStatus ur_tokenizeB( UThread* ut, UIndex blkN, int inputEncoding,
     errorMsg = msg; \
     goto error_token
 
+// An error on the last line of partial input may be due to a truncated token.
+#define CHECK_PART \
+    if( (flags & TOK_PART) && ! memchr( it, '\n', end - it ) ) \
+        goto more
+
     intern = ut->env->threadCount ? ur_internAtom : ur_internAtomUnlocked;
 
     ur_arrInit( &stack, sizeof(UIndex), 32 );
@@ -682,16 +838,41 @@ next:
 proc:
     while( ch > 0 )
     {
+        if( flags & TOK_ONE )
+        {
+            // A value is done when the next character does not continue it
+            // (e.g. '#' following a vector form word or binary base).
+            blk = ur_buffer( blkN );
+            if( blk->used && stack.used == 1 && ! vectorN )
+            {
+                cell = blk->ptr.cell + blk->used - 1;
+                if( ch != '#' || ! (ur_is(cell, UT_WORD) ||
+                                    ur_is(cell, UT_INT)) )
+                {
+                    // Number parsers (e.g. str_toVec3) may have stopped
+                    // at a truncated token.
+                    if( (flags & TOK_PART) && it == end && ! IS_WHITE(ch) )
+                        goto more;
+                    *pos = it - 1;
+                    break;
+                }
+            }
+        }
         if( ch > 126 )
             goto invalid_char;
         switch( firstCharOp[ ch ] )
         {
-        case SKIP:
-            goto next;
-
         case NL:
             sol = 1;
             tokenState = 0;
+            // Fall through...
+
+        case SKIP:
+            if( _skipWhite( &it, end ) )
+            {
+                sol = 1;
+                tokenState = 0;
+            }
             goto next;
 
         case BLK:
@@ -727,7 +908,7 @@ proc:
             token = it - 1;
             if( (ch = CS_NEXT) > 0 && isDigit(ch) )
                 goto number;
-            if( IS_WORD(ch) )
+            if( ch > 0 && IS_WORD(ch) )
                 goto word;
             goto push_word;
 
@@ -882,7 +1063,7 @@ path_seg:
                     wt = UT_LITWORD;
                     ++token;
                 }
-                else if( ! IS_WORD(ch) )
+                else if( ch < 0 || ! IS_WORD(ch) )
                 {
                     --token;
                     syntaxErrorT( "Invalid path segment" );
@@ -923,19 +1104,20 @@ path_seg:
 
         case STR:
             token = it;
-            while( (ch = CS_NEXT) > 0 )
+            mode = inputEncoding;
+            while( 1 )
             {
-                if( ch == '^' )
-                {
-                    if( CS_NEXT < 0 )
-                        break;
-                }
+                it = _scanTo( it, end, '"', '^', '\n', 0 );
+                if( it == end )
+                    goto str_term;
+                ch = *it++;
                 if( ch == '"' )
                     goto push_string;
-                if( ch == '\n' )
-                    break;
+                if( ch != '^' || it == end )
+                    goto str_term;
+                ++it;
+                mode = -1;      // Escape found.
             }
-            goto str_term;
 
         case STRB:
             if( _bracketNewline(it - 1, end, &token, &it) )
@@ -951,31 +1133,44 @@ path_seg:
                 goto next_sol;
             }
             token = it;
-            mode = 0;       // Nested depth.
-            while( (ch = CS_NEXT) > 0 )
+            mode = inputEncoding;
             {
+            int depth = 0;
+            while( 1 )
+            {
+                it = _scanTo( it, end, '{', '}', '^', 0 );
+                if( it == end )
+                    goto str_term;
+                ch = *it++;
                 if( ch == '^' )
                 {
-                    if( CS_NEXT < 0 )
-                        break;
+                    if( it == end )
+                        goto str_term;
+                    ++it;
+                    mode = -1;      // Escape found.
                 }
                 else if( ch == '{' )
-                {
-                    ++mode;
-                }
+                    ++depth;
                 else if( ch == '}' )
                 {
-                    if( mode )
-                        --mode;
-                    else
+                    if( ! depth )
                         goto push_string;
+                    --depth;
                 }
+                else
+                    goto str_term;
+            }
             }
 str_term:
             syntaxError( "String not terminated" );
 push_string:
+            // Here mode is -1 if a caret escape was found.
+            if( mode < 0 )
+                mode = inputEncoding;
+            else if( _isAscii( token, it - 1 ) )
+                mode = ENC_ASCII;
             cell = _makeStringEnc( ut, STACK[stack.used - 1],
-                                   token, TOK_END, inputEncoding );
+                                   token, it - 1, mode );
             goto next_sol;
 
         case HASH:
@@ -1050,9 +1245,9 @@ invalid_binary:
                     mode = UR_VEC_I32;
                     cell = ur_blkAppendNew( blk, UT_NONE );
                 }
-                ur_makeVectorCell( ut, mode, 0, cell );
-                vectorN = cell->series.buf;
                 vectorPos = blk->used;
+                ur_makeVectorCell( ut, mode, 0, cell );     // gc!
+                vectorN = cell->series.buf;
                 goto next_sol;
             }
             token = it - 1;
@@ -1062,18 +1257,20 @@ invalid_binary:
             ch = CS_NEXT;
             if( ch == '*' )
             {
-                mode = 0;
-                while( (ch = CS_NEXT) > 0 )
+                token = it;
+                while( 1 )
                 {
-                    if( ch == '/' && mode == '*' )
+                    it = _scanTo( it, end, '/', 0, 0, 0 );
+                    if( it == end || ! *it )
+                        goto next;
+                    ++it;
+                    if( it - token > 1 && it[-2] == '*' )
                         goto next;
-                    mode = ch;
                 }
-                goto proc;
             }
-            else if( ! IS_WORD(ch) )
+            else if( ch < 0 || ! IS_WORD(ch) )
             {
-                token = it - 2;
+                token = (ch < 0) ? it - 1 : it - 2;
                 goto push_word;
             }
             tokenState = UT_OPTION;
@@ -1097,7 +1294,7 @@ invalid_binary:
             {
                 do
                 {
-                    if( IS_DELIM( ch ) )
+                    if( ch < 0 || IS_DELIM( ch ) )
                         break;
                 }
                 while( (ch = CS_NEXT) > 0 );
@@ -1129,16 +1326,27 @@ invalid_binary:
             goto next;
 
         case COM_L:
-            while( (ch = CS_NEXT) && ch != '\n' )
-                ;
-            sol = 1;
-            break;
+            it = _scanTo( it, end, '\n', 0, 0, 0 );
+            goto next;
 
         case INV:
             goto invalid_char;
         }
     }
 
+    if( flags & TOK_ONE )
+    {
+        if( ch < 0 )
+        {
+            // A value ending at the input end might be continued.
+            if( flags & TOK_PART )
+                goto more;
+            *pos = end;
+        }
+        else if( ch == 0 )
+            *pos = it - 1;
+    }
+
     if( stack.used > 1 )
     {
         syntaxError( "Block or paren not closed" );
@@ -1159,21 +1367,79 @@ set_sol:
     goto proc;
 
 invalid_char:
+    CHECK_PART;
     ur_error( ut, UR_ERR_SYNTAX, "Unprintable/Non-ASCII Input %d (line %d)",
               ch, _lineCount(start, it) );
     goto error;
 
 error_msg:
+    CHECK_PART;
     ur_error( ut, UR_ERR_SYNTAX, "%s (line %d)",
               errorMsg, _lineCount(start, it) );
     goto error;
 
 error_token:
+    CHECK_PART;
     _errorToken( ut, errorMsg, _lineCount(start, it), token, end );
 
 error:
     ur_arrFree( &stack );
     return UR_THROW;
+
+more:
+    ur_arrFree( &stack );
+    return TOK_MORE;
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Parse UTF-8 or Latin1 data into block.
+
+  \param blkN           Index of initialized block buffer.
+  \param inputEncoding  UR_ENC_UTF8 or UR_ENC_LATIN1
+  \param start          Pointer to start of input data.
+  \param end            Pointer to end of input data.
+
+  \return UR_OK if all input successfully parsed, or UR_THROW on syntax error.
+*/
+UStatus ur_tokenizeB( UThread* ut, UIndex blkN, int inputEncoding,
+                      const uint8_t* start, const uint8_t* end )
+{
+    return _tokenize( ut, blkN, inputEncoding, start, end, 0, NULL );
+}
+
+
+/**
+  \ingroup urlan_core
+
+  Parse the first top-level value from a chunk of UTF-8 or Latin1 data.
+  This allows large inputs to be read & parsed a piece at a time.
+
+  If the chunk ends before the value is complete (or a token might be
+  continued in the following data) then nothing is consumed and -1 is
+  returned.  The caller should then append more input to the chunk and
+  call again with the same start.
+
+  \param blkN           Index of initialized empty block buffer.
+  \param inputEncoding  UR_ENC_UTF8 or UR_ENC_LATIN1
+  \param start          Pointer to start of input data.
+  \param end            Pointer to end of input data.
+  \param more           Non-zero if more input may follow end.
+  \param pos            Set to the end of the parsed input when UR_OK is
+                        returned.
+
+  \return UR_OK, UR_THROW on syntax error, or -1 if more input is needed.
+          When UR_OK is returned the block holds the value, or is empty if
+          the chunk has only whitespace & comments.
+*/
+int ur_tokenizeNext( UThread* ut, UIndex blkN, int inputEncoding,
+                     const uint8_t* start, const uint8_t* end, int more,
+                     const uint8_t** pos )
+{
+    return _tokenize( ut, blkN, inputEncoding, start, end,
+                      more ? TOK_ONE | TOK_PART : TOK_ONE, pos );
 }
 
 
@@ -320,6 +320,136 @@ int ur_readDir( UThread* ut, const char* filename, UCell* res )
 }
 
 
+/*
+  Recursive directory walk (threads are not used on Windows).
+*/
+
+typedef struct WalkDir
+{
+    struct WalkDir* next;
+    char path[1];               // Includes trailing slash.
+}
+WalkDir;
+
+struct OSWalk
+{
+    WalkDir* dirs;
+    WalkDir* cur;
+    HANDLE fh;
+    WIN32_FIND_DATA data;
+    char path[ _MAX_PATH ];
+};
+
+
+static WalkDir* _walkDirNew( const char* parent, const char* name )
+{
+    size_t plen = strlen( parent );
+    size_t nlen = strlen( name );
+    WalkDir* wd = (WalkDir*) memAlloc( sizeof(WalkDir) + plen + nlen + 1 );
+    wd->next = NULL;
+    memCpy( wd->path, parent, plen );
+    memCpy( wd->path + plen, name, nlen );
+    if( plen + nlen && wd->path[ plen + nlen - 1 ] != '/' &&
+                       wd->path[ plen + nlen - 1 ] != '\\' )
+        wd->path[ plen + nlen++ ] = '/';
+    wd->path[ plen + nlen ] = '\0';
+    return wd;
+}
+
+
+OSWalk* ur_walkOpen( const char* root, int mask, int threads )
+{
+    OSWalk* wk;
+    (void) mask;
+    (void) threads;
+
+    if( _isDir( root ) != 1 )
+        return NULL;
+    wk = (OSWalk*) memAlloc( sizeof(OSWalk) );
+    wk->dirs = _walkDirNew( root, "" );
+    wk->cur = NULL;
+    wk->fh = INVALID_HANDLE_VALUE;
+    return wk;
+}
+
+
+const char* ur_walkNext( OSWalk* wk, OSFileInfo* info, int* pathLen )
+{
+    WIN32_FIND_DATA* data = &wk->data;
+    const char* cp;
+    int len;
+
+    while( 1 )
+    {
+        if( wk->fh == INVALID_HANDLE_VALUE )
+        {
+            memFree( wk->cur );
+            if( ! (wk->cur = wk->dirs) )
+                return NULL;
+            wk->dirs = wk->cur->next;
+            if( strlen( wk->cur->path ) + 2 > _MAX_PATH )
+                continue;
+            strcpy( wk->path, wk->cur->path );
+            strcat( wk->path, "*" );
+            wk->fh = FindFirstFile( wk->path, data );
+            if( wk->fh == INVALID_HANDLE_VALUE )
+                continue;
+        }
+        else if( ! FindNextFile( wk->fh, data ) )
+        {
+            FindClose( wk->fh );
+            wk->fh = INVALID_HANDLE_VALUE;
+            continue;
+        }
+
+        cp = data->cFileName;
+        if( cp[0] == '.' && (cp[1] == '\0' || (cp[1] == '.' && cp[2] == '\0')) )
+            continue;
+        len = strlen( wk->cur->path ) + strlen( cp );
+        if( len >= _MAX_PATH )
+            continue;
+        strcpy( wk->path, wk->cur->path );
+        strcat( wk->path, cp );
+
+        info->size = data->nFileSizeLow;
+        if( data->nFileSizeHigh )
+            info->size += data->nFileSizeHigh * (((int64_t) MAXDWORD)+1);
+        info->modified = ft_to_seconds( &data->ftLastWriteTime );
+        if( data->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT )
+            info->type = FI_Link;
+        else if( data->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            WalkDir* sub = _walkDirNew( wk->cur->path, cp );
+            sub->next = wk->dirs;
+            wk->dirs = sub;
+            info->type = FI_Dir;
+        }
+        else
+            info->type = FI_File;
+
+        *pathLen = len;
+        return wk->path;
+    }
+}
+
+
+void ur_walkClose( OSWalk* wk )
+{
+    WalkDir* it;
+    WalkDir* next;
+
+    if( wk->fh != INVALID_HANDLE_VALUE )
+        FindClose( wk->fh );
+    memFree( wk->cur );
+    for( it = wk->dirs; it; it = next )
+    {
+        next = it->next;
+        memFree( it );
+    }
+    memFree( wk );
+}
+
+
 #ifdef CONFIG_EXECUTE
 static int _readInfoBuf( HANDLE fd, UBuffer* buf )
 {